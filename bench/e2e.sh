@@ -0,0 +1,158 @@
+#!/bin/bash
+
+# End-to-End Benchmark
+# 実際の送受信で、ft_pingが維持できるパケット/秒・CPU使用率・RTTの分布・ツール自身の遅延を測定する
+# 経路はループバック（127.0.0.1）と、ネットワーク名前空間につないだvethペア（netemで遅延・ロスを付けられる）
+# 動作モードごとに同じ項目を測り、test_results/e2e_report.tsv に比較できる形で書き出す
+#
+# 使い方: sudo ./bench/e2e.sh [秒数]
+# DELAY=5ms LOSS=1% : vethの応答側にnetemで遅延・ロスを付ける（tcのnetemがない環境では付けずに続ける）
+# NO_NETNS=1        : vethの経路を測らない
+# BASELINE=旧バージョンのft_ping : その実行ファイルも同じ条件で測定する（対応していないモードはn/a）
+# （例: git worktree add /tmp/base <コミット> && make -C /tmp/base ft_ping）
+#
+# モード
+#   paced       : -i 0.001（1000パケット/秒の一定間隔）。--kernel-timestampsでツール自身の遅延も測る
+#   flood       : -f -l 64（応答が返り次第送信）
+#   flood-dgram : -f -l 64 --socket dgram（ICMPデータグラムソケット）
+#   flood-4x4   : -f -l 64 --threads 4 で4宛先（ループバックのみ）
+#   *-uring     : flood・flood-dgram・flood-4x4に--io-uringを付けたもの（sendmmsg/recvmmsgとの比較用）
+
+set -e
+
+DURATION=${1:-5}
+NETNS=ftping_e2e
+HOST_IF=ftpe0
+PEER_IF=ftpe1
+HOST_ADDR=10.99.0.1
+PEER_ADDR=10.99.0.2
+REPORT=test_results/e2e_report.tsv
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping > /dev/null
+
+# データグラムソケットを全グループに許可し、終了時に元に戻す
+ORIG_PING_GROUP=$(sysctl -n net.ipv4.ping_group_range 2> /dev/null | tr '\t' ' ' || true)
+cleanup() {
+    if [ -n "$ORIG_PING_GROUP" ]; then
+        sysctl -qw net.ipv4.ping_group_range="$ORIG_PING_GROUP" 2> /dev/null || true
+    fi
+    ip netns del "$NETNS" 2> /dev/null || true
+}
+trap cleanup EXIT
+sysctl -qw net.ipv4.ping_group_range="0 2147483647" 2> /dev/null || true
+
+PATHS="lo"
+NETEM="none"
+if [ -z "$NO_NETNS" ]; then
+    ip netns del "$NETNS" 2> /dev/null || true
+    if ip netns add "$NETNS" &&
+        ip link add "$HOST_IF" type veth peer name "$PEER_IF" netns "$NETNS"; then
+        ip addr add "$HOST_ADDR/24" dev "$HOST_IF"
+        ip link set "$HOST_IF" up
+        ip netns exec "$NETNS" ip addr add "$PEER_ADDR/24" dev "$PEER_IF"
+        ip netns exec "$NETNS" ip link set "$PEER_IF" up
+        ip netns exec "$NETNS" ip link set lo up
+        # 名前空間側のEcho Replyに遅延・ロスを付ける
+        if [ -n "$DELAY" ] || [ -n "$LOSS" ]; then
+            NETEM_ARGS=""
+            [ -n "$DELAY" ] && NETEM_ARGS="delay $DELAY"
+            [ -n "$LOSS" ] && NETEM_ARGS="$NETEM_ARGS loss $LOSS"
+            if ip netns exec "$NETNS" tc qdisc add dev "$PEER_IF" root netem $NETEM_ARGS 2> /dev/null; then
+                NETEM="$NETEM_ARGS"
+            else
+                echo "warning: netem is not available; measuring veth without delay/loss"
+            fi
+        fi
+        PATHS="lo veth"
+    else
+        echo "warning: cannot create network namespace; measuring loopback only"
+    fi
+fi
+
+# 比較の前提になる環境を報告の先頭に残す
+{
+    echo "# date: $(date -u +%Y-%m-%dT%H:%M:%SZ)"
+    echo "# commit: $(git rev-parse --short HEAD 2> /dev/null || echo unknown)"
+    echo "# kernel: $(uname -r), cpus: $(nproc), duration: ${DURATION}s, netem: ${NETEM}"
+    printf "binary\tpath\tmode\tsent/s\trecv/s\tloss%%\tcpu%%\tcpu_us/probe\tp50_ms\tp90_ms\tp99_ms\tp99.9_ms\toverhead_ms\n"
+} > "$REPORT"
+
+printf "%-8s %-5s %-17s %10s %10s %6s %6s %8s %8s %8s %8s %9s\n" "binary" "path" "mode" \
+    "sent/s" "recv/s" "loss%" "cpu%" "us/probe" "p50" "p99" "p99.9" "overhead"
+
+# $1=ラベル $2=実行ファイル $3=経路 $4=モード
+run_case() {
+    local LABEL=$1 BIN=$2 PATH_NAME=$3 MODE=$4
+    local TARGETS ARGS
+    local LOG="test_results/e2e_${LABEL}_${PATH_NAME}_${MODE}.txt"
+
+    if [ "$PATH_NAME" = "lo" ]; then
+        TARGETS=127.0.0.1
+    else
+        TARGETS=$PEER_ADDR
+    fi
+    case "${MODE%-uring}" in
+        paced) ARGS="-i 0.001 --kernel-timestamps" ;;
+        flood) ARGS="-f -l 64" ;;
+        flood-dgram) ARGS="-f -l 64 --socket dgram" ;;
+        flood-4x4)
+            [ "$PATH_NAME" = "lo" ] || return 0
+            ARGS="-f -l 64 --threads 4"
+            TARGETS="127.0.0.1 127.0.0.2 127.0.0.3 127.0.0.4"
+            ;;
+    esac
+    case "$MODE" in
+        *-uring) ARGS="$ARGS --io-uring" ;;
+    esac
+
+    # -wで終了させ、終了時の統計から読む（-wのないバージョンはSIGINTで止める）
+    local CPU
+    TIMEFORMAT="%U %S"
+    CPU=$( { time timeout -s INT $((DURATION + 2)) "$BIN" -w "$DURATION" -q $ARGS $TARGETS > "$LOG" 2>&1 || true; } 2>&1 )
+
+    local SENT RECV
+    SENT=$(awk '/packets transmitted/ { print $1 }' "$LOG")
+    # io_uringを使えない環境ではsendmmsg/recvmmsgに切り替わるので、比較にならない
+    if grep -q "io_uring unavailable" "$LOG"; then
+        SENT=""
+    fi
+    RECV=$(awk '/packets transmitted/ { print $4 }' "$LOG")
+    if [ -z "$SENT" ] || [ "$SENT" -eq 0 ]; then
+        printf "%-8s %-5s %-17s %10s\n" "$LABEL" "$PATH_NAME" "$MODE" "n/a"
+        printf "%s\t%s\t%s\tn/a\n" "$LABEL" "$PATH_NAME" "$MODE" >> "$REPORT"
+        return 0
+    fi
+    local PCT
+    PCT=$(awk -F'[=/ ]+' '/round-trip p50/ { print $6, $7, $8, $9 }' "$LOG")
+    [ -n "$PCT" ] || PCT="n/a n/a n/a n/a"
+    local OVERHEAD
+    OVERHEAD=$(awk -F'[=/ ]+' '/^tool overhead/ { print $7 }' "$LOG")
+    [ -n "$OVERHEAD" ] || OVERHEAD="-"
+
+    echo "$CPU $SENT $RECV $PCT $OVERHEAD" | awk -v d="$DURATION" -v label="$LABEL" \
+        -v path="$PATH_NAME" -v mode="$MODE" -v report="$REPORT" '{
+        cpu = $1 + $2
+        sent = $3 / d; recv = $4 / d
+        loss = ($3 > 0) ? 100.0 * ($3 - $4) / $3 : 0
+        printf "%-8s %-5s %-17s %10.0f %10.0f %6.2f %6.1f %8.2f %8s %8s %8s %9s\n",
+            label, path, mode, sent, recv, loss, 100.0 * cpu / d,
+            cpu * 1e6 / $3, $5, $7, $8, $9
+        printf "%s\t%s\t%s\t%.0f\t%.0f\t%.2f\t%.1f\t%.2f\t%s\t%s\t%s\t%s\t%s\n",
+            label, path, mode, sent, recv, loss, 100.0 * cpu / d,
+            cpu * 1e6 / $3, $5, $6, $7, $8, $9 >> report
+    }'
+}
+
+for PATH_NAME in $PATHS; do
+    for MODE in paced flood flood-dgram flood-4x4 flood-uring flood-dgram-uring flood-4x4-uring; do
+        run_case current ./ft_ping "$PATH_NAME" "$MODE"
+        if [ -n "$BASELINE" ]; then
+            run_case baseline "$BASELINE" "$PATH_NAME" "$MODE"
+        fi
+    done
+done
+
+echo "Report saved to $REPORT"
@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# BPF Filter Benchmark
+# 他のpingプロセスが同時に動いている状態で、BPFフィルタの有無による
+# ft_pingのCPU時間と受信パケット数を比較する
+#
+# 使い方: sudo ./bench/filter_cpu.sh [秒数] [競合プロセス数]
+# 競合プロセスはループバックの別アドレスへfloodモードでpingする
+
+set -e
+
+DURATION=${1:-5}
+COMPETITORS=${2:-4}
+INTERVAL=0.001
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping > /dev/null
+
+PIDS=""
+cleanup() {
+    for pid in $PIDS; do
+        kill -INT "$pid" 2> /dev/null || true
+    done
+    wait 2> /dev/null || true
+}
+trap cleanup EXIT
+
+for i in $(seq 1 "$COMPETITORS"); do
+    ./ft_ping -f -l 16 "127.0.1.$i" > /dev/null 2>&1 &
+    PIDS="$PIDS $!"
+done
+sleep 1
+
+echo "=== ${COMPETITORS} competing flood pingers, measured: -i ${INTERVAL} for ${DURATION}s ==="
+printf "%10s %12s %12s %16s\n" "mode" "cpu (ms)" "rx packets" "cpu/reply (us)"
+
+for MODE in filter no-filter; do
+    LOG="test_results/filter_cpu_${MODE}.txt"
+    FLAGS="-v -i $INTERVAL"
+    if [ "$MODE" = "no-filter" ]; then
+        FLAGS="$FLAGS --no-filter"
+    fi
+    # timeoutの子プロセスとして測るので、ft_pingのユーザ+システムCPU時間が得られる
+    TIMEFORMAT="%U %S"
+    CPU=$( { time timeout -s INT "$DURATION" ./ft_ping $FLAGS 127.0.0.1 > "$LOG" 2>&1 || true; } 2>&1 )
+    CPU_MS=$(echo "$CPU" | awk '{ printf "%.0f", ($1 + $2) * 1000 }')
+    RX=$(awk '/^rx:/ { print $2 }' "$LOG")
+    REPLIES=$(awk '/packets received/ { print $4 }' "$LOG")
+    PER_REPLY=$(awk -v c="$CPU_MS" -v r="$REPLIES" 'BEGIN { printf "%.1f", (r > 0) ? c * 1000 / r : 0 }')
+    printf "%10s %12s %12s %16s\n" "$MODE" "$CPU_MS" "$RX" "$PER_REPLY"
+done
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Output Throughput Benchmark
+# 応答ごとに1行出力する状態で、出力形式・出力先ごとの応答/秒と応答1つあたりのCPU時間を測定する
+# 送信は10マイクロ秒間隔（約10万パケット/秒）が上限なので、上限に達した場合はCPU時間で比べる
+# 出力先は端末（scriptで擬似端末を割り当てる。stdioは行バッファになる）とファイル
+#
+# 使い方: sudo ./bench/output_rate.sh [秒数] [宛先]
+# BASELINE=旧バージョンのft_ping を指定すると、その実行ファイルのテキスト出力も同じ条件で測定する
+# （例: git worktree add /tmp/base <コミット> && make -C /tmp/base ft_ping）
+
+set -e
+
+DURATION=${1:-5}
+TARGET=${2:-127.0.0.1}
+ARGS="-i 0.00001 -l 64"
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping > /dev/null
+
+# $1=名前 $2=出力先(tty|file) $3=実行ファイル 残り=追加の引数
+run_case() {
+    local NAME=$1 SINK=$2 BIN=$3
+    shift 3
+    local LOG="test_results/output_rate_${NAME}_${SINK}.txt"
+    local STATS="test_results/output_rate_${NAME}_${SINK}.stats"
+    local CMD="timeout -s INT $DURATION $BIN $ARGS $* $TARGET"
+
+    local CPU
+    TIMEFORMAT="%U %S"
+    if [ "$SINK" = "tty" ]; then
+        # scriptのCPU時間も含まれるが、擬似端末へ書き出す量に比例するので出力の費用として数える
+        CPU=$( { time script -qec "$CMD" /dev/null > "$LOG" 2>&1 || true; } 2>&1 )
+        cp "$LOG" "$STATS"
+    else
+        CPU=$( { time $CMD > "$LOG" 2> "$STATS" || true; } 2>&1 )
+        cat "$LOG" >> "$STATS"
+    fi
+    local REPLIES=$(awk '/packets received/ { print $4; exit }' "$STATS")
+    if [ -z "$REPLIES" ]; then
+        echo "${NAME} (${SINK}): no result (see ${LOG})"
+        return
+    fi
+    local LINES=$(grep -c 'icmp_seq=\|"seq"\|^[0-9.]*,[0-9]' "$LOG" || true)
+    local RATE=$(awk -v r="$REPLIES" -v d="$DURATION" 'BEGIN { printf "%.0f", r / d }')
+    local PER_REPLY=$(echo "$CPU" | awk -v r="$REPLIES" '{ printf "%.2f", (r > 0) ? ($1 + $2) * 1000000 / r : 0 }')
+    printf "%10s %6s %12s %12s %12s %16s\n" "$NAME" "$SINK" "$REPLIES" "$LINES" "$RATE" "$PER_REPLY"
+}
+
+echo "=== ${ARGS} to ${TARGET} for ${DURATION}s ==="
+printf "%10s %6s %12s %12s %12s %16s\n" "format" "sink" "replies" "lines" "replies/s" "cpu/reply (us)"
+
+for SINK in tty file; do
+    if [ -n "$BASELINE" ]; then
+        run_case baseline "$SINK" "$BASELINE"
+    fi
+    run_case text "$SINK" ./ft_ping
+    run_case jsonl "$SINK" ./ft_ping --format=jsonl
+    run_case csv "$SINK" ./ft_ping --format=csv
+    run_case quiet "$SINK" ./ft_ping -q
+done
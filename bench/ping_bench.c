@@ -0,0 +1,435 @@
+// ping_bench.c: 送受信のホットパスのマイクロベンチマーク
+// root権限もネットワークも使わずに、1操作あたりのナノ秒を測定する
+//   checksum   : ping_checksumのペイロードサイズごとの計算
+//   rx         : 合成したIP+ICMPパケットに対するprocess_replyの解析・照合・統計更新・出力
+//   stats      : RTT統計・ヒストグラムの更新とパーセンタイルの計算
+//   window     : 送信記録のリングの確保と照合
+//   wheel      : 応答待ちのタイマーの登録・取り消し・満了
+// 各ケースは1回の計測が約BENCH_TARGET_NS以上になるよう操作数を決め、
+// BENCH_REPS回繰り返した中央値・最小値・最大値を表示する
+//
+// 使い方: make bench または ./obj/ping_bench [ケース名の一部...]
+
+#include "ping.h"
+#include "ping_checksum.h"
+#include "ping_engine.h"
+#include "ping_output.h"
+#include "ping_packet.h"
+#include "ping_sched.h"
+#include "ping_stats.h"
+#include "ping_target.h"
+#include "ping_wheel.h"
+#include "ping_window.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_REPS 11
+#define BENCH_TARGET_NS 20000000.0 // 1回の計測の目安（20ミリ秒）
+#define RX_PACKETS 1024            // 受信ベンチマークで使い回すパケット数
+#define RX_PACKET_SIZE (20 + ICMP_HDRLEN + ICMP_DATA_SIZE)
+
+// 最適化で計算が消えないよう、結果をここへ足し込む
+static volatile unsigned long long sink;
+
+static char **filters;
+static int filter_count;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int selected(const char *name) {
+  if (filter_count == 0) {
+    return 1;
+  }
+  for (int i = 0; i < filter_count; i++) {
+    if (strstr(name, filters[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// run(arg, iters)でiters回の操作を行うケースを測定して1行表示する
+static void bench(const char *name, void (*run)(void *arg, long iters),
+                  void *arg) {
+  double samples[BENCH_REPS];
+  long iters = 1;
+
+  if (!selected(name)) {
+    return;
+  }
+  // 操作数を倍にしながら目安の時間に届く数を探す（キャッシュ・分岐予測の暖機も兼ねる）
+  for (;;) {
+    double start = now_ns();
+    run(arg, iters);
+    double elapsed = now_ns() - start;
+    if (elapsed >= BENCH_TARGET_NS || iters >= (1L << 40)) {
+      break;
+    }
+    iters *= 2;
+  }
+  for (int rep = 0; rep < BENCH_REPS; rep++) {
+    double start = now_ns();
+    run(arg, iters);
+    samples[rep] = (now_ns() - start) / (double)iters;
+  }
+  qsort(samples, BENCH_REPS, sizeof(double), compare_double);
+  printf("%-28s %12.2f %12.2f %12.2f %12ld\n", name, samples[BENCH_REPS / 2],
+         samples[0], samples[BENCH_REPS - 1], iters);
+  fflush(stdout);
+}
+
+// --- checksum ---
+
+typedef struct {
+  unsigned char *buf;
+  int len;
+  unsigned short (*fn)(const void *b, int len);
+} ChecksumBench;
+
+static unsigned short checksum_dispatch(const void *b, int len) {
+  return ping_checksum((void *)b, len);
+}
+
+static void run_checksum(void *arg, long iters) {
+  ChecksumBench *cb = arg;
+  unsigned long long sum = 0;
+  for (long i = 0; i < iters; i++) {
+    // 毎回ヘッダを書き換えて、同じ入力の計算をまとめられないようにする
+    cb->buf[6] = (unsigned char)i;
+    sum += cb->fn(cb->buf, cb->len);
+  }
+  sink += sum;
+}
+
+static void bench_checksum(void) {
+  static const int sizes[] = {ICMP_HDRLEN, PACKET_SIZE, 512, 1472, 9000,
+                              ICMP_HDRLEN + PING_MAX_DATA_SIZE};
+  ChecksumBench cb;
+  char name[64];
+
+  cb.buf = malloc(ICMP_HDRLEN + PING_MAX_DATA_SIZE);
+  if (!cb.buf) {
+    return;
+  }
+  for (int i = 0; i < ICMP_HDRLEN + PING_MAX_DATA_SIZE; i++) {
+    cb.buf[i] = (unsigned char)(i * 131 + 7);
+  }
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    cb.len = sizes[i];
+    cb.fn = checksum_dispatch;
+    snprintf(name, sizeof(name), "checksum/%d", sizes[i]);
+    bench(name, run_checksum, &cb);
+  }
+  // 実装ごとの比較は典型的なパケットサイズだけ測る
+  cb.len = PACKET_SIZE;
+  cb.fn = ping_checksum_scalar;
+  bench("checksum/scalar/64", run_checksum, &cb);
+  cb.fn = ping_checksum_wide;
+  bench("checksum/wide/64", run_checksum, &cb);
+  free(cb.buf);
+}
+
+// --- rx ---
+
+typedef struct {
+  PingContext ctx;
+  unsigned char packets[RX_PACKETS][RX_PACKET_SIZE];
+  struct sockaddr_in from;
+  struct timespec ts_recv;
+  int reset; // 受信済みの印を戻し、毎回初めての応答として処理する
+} RxBench;
+
+static void build_packet(RxBench *rb, int index, int type, int ident,
+                         const struct timespec *sent) {
+  unsigned char *p = rb->packets[index];
+  struct iphdr *ip = (struct iphdr *)p;
+  struct icmphdr *icmp = (struct icmphdr *)(p + sizeof(struct iphdr));
+
+  memset(p, 0, RX_PACKET_SIZE);
+  ip->version = 4;
+  ip->ihl = 5;
+  ip->ttl = 64;
+  ip->protocol = IPPROTO_ICMP;
+  ip->tot_len = htons(RX_PACKET_SIZE);
+  ip->saddr = rb->from.sin_addr.s_addr;
+  icmp->type = type;
+  icmp->un.echo.id = htons(ident);
+  icmp->un.echo.sequence = htons(index);
+  memcpy((unsigned char *)icmp + ICMP_HDRLEN, sent, sizeof(*sent));
+  icmp->checksum = ping_checksum(icmp, ICMP_HDRLEN + ICMP_DATA_SIZE);
+}
+
+// 送信済みの記録と、それに対する応答パケットを用意する
+static int setup_rx(RxBench *rb, PingFormat format, int quiet) {
+  memset(rb, 0, sizeof(*rb));
+  if (initialize_context(&rb->ctx) < 0) {
+    return -1;
+  }
+  PingContext *ctx = &rb->ctx;
+  ctx->socket_type = PING_SOCKET_RAW;
+  ctx->format = format;
+  ctx->quiet = quiet;
+  ctx->ident = 0x1234;
+  // 受信結果は捨てる（出力の整形と書き出しの費用は含める）
+  int fd = open("/dev/null", O_WRONLY);
+  clock_gettime(CLOCK_MONOTONIC, &rb->ts_recv);
+  if (fd < 0 || init_output(&ctx->out, fd) < 0 ||
+      init_timer_wheel(&ctx->wheel, ctx->window.size,
+                       timespec_to_ms(&rb->ts_recv)) < 0) {
+    return -1;
+  }
+  rb->from.sin_family = AF_INET;
+  rb->from.sin_addr.s_addr = htonl(0x7F000001);
+  if (add_resolved_target(ctx, "localhost", &rb->from) < 0) {
+    return -1;
+  }
+
+  struct timespec sent = rb->ts_recv;
+  sent.tv_sec -= 1;
+  for (int i = 0; i < RX_PACKETS; i++) {
+    PingSeqSlot *slot = claim_seq_slot(&ctx->window, i);
+    slot->target = 0;
+    slot->sent_time = sent;
+    build_packet(rb, i, ICMP_ECHOREPLY, ctx->ident, &sent);
+  }
+  ctx->packets_sent = RX_PACKETS;
+  rb->reset = 1;
+  return 0;
+}
+
+static void close_rx(RxBench *rb) {
+  int fd = rb->ctx.out.fd;
+  cleanup_context(&rb->ctx);
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+static void run_rx(void *arg, long iters) {
+  RxBench *rb = arg;
+  PingContext *ctx = &rb->ctx;
+  unsigned long long sum = 0;
+
+  for (long i = 0; i < iters; i++) {
+    int index = (int)(i & (RX_PACKETS - 1));
+    sum += (unsigned long long)process_reply(ctx, (char *)rb->packets[index],
+                                             RX_PACKET_SIZE, &rb->from,
+                                             &rb->ts_recv, NULL);
+    if (rb->reset) {
+      ctx->window.slots[index].received = 0;
+    }
+  }
+  sink += sum + (unsigned long long)ctx->packets_received;
+}
+
+static void bench_rx_case(const char *name, PingFormat format, int quiet,
+                          int reset, int type, int ident, int corrupt) {
+  RxBench *rb = malloc(sizeof(RxBench));
+
+  if (!rb || setup_rx(rb, format, quiet) < 0) {
+    fprintf(stderr, "ping_bench: %s: setup failed\n", name);
+    free(rb);
+    return;
+  }
+  rb->reset = reset;
+  if (type != ICMP_ECHOREPLY || ident != rb->ctx.ident || corrupt) {
+    struct timespec sent = rb->ctx.window.slots[0].sent_time;
+    for (int i = 0; i < RX_PACKETS; i++) {
+      build_packet(rb, i, type, ident, &sent);
+      if (corrupt) {
+        rb->packets[i][RX_PACKET_SIZE - 1] ^= 0xFF;
+      }
+    }
+  }
+  bench(name, run_rx, rb);
+  close_rx(rb);
+  free(rb);
+}
+
+static void bench_rx(void) {
+  bench_rx_case("rx/reply/quiet", PING_FORMAT_TEXT, 1, 1, ICMP_ECHOREPLY,
+                0x1234, 0);
+  bench_rx_case("rx/reply/text", PING_FORMAT_TEXT, 0, 1, ICMP_ECHOREPLY,
+                0x1234, 0);
+  bench_rx_case("rx/reply/jsonl", PING_FORMAT_JSONL, 0, 1, ICMP_ECHOREPLY,
+                0x1234, 0);
+  bench_rx_case("rx/reply/csv", PING_FORMAT_CSV, 0, 1, ICMP_ECHOREPLY, 0x1234,
+                0);
+  bench_rx_case("rx/duplicate/quiet", PING_FORMAT_TEXT, 1, 0, ICMP_ECHOREPLY,
+                0x1234, 0);
+  // 他のプロセス宛ての応答と、ループバックで届く自分のEcho Requestは早く捨てる
+  bench_rx_case("rx/foreign-id", PING_FORMAT_TEXT, 1, 0, ICMP_ECHOREPLY,
+                0x4321, 0);
+  bench_rx_case("rx/echo-request", PING_FORMAT_TEXT, 1, 0, ICMP_ECHO, 0x1234,
+                0);
+  bench_rx_case("rx/bad-checksum", PING_FORMAT_TEXT, 1, 0, ICMP_ECHOREPLY,
+                0x1234, 1);
+}
+
+// --- stats ---
+
+typedef struct {
+  PingRttStats rtt;
+  PingHistogram hist;
+  PingIntervalStats a, b;
+  double rtts[1024];
+} StatsBench;
+
+static void run_rtt_sample(void *arg, long iters) {
+  StatsBench *sb = arg;
+  for (long i = 0; i < iters; i++) {
+    add_rtt_sample(&sb->rtt, sb->rtts[i & 1023]);
+  }
+  sink += (unsigned long long)sb->rtt.count;
+}
+
+static void run_histogram_record(void *arg, long iters) {
+  StatsBench *sb = arg;
+  for (long i = 0; i < iters; i++) {
+    histogram_record(&sb->hist, sb->rtts[i & 1023]);
+  }
+  sink += sb->hist.total;
+}
+
+static void run_histogram_percentile(void *arg, long iters) {
+  StatsBench *sb = arg;
+  double sum = 0.0;
+  for (long i = 0; i < iters; i++) {
+    sum += histogram_percentile(&sb->hist, 99.0);
+  }
+  sink += (unsigned long long)sum;
+}
+
+static void run_interval_merge(void *arg, long iters) {
+  StatsBench *sb = arg;
+  for (long i = 0; i < iters; i++) {
+    merge_interval_stats(&sb->a, &sb->b);
+  }
+  sink += (unsigned long long)sb->a.packets_sent;
+}
+
+static void bench_stats(void) {
+  StatsBench *sb = calloc(1, sizeof(StatsBench));
+  unsigned long long seed = 1;
+
+  if (!sb) {
+    return;
+  }
+  // 0.05〜200ミリ秒に散らばるRTT
+  for (int i = 0; i < 1024; i++) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    sb->rtts[i] = 0.05 * (double)(1 + (seed >> 33) % 4000);
+  }
+  for (int i = 0; i < 1024; i++) {
+    histogram_record(&sb->b.hist, sb->rtts[i]);
+    add_rtt_sample(&sb->b.rtt, sb->rtts[i]);
+  }
+  sb->b.packets_sent = 1024;
+  bench("stats/rtt-sample", run_rtt_sample, sb);
+  bench("stats/histogram-record", run_histogram_record, sb);
+  bench("stats/histogram-p99", run_histogram_percentile, sb);
+  bench("stats/interval-merge", run_interval_merge, sb);
+  free(sb);
+}
+
+// --- window / wheel ---
+
+typedef struct {
+  PingSeqWindow window;
+  PingTimerWheel wheel;
+  unsigned long long expired;
+} WindowBench;
+
+static void run_window(void *arg, long iters) {
+  WindowBench *wb = arg;
+  unsigned long long hits = 0;
+  // 送信番号は一周してもよいよう、int の範囲内で巡回させる
+  for (long i = 0; i < iters; i++) {
+    int number = (int)(i & 0x3FFFFFFF);
+    claim_seq_slot(&wb->window, number);
+    int found = seq_window_number(&wb->window, number & 0xFFFF, number + 1);
+    hits += seq_slot(&wb->window, found, number + 1) != NULL;
+  }
+  sink += hits;
+}
+
+static void run_wheel_cancel(void *arg, long iters) {
+  WindowBench *wb = arg;
+  unsigned long long now = wb->wheel.now;
+  for (long i = 0; i < iters; i++) {
+    int id = (int)(i & (PING_SEQ_WINDOW - 1));
+    timer_wheel_add(&wb->wheel, id, now + 10000);
+    timer_wheel_cancel(&wb->wheel, id);
+  }
+  sink += (unsigned long long)wb->wheel.count;
+}
+
+static void count_expired(void *arg, int id) {
+  WindowBench *wb = arg;
+  wb->expired += (unsigned long long)id + 1;
+}
+
+// 1ミリ秒ごとに1つ送信し、応答がないまま10秒後に満了する定常状態
+static void run_wheel_expire(void *arg, long iters) {
+  WindowBench *wb = arg;
+  for (long i = 0; i < iters; i++) {
+    unsigned long long now = wb->wheel.now + 1;
+    timer_wheel_advance(&wb->wheel, now, count_expired, wb);
+    timer_wheel_add(&wb->wheel, (int)(now & (PING_SEQ_WINDOW - 1)),
+                    now + 10000);
+  }
+  sink += wb->expired;
+}
+
+static void bench_window(void) {
+  WindowBench wb;
+
+  memset(&wb, 0, sizeof(wb));
+  if (create_seq_window(&wb.window, PING_SEQ_WINDOW) < 0 ||
+      init_timer_wheel(&wb.wheel, PING_SEQ_WINDOW, 1) < 0) {
+    free_seq_window(&wb.window);
+    return;
+  }
+  bench("window/claim-lookup", run_window, &wb);
+  bench("wheel/add-cancel", run_wheel_cancel, &wb);
+  bench("wheel/add-expire", run_wheel_expire, &wb);
+  close_timer_wheel(&wb.wheel);
+  free_seq_window(&wb.window);
+}
+
+int main(int argc, char *argv[]) {
+  filters = argv + 1;
+  filter_count = argc - 1;
+
+  // 計測中にCPUを移ると結果がぶれるので、今のCPUに固定する
+  int cpu = sched_getcpu();
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+  }
+
+  printf("%-28s %12s %12s %12s %12s\n", "case", "ns/op(med)", "min", "max",
+         "iters");
+  bench_checksum();
+  bench_rx();
+  bench_stats();
+  bench_window();
+  return EXIT_SUCCESS;
+}
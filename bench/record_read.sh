@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Probe Log Benchmark
+# 同じ送受信を--recordの記録ファイルとJSON Linesの両方に書き、
+# ファイルの大きさと、統計を求めるまでの時間（ft_ping_read と awkでのJSON Linesの集計）を比べる
+#
+# 使い方: sudo ./bench/record_read.sh [秒数(既定5)]
+# 127.0.0.1へ間隔10マイクロ秒・先行送信64で記録する（floodは受信結果を出力しないため）
+
+set -e
+
+DURATION=${1:-5}
+LOG=test_results/record_read.bin
+JSONL=test_results/record_read.jsonl
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping ft_ping_read > /dev/null
+
+echo "Recording ${DURATION}s of ping to 127.0.0.1..."
+./ft_ping -i 0.00001 -l 64 -w "$DURATION" --format=jsonl --record "$LOG" 127.0.0.1 \
+    > "$JSONL" 2> test_results/record_read_live.txt || true
+
+# ページキャッシュに載せてから測る
+cat "$LOG" "$JSONL" > /dev/null
+
+PROBES=$(awk '/packets transmitted/ { print $1 }' test_results/record_read_live.txt)
+printf "%-12s %12s %12s %10s %14s\n" "format" "bytes" "bytes/probe" "seconds" "probes/s"
+
+# $1=名前 $2=ファイル 残り=集計するコマンド
+measure() {
+    local NAME=$1 FILE=$2
+    shift 2
+    local START END SIZE
+    SIZE=$(stat -c %s "$FILE")
+    START=$(date +%s.%N)
+    "$@" > "test_results/record_read_${NAME}.txt"
+    END=$(date +%s.%N)
+    awk -v name="$NAME" -v size="$SIZE" -v probes="$PROBES" -v start="$START" -v end="$END" \
+        'BEGIN { printf "%-12s %12d %12.1f %10.3f %14.0f\n", name, size, size / probes,
+                 end - start, probes / (end - start) }'
+}
+
+measure binary "$LOG" ./ft_ping_read "$LOG"
+# JSON Linesは応答の行だけなので、送信数・受信数・RTTの最小/平均/最大だけを求める
+measure jsonl "$JSONL" awk -F'[:,}]' '
+    /"status":"reply"/ { for (i = 1; i < NF; i++) if ($i ~ /"rtt_ms"/) rtt = $(i + 1)
+                         n++; sum += rtt; if (n == 1 || rtt < min) min = rtt; if (rtt > max) max = rtt }
+    END { printf "%d replies, min/avg/max = %.3f/%.3f/%.3f ms\n", n, min, sum / n, max }' "$JSONL"
+
+echo "--- live ---"
+grep -E "transmitted|round-trip" test_results/record_read_live.txt
+echo "--- ft_ping_read ---"
+grep -E "transmitted|round-trip" test_results/record_read_binary.txt
+echo "--- awk (jsonl) ---"
+cat test_results/record_read_jsonl.txt
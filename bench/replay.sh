@@ -0,0 +1,79 @@
+#!/bin/bash
+
+# Capture Replay Benchmark
+# --replayで大きなキャプチャを読んだときのパケット/秒とMB/秒を測定する
+# キャプチャは試験用に生成する（宛先TARGETS個へ交互に送り、LOSS_EVERY回に1回は応答なし）
+#
+# 使い方: ./bench/replay.sh [パケット数(既定2000000)]
+# 2回目以降はページキャッシュに載った状態で読むので、ディスクではなくft_ping自身の速さになる
+# 既存のキャプチャを測るときは CAPTURE=ファイル を指定する
+
+set -e
+
+PACKETS=${1:-2000000}
+TARGETS=${TARGETS:-64}
+LOSS_EVERY=${LOSS_EVERY:-100}
+CAPTURE=${CAPTURE:-test_results/replay_bench.pcap}
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping > /dev/null
+
+if [ ! -f "$CAPTURE" ]; then
+    echo "Generating $CAPTURE ($PACKETS packets)..."
+    python3 - "$CAPTURE" "$PACKETS" "$TARGETS" "$LOSS_EVERY" << 'PYEOF'
+import struct, sys
+path, packets, targets, loss_every = sys.argv[1], int(sys.argv[2]), int(sys.argv[3]), int(sys.argv[4])
+
+def checksum(data):
+    s = sum(struct.unpack("!%dH" % (len(data) // 2), data))
+    s = (s >> 16) + (s & 0xFFFF)
+    s += s >> 16
+    return ~s & 0xFFFF
+
+def frame(src, dst, icmp_type, seq, payload):
+    icmp = struct.pack("!BBHHH", icmp_type, 0, 0, 0x4242, seq & 0xFFFF) + payload
+    icmp = icmp[:2] + struct.pack("!H", checksum(icmp)) + icmp[4:]
+    ip = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + len(icmp), 0, 0, 64, 1, 0, src, dst)
+    return b"\0" * 12 + b"\x08\x00" + ip + icmp
+
+out = open(path, "wb")
+out.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, 65535, 1))
+self_addr = bytes([10, 0, 0, 1])
+t = 1700000000 * 1000000
+written = 0
+seq = 0
+buf = []
+while written < packets:
+    peer = bytes([10, 1, seq % targets // 256, 1 + seq % targets % 254])
+    payload = struct.pack("<QQ", t // 1000000, t % 1000000 * 1000) + bytes(40)
+    req = frame(self_addr, peer, 8, seq, payload)
+    buf.append(struct.pack("<IIII", t // 1000000, t % 1000000, len(req), len(req)) + req)
+    written += 1
+    if seq % loss_every != 0:
+        rt = t + 200 + seq % 97
+        rep = frame(peer, self_addr, 0, seq, payload)
+        buf.append(struct.pack("<IIII", rt // 1000000, rt % 1000000, len(rep), len(rep)) + rep)
+        written += 1
+    t += 1000
+    seq += 1
+    if len(buf) >= 65536:
+        out.write(b"".join(buf))
+        buf = []
+out.write(b"".join(buf))
+PYEOF
+fi
+
+SIZE=$(stat -c %s "$CAPTURE")
+printf "%-8s %12s %12s %10s\n" "run" "packets/s" "MB/s" "seconds"
+for RUN in 1 2 3; do
+    LOG="test_results/replay_${RUN}.txt"
+    ./ft_ping -q --replay "$CAPTURE" > "$LOG" 2>&1
+    awk -v run="$RUN" -v size="$SIZE" '/^replay: .* packets\/s/ {
+        for (i = 1; i <= NF; i++) if ($i == "s,") secs = $(i - 1)
+        printf "%-8s %12.0f %12.1f %10.3f\n", run, $2 / secs, size / 1e6 / secs, secs
+    }' "$LOG"
+done
+grep "packets transmitted" "test_results/replay_3.txt"
+echo "Results saved to test_results/replay_*.txt"
@@ -0,0 +1,114 @@
+#!/bin/bash
+
+# Name Resolution Startup Benchmark
+# 多数のホスト名を宛先にしたとき、起動から最初の応答まで・最後の応答まで・終了までの時間を測定する
+# （--dns-cacheでは終了時にTTLの問い合わせを待つので、送受信は最後の応答までの時間で比べる）
+# 名前解決を1つずつ行う場合（--resolvers 1）、並列に行う場合、キャッシュが空の場合・温まった場合を比べる
+#
+# 使い方: sudo ./bench/resolve_startup.sh [宛先ファイル]
+# 宛先ファイルを省略すると、127.0.0.1:53に応答を遅らせる試験用のDNSサーバを立て、
+# HOSTS個（既定200）の名前を作って使う（/etc/resolv.confのnameserverが127.0.0.1の環境用）
+# DELAY_MS=DNSサーバの応答の遅延（既定50ミリ秒）, TTL=応答に付けるTTL（既定300秒）
+
+set -e
+
+HOSTS=${HOSTS:-200}
+DELAY_MS=${DELAY_MS:-50}
+TTL=${TTL:-300}
+HOSTS_FILE=$1
+CACHE=test_results/resolve_startup.cache
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping > /dev/null
+
+DNS_PID=
+cleanup() {
+    if [ -n "$DNS_PID" ]; then
+        kill "$DNS_PID" 2> /dev/null || true
+    fi
+}
+trap cleanup EXIT
+
+if [ -z "$HOSTS_FILE" ]; then
+    # 名前からループバックのアドレスを決めて、DELAY_MSだけ遅らせて答える
+    python3 - "$DELAY_MS" "$TTL" << 'EOF' &
+import socket, struct, sys, threading, zlib
+delay = int(sys.argv[1]) / 1000.0
+ttl = int(sys.argv[2])
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+sock.bind(("127.0.0.1", 53))
+
+def answer(data, peer):
+    qid, _, qdcount = struct.unpack("!HHH", data[:6])
+    end = 12
+    labels = []
+    while data[end] != 0:
+        labels.append(data[end + 1:end + 1 + data[end]].decode())
+        end += 1 + data[end]
+    qtype = struct.unpack("!H", data[end + 1:end + 3])[0]
+    question = data[12:end + 5]
+    name = ".".join(labels)
+    if qtype == 1:
+        h = zlib.crc32(name.encode())
+        rr = struct.pack("!HHHIH", 0xC00C, 1, 1, ttl, 4)
+        rr += bytes([127, 1 + (h >> 16) % 254, (h >> 8) % 256, 1 + h % 254])
+        header = struct.pack("!HHHHHH", qid, 0x8180, 1, 1, 0, 0)
+    else:
+        rr = b""
+        header = struct.pack("!HHHHHH", qid, 0x8180, 1, 0, 0, 0)
+    sock.sendto(header + question + rr, peer)
+
+while True:
+    data, peer = sock.recvfrom(512)
+    threading.Timer(delay, answer, (data, peer)).start()
+EOF
+    DNS_PID=$!
+    sleep 0.5
+    HOSTS_FILE=test_results/resolve_startup.hosts
+    for i in $(seq 1 "$HOSTS"); do
+        echo "h$i.ftping.test"
+    done > "$HOSTS_FILE"
+fi
+
+COUNT=$(grep -cv '^\s*\(#\|$\)' "$HOSTS_FILE")
+echo "Destinations: $COUNT"
+printf "%-24s %16s %15s %9s %10s\n" "case" "first reply(s)" "last reply(s)" "exit(s)" \
+    "replies"
+
+# $1=名前 残り=追加の引数
+# 各宛先に1回ずつ送り、最初と最後の応答行が出た時刻と終了した時刻を測る
+run_case() {
+    local NAME=$1
+    shift
+    local LOG="test_results/resolve_startup_${NAME}.txt"
+    local START FIRST LAST END
+
+    START=$EPOCHREALTIME
+    FIRST=
+    LAST=
+    while IFS= read -r line; do
+        if [[ "$line" == *'"status":"reply"'* ]]; then
+            LAST=$EPOCHREALTIME
+            FIRST=${FIRST:-$LAST}
+        fi
+        echo "$line"
+    done < <(./ft_ping -c 1 -i 0.001 -W 1 --format=jsonl "$@" \
+                 --file "$HOSTS_FILE" 2> /dev/null) > "$LOG"
+    END=$EPOCHREALTIME
+    awk -v name="$NAME" -v start="$START" -v first="${FIRST:-$END}" \
+        -v last="${LAST:-$END}" -v end="$END" \
+        -v replies="$(grep -c '"status":"reply"' "$LOG")" \
+        'BEGIN { printf "%-24s %16.3f %15.3f %9.3f %10d\n", name, first - start,
+                 last - start, end - start, replies }'
+}
+
+rm -f "$CACHE"
+run_case serial --resolvers 1
+run_case parallel
+run_case cache-cold --dns-cache "$CACHE"
+run_case cache-warm --dns-cache "$CACHE"
+
+echo "Cached entries: $(wc -l < "$CACHE")"
+echo "Results saved to test_results/resolve_startup_*.txt"
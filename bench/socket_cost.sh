@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Socket Backend Benchmark
+# RAWソケットとICMPデータグラムソケットで、floodモードの応答1つあたりのCPU時間を比較する
+#
+# 使い方: sudo ./bench/socket_cost.sh [秒数] [宛先]
+# データグラムソケットには net.ipv4.ping_group_range で実行グループの許可が必要
+
+set -e
+
+DURATION=${1:-5}
+TARGET=${2:-127.0.0.1}
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping > /dev/null
+
+echo "=== -f -l 64 to ${TARGET} for ${DURATION}s ==="
+printf "%8s %12s %12s %14s %16s\n" "socket" "cpu (ms)" "replies" "replies/s" "cpu/reply (us)"
+
+for SOCKET in raw dgram; do
+    LOG="test_results/socket_cost_${SOCKET}.txt"
+    TIMEFORMAT="%U %S"
+    CPU=$( { time timeout -s INT "$DURATION" ./ft_ping -f -l 64 --socket "$SOCKET" "$TARGET" > "$LOG" 2>&1 || true; } 2>&1 )
+    CPU_MS=$(echo "$CPU" | awk '{ printf "%.0f", ($1 + $2) * 1000 }')
+    REPLIES=$(awk '/packets received/ { print $4 }' "$LOG")
+    RATE=$(awk '/^flood:/ { print $5 }' "$LOG")
+    if [ -z "$REPLIES" ]; then
+        echo "${SOCKET}: no result (see ${LOG})"
+        continue
+    fi
+    PER_REPLY=$(awk -v c="$CPU_MS" -v r="$REPLIES" 'BEGIN { printf "%.2f", (r > 0) ? c * 1000 / r : 0 }')
+    printf "%8s %12s %12s %14s %16s\n" "$SOCKET" "$CPU_MS" "$REPLIES" "$RATE" "$PER_REPLY"
+done
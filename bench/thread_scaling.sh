@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Thread Scaling Benchmark
+# --threads のワーカー数を変えながらfloodモードで送受信できるパケット/秒を測定する
+#
+# 使い方: sudo ./bench/thread_scaling.sh [秒数] [宛先数] [最大スレッド数]
+# 宛先はループバックの 127.0.0.1 から順に割り当てるため外部へのパケットは出ない
+
+set -e
+
+DURATION=${1:-5}
+TARGETS=${2:-16}
+MAX_THREADS=${3:-$(nproc)}
+PRELOAD=64
+
+mkdir -p test_results
+
+echo "Building ft_ping..."
+make ft_ping > /dev/null
+
+HOSTS=""
+for i in $(seq 1 "$TARGETS"); do
+    HOSTS="$HOSTS 127.0.0.$i"
+done
+
+echo "=== Thread scaling: ${TARGETS} targets, ${DURATION}s per run, -f -l ${PRELOAD} ==="
+printf "%8s %14s %14s %10s\n" "threads" "sent/s" "received/s" "speedup"
+
+BASE=""
+THREADS=1
+while [ "$THREADS" -le "$MAX_THREADS" ]; do
+    LOG="test_results/thread_scaling_${THREADS}.txt"
+    # SIGINTで終了させ、終了時の統計のfloodの行からレートを読む
+    timeout -s INT "$DURATION" ./ft_ping -f -l "$PRELOAD" --threads "$THREADS" $HOSTS > "$LOG" 2>&1 || true
+    SENT=$(awk '/^flood:/ { print $2 }' "$LOG")
+    RECV=$(awk '/^flood:/ { print $5 }' "$LOG")
+    if [ -z "$SENT" ]; then
+        echo "threads=${THREADS}: no result (see ${LOG})"
+        exit 1
+    fi
+    if [ -z "$BASE" ]; then
+        BASE=$RECV
+    fi
+    SPEEDUP=$(awk -v r="$RECV" -v b="$BASE" 'BEGIN { printf "%.2fx", (b > 0) ? r / b : 0 }')
+    printf "%8d %14s %14s %10s\n" "$THREADS" "$SENT" "$RECV" "$SPEEDUP"
+    THREADS=$((THREADS * 2))
+done
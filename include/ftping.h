@@ -0,0 +1,30 @@
+#ifndef FTPING_H
+#define FTPING_H
+
+// libftping: ft_pingの送受信エンジンを他のプログラムに組み込むためのヘッダ
+// （make libftping.a / make libftping.so、-lm -lpthread -lresolvと一緒にリンクする）
+//
+// スレッドもグローバルな状態も使わず、呼び出し側のイベントループ（epoll・poll）の中で動く
+// コンテキストごとに別のソケット・ICMP識別子・終了フラグ・統計を持つので、
+// 1つのプロセスで複数のコンテキストを同時に動かせる
+//
+//   PingContext ctx;
+//   initialize_context(&ctx);
+//   ctx.quiet = 1;                  // 標準出力に結果を書かない
+//   ctx.count = 5;                  // 5回送って終了（0=stop_ping_loopまで続ける）
+//   ctx.on_result = on_result;      // 結果ごとに呼ばれる（ctx.user_dataを使える）
+//   add_target(&ctx, "192.0.2.1");  // 名前の解決はこの場で行う
+//   setup_engine(&ctx, 1.0);        // 各宛先への送信間隔(秒)
+//   start_ping_loop(&ctx);
+//   // ctx.epoll_fdを自分のepollに登録し、読めるようになるか
+//   // ping_loop_timeout_ms(&ctx)が過ぎたら step_ping_loop(&ctx, 0) を呼ぶ
+//   // 0が返れば終了。統計はctxのpackets_*・rtt_*・targets[i]に入っている
+//   cleanup_context(&ctx);
+
+#include "ping.h"
+#include "ping_engine.h"
+#include "ping_stats.h"
+#include "ping_summary.h"
+#include "ping_target.h"
+
+#endif // FTPING_H
@@ -7,6 +7,7 @@
 #endif
 
 #include <netinet/in.h>
+#include <signal.h>
 #include <time.h>
 #include <sys/time.h>
 #include <sys/select.h>
@@ -14,28 +15,270 @@
 
 // ping全体で共通利用する定数や型定義
 #define ICMP_HDRLEN 8 // ICMPヘッダ長（バイト数、通常8バイト）
-#define PACKET_SIZE (ICMP_HDRLEN + ICMP_DATA_SIZE) // ICMPパケット全体サイズ
-#define ICMP_DATA_SIZE 56   // ICMPデータ部サイズ
+#define PACKET_SIZE (ICMP_HDRLEN + ICMP_DATA_SIZE) // ICMPパケット全体サイズの既定値
+#define ICMP_DATA_SIZE 56   // ICMPデータ部サイズの既定値
+#define PING_MAX_DATA_SIZE 65507 // -sで指定できる最大データ部サイズ
+#define PING_MAX_IPHDR_LEN 60    // IPヘッダの最大長（オプション込み）
 #define PING_INTERVAL 1     // ping送信間隔(秒)
-// pingの統計情報や状態をまとめた構造体
+#define PING_FLOOD_TIMEOUT 0.01 // floodモードで応答を待つ最大時間(秒)
+#define PING_MIN_INTERVAL 0.00001 // -iで指定できる最小送信間隔(秒)
+#define PING_MAX_BURST 64   // 送信が遅れた場合に1回の起床で追いつく最大送信数
+#define PING_TX_BATCH 64    // sendmmsgで一度に送信する最大パケット数
+#define PING_RX_BATCH 64    // recvmmsgで一度に受信する最大パケット数
+#define PING_RX_BUFSIZE 2048 // 受信バッファ1つあたりの最小サイズ
+#define PING_RX_CONTROL_SIZE 256 // 受信1つあたりの制御メッセージ(cmsg)領域サイズ
+#define PING_SEQ_WINDOW 16384 // 応答を照合できる直近の送信数の最小値（2のべき乗）
+#define PING_SEQ_WINDOW_MAX 65536 // 送信レートと-Wに合わせて広げる上限（シーケンス番号16ビット分）
+#define PING_OUTPUT_BUFSIZE 65536 // 受信結果の出力バッファサイズ
+#define PING_OUTPUT_FLUSH_MS 100  // 出力バッファを書き出すまでの最大時間(ミリ秒)
+#define PING_DEFAULT_LINGER 10    // 応答を待つ時間の既定値(秒) (-W)
+#define PING_RESOLVE_CONCURRENCY 16 // 同時に解決する名前の数の既定値 (--resolvers)
+#define PING_DNS_DEFAULT_TTL 60     // DNSからTTLを得られない名前をキャッシュに残す秒数
+#define PING_MAX_SWEEP_SIZES 1024   // --sweepで使えるデータ部サイズの最大数
+
+struct PingResolver;
+struct PingRecorder;
+struct PingSharedStats;
+struct PingUring;
+struct PingProfile;
+
+// 送受信に使うソケットの種類
+typedef enum {
+    PING_SOCKET_AUTO,  // RAWを試し、権限がなければデータグラムを使う
+    PING_SOCKET_RAW,   // SOCK_RAW（root権限が必要）
+    PING_SOCKET_DGRAM, // SOCK_DGRAM/IPPROTO_ICMP（net.ipv4.ping_group_rangeで許可）
+} PingSocketType;
+
+// 階層タイマーホイール（1ミリ秒刻み、64スロット×4段で約4.6時間先まで）
+// 段Lのスロットは64^L ミリ秒ずつ進み、上の段のタイマーは時刻が近づくと下の段へ移す
+// 登録・取り消し・満了はタイマー数によらずO(1)
+#define PING_WHEEL_BITS 6
+#define PING_WHEEL_SLOTS (1 << PING_WHEEL_BITS)
+#define PING_WHEEL_LEVELS 4
+
+typedef struct {
+    int next, prev;              // 同じスロットの前後のタイマー（-1=なし）
+    int bucket;                  // 登録先（段*PING_WHEEL_SLOTS+スロット、-1=未登録）
+    unsigned long long expires;  // 満了時刻(ミリ秒)
+} PingTimerNode;
+
+typedef struct {
+    PingTimerNode *nodes;        // タイマーの配列（idで引く、動的割り当て）
+    int capacity;                // タイマー数
+    int head[PING_WHEEL_LEVELS * PING_WHEEL_SLOTS]; // スロットごとのリストの先頭
+    unsigned long long occupied[PING_WHEEL_LEVELS]; // 空でないスロットのビットマップ
+    unsigned long long now;      // 処理済みの時刻(ミリ秒)
+    long count;                  // 登録中のタイマー数
+} PingTimerWheel;
+
+// 受信結果の出力形式
+typedef enum {
+    PING_FORMAT_TEXT,  // pingと同じ1行の文章
+    PING_FORMAT_JSONL, // 1行1オブジェクトのJSON (JSON Lines)
+    PING_FORMAT_CSV,   // 先頭に列名の行を付けたCSV
+} PingFormat;
+
+// 受信結果の出力バッファ
+// 行をためてまとめてwriteし、サイズか時間のしきい値を超えたら書き出す
 typedef struct {
-    double *rtt_times;           // RTT記録配列（動的割り当て）
-    int rtt_count;               // RTT記録数
-    int rtt_capacity;            // RTT記録配列の容量
+    int fd;                      // 書き出し先（標準出力）
+    char *buf;                   // 出力バッファ（動的割り当て）
+    size_t len;                  // バッファ内のバイト数
+    size_t cap;                  // バッファの容量
+    struct timespec last_flush;  // 最後に書き出した時刻（CLOCK_MONOTONIC）
+} PingOutput;
+
+// RTTヒストグラム（対数線形のバケット、値はナノ秒）
+// 2^PING_HIST_SUB_BITS未満の値は1ナノ秒刻み、それ以上は2のべき乗ごとに
+// 2^(PING_HIST_SUB_BITS-1)個へ等分するので、バケット中央値の相対誤差は
+// 1/2^PING_HIST_SUB_BITS (約0.8%) 以内。2^36ナノ秒(約68秒)以上は最上位のバケットに入る
+#define PING_HIST_SUB_BITS 7
+#define PING_HIST_HALF (1 << (PING_HIST_SUB_BITS - 1))
+#define PING_HIST_MAX_SHIFT 29
+#define PING_HIST_BUCKETS ((PING_HIST_MAX_SHIFT + 2) * PING_HIST_HALF)
+
+typedef struct {
+    unsigned long long counts[PING_HIST_BUCKETS]; // バケットごとの記録数
+    unsigned long long total;                     // 記録数の合計
+    unsigned long long min_ns, max_ns;            // 記録した最小・最大値
+} PingHistogram;
+
+// RTTの最小・最大・合計・二乗和（ミリ秒）
+typedef struct {
+    long count;
+    double min, max, sum, sum2;
+} PingRttStats;
+
+// 定期レポート用の区間統計（レポートのたびにリセットする）
+typedef struct {
+    long long packets_sent;      // 区間内の送信パケット数
+    long long packets_received;  // 区間内の受信パケット数
+    long long packets_duplicate; // 区間内の重複受信パケット数
+    long long packets_timeout;   // 区間内に応答待ちがタイムアウトしたパケット数
+    PingRttStats rtt;            // 区間内のRTT統計
+    PingHistogram hist;          // 区間内のRTTの分布
+} PingIntervalStats;
+
+// ワーカーへのレポート要求（eventfdに書く値）
+#define PING_REPORT_SNAPSHOT 1 // 累積の統計を写す
+#define PING_REPORT_INTERVAL 2 // 累積の統計を写し、区間統計をリセットする
+
+// 送信1回分の記録（送信番号の下位ビットで選ぶリングのスロット）
+typedef struct {
+    struct timespec sent_time;        // 送信時刻（CLOCK_MONOTONIC）
+    struct timespec kernel_sent_time; // 送信時刻(CLOCK_REALTIME)。カーネルのTX時刻で上書き
+                                      // --replayではEcho Requestのデータ部の先頭16バイト
+    long long number;                 // このスロットを使った送信番号（世代タグ、-1=未使用）
+    int target;                       // 宛先インデックス
+    int received;                     // 応答を受信済みか
+    int size_index;                   // --sweepで使ったデータ部サイズの番号
+} PingSeqSlot;
+
+// 送信記録のリング
+typedef struct {
+    PingSeqSlot *slots; // 送信記録（size個、動的割り当て）
+    int size;           // スロット数（2のべき乗、PING_SEQ_WINDOW_MAX以下）
+} PingSeqWindow;
+
+// 送信1回分の結果の種類（on_resultに渡す）
+typedef enum {
+    PING_RESULT_REPLY,      // 応答
+    PING_RESULT_LATE_REPLY, // 応答待ちのタイムアウトを知らせた後に届いた応答
+    PING_RESULT_DUPLICATE,  // 重複した応答
+    PING_RESULT_LOST,       // 応答待ちのタイムアウト
+} PingResultKind;
+
+// 送信1回分の結果（LOSTでは応答の項目は0・NULL）
+typedef struct {
+    PingResultKind kind;
+    int target;                     // 宛先インデックス（ctx->targets）
+    int seq;                        // ICMPのシーケンス番号
+    double rtt;                     // RTT(ミリ秒)
+    int ttl;                        // 応答のTTL
+    int bytes;                      // 応答のICMPのバイト数
+    const struct sockaddr_in *from; // 応答の送信元
+} PingResult;
+
+// --sweepのデータ部サイズごとの統計
+typedef struct {
+    long long packets_sent;      // 送信パケット数
+    long long packets_received;  // 受信パケット数（重複を除く）
+    PingRttStats rtt;            // RTT統計
+} PingSweepStat;
+
+// 宛先ごとの状態と統計
+typedef struct {
+    struct sockaddr_in addr;     // 宛先アドレス
+    char ip[INET_ADDRSTRLEN];    // 宛先IP文字列（表示用にキャッシュ）
+    int ip_len;                  // 宛先IP文字列の長さ
+    char *hostname;              // 宛先ホスト名（動的割り当て）
+    long long packets_sent;      // 送信パケット数
+    int probes_pending;          // 送信待ちのパケット数（-cの上限の判定用）
+    long long send_errors;       // 経路がないなどで送信できなかったパケット数
+    long long packets_received;  // 受信パケット数
+    long long packets_duplicate; // 重複受信パケット数
+    PingRttStats rtt;            // RTT統計
+    PingSweepStat *sweep;        // --sweepのサイズごとの統計（最初の送信で確保、NULL=なし）
+} PingTarget;
+
+// 送信スケジューラ（timerfdに絶対時刻の送信期限を設定する）
+typedef struct {
+    int timer_fd;                  // timerfdディスクリプタ
+    struct timespec interval;      // 送信間隔
+    struct timespec next_deadline; // 次の送信期限（CLOCK_MONOTONIC絶対時刻）
+    long jitter_count;             // 送信遅れの計測数
+    double jitter_min, jitter_max;  // 送信遅れの最小・最大（マイクロ秒）
+    double jitter_sum, jitter_sum2; // 送信遅れの合計・二乗和（マイクロ秒）
+} PingScheduler;
+
+// 送信エンジン（組み立て済みのパケットのシーケンス番号と時刻だけを書き換える）
+typedef struct {
+    unsigned char *slots;               // PING_TX_BATCH個分のパケットバッファ
+    size_t packet_size;                 // ICMPパケット全体サイズ
+    struct mmsghdr msgs[PING_TX_BATCH]; // sendmmsgに渡すメッセージ
+    struct iovec iovs[PING_TX_BATCH];   // 各パケットのiovec
+    int pending;                        // 送信待ちのパケット数
+    long probes;                        // 送信したパケット数
+    long syscalls;                      // 送信に使ったシステムコール数
+} PingTxEngine;
+
+// 受信エンジン（事前に確保したバッファ群へrecvmmsgでまとめて受信する）
+typedef struct {
+    unsigned char *buffers;                   // PING_RX_BATCH個分の受信バッファ
+    size_t buffer_size;                       // 受信バッファ1つあたりのサイズ
+    struct mmsghdr msgs[PING_RX_BATCH];       // recvmmsgに渡すメッセージ
+    struct iovec iovs[PING_RX_BATCH];         // 各バッファのiovec
+    struct sockaddr_in addrs[PING_RX_BATCH];  // 各パケットの送信元アドレス
+    unsigned char control[PING_RX_BATCH][PING_RX_CONTROL_SIZE]; // 制御メッセージ
+    long packets;                             // 受信したパケット数
+    long syscalls;                            // 受信に使ったシステムコール数
+} PingRxEngine;
+
+// pingの統計情報や状態をまとめた構造体
+typedef struct PingContext {
+    long rtt_count;              // RTT記録数
     double rtt_min, rtt_max, rtt_sum, rtt_sum2; // RTT統計
-    int packets_sent;            // 送信パケット数
-    int packets_received;        // 受信パケット数
-    int packets_duplicate;        // 重複受信パケット数
-    int *received_seq;           // 受信済みシーケンス番号のビットマップ（動的割り当て）
-    int received_seq_size;       // ビットマップサイズ
-    int ping_running;            // pingループ継続フラグ
+    PingHistogram rtt_hist;      // RTTの分布（パーセンタイル用、固定サイズ）
+    long long packets_sent;      // 送信パケット数（次の送信番号）
+    long long packets_received;  // 受信パケット数
+    long long packets_duplicate; // 重複受信パケット数
+    long long packets_late;      // 照合できる範囲より古い応答の数
+    long long packets_timeout;   // 応答待ちがタイムアウトしたパケット数
+    long long send_errors;       // 経路がないなどで送信できなかったパケット数
+    volatile sig_atomic_t ping_running; // pingループ継続フラグ（シグナルハンドラからも下ろせる）
     int sock_fd;                 // ソケットディスクリプタ
-    struct sockaddr dest_addr;    // 宛先アドレス (互換性のためstruct sockaddrを使用)
-    char dest_ip[INET_ADDRSTRLEN]; // 宛先IP文字列 (IPv4のみ利用)
-    char dest_hostname[256];     // 宛先ホスト名
-    struct timespec *sent_times; // シーケンス番号ごとの送信時刻記録（動的割り当て）
-    int sent_times_capacity;     // 送信時刻記録配列の容量
+    int ident;                   // ICMP識別子（コンテキストごとに割り当てる）
+    int epoll_fd;                // 送受信ループが待ち受けるepoll（-1=未開始）
+    unsigned long long end_ms;   // -wで終了する時刻(ミリ秒、CLOCK_MONOTONIC)
+    void (*on_result)(struct PingContext *ctx, const PingResult *result); // 送信の結果ごとの通知（NULL=なし）
+    void *user_data;             // on_resultから使う呼び出し側のデータ
+    int worker_id;               // ワーカースレッド番号（-1=スレッド分割なし）
+    int stop_fd;                 // 停止通知用eventfd（-1=なし）
+    int report_fd;               // レポート要求用eventfd（-1=なし）
+    void (*on_report)(struct PingContext *ctx, unsigned long long request); // report_fd通知時の処理
+    double report_interval;      // 定期レポートの間隔(秒)（0=レポートしない）
+    int report_timer_fd;         // 定期レポート用timerfd（-1=なし）
+    PingIntervalStats interval;  // 前回のレポート以降の区間統計
+    PingTarget *targets;         // 宛先の配列（動的割り当て）
+    int target_count;            // 宛先数
+    int target_capacity;         // 宛先配列の容量
+    int next_target;             // 次に送信する宛先（ラウンドロビン）
+    double target_interval;      // 各宛先への送信間隔(秒) (-i)
+    struct PingResolver *resolver; // 解決中の宛先のワーカープール（NULL=なし）
+    PingSeqWindow window;        // 直近window.size回分の送信記録
+    PingTimerWheel wheel;        // 応答待ちのタイムアウト（idは送信記録のスロット位置）
+    long count;                  // 宛先ごとの送信数の上限 (-c, 0=無制限、--sweepではサイズごと)
+    double deadline;             // 実行時間の上限(秒) (-w, 0=無制限)
+    double linger;               // 応答を待つ時間(秒) (-W)
     int verbose_mode;            // verboseモードフラグ
+    int flood_mode;              // floodモードフラグ
+    int preload;                 // 応答を待たずに送信できるパケット数
+    int data_size;               // ICMPデータ部サイズ（--sweepでは最大のサイズ）
+    int sweep_min, sweep_max, sweep_step; // --sweepのデータ部サイズの範囲と刻み
+    int sweep_count;             // --sweepで順に使うサイズの数（0=data_sizeだけを使う）
+    int kernel_timestamps;       // カーネルの送受信タイムスタンプでRTTを測るフラグ
+    int no_filter;               // RAWソケットにBPFフィルタを付けないフラグ
+    int io_uring;                // io_uringで送受信する (--io-uring、使えなければ0に戻す)
+    struct PingUring *uring;     // io_uringの送受信（NULL=sendmmsg/recvmmsg）
+    int profile;                 // 段階ごとの処理時間を計測する (-X、PING_PROFILEでビルドした場合のみ)
+    struct PingProfile *prof;    // 段階ごとの計測値（NULL=計測しない）
+    int replay;                  // キャプチャを再生している（応答はEcho Requestのデータ部と照合）
+    const char *record_path;     // 送信ごとの記録ファイル (--record, NULL=記録しない)
+    struct PingRecorder *recorder; // 記録ファイルの書き込み側（NULL=記録しない）
+    const char *stats_path;      // 実行中の統計を共有するファイル (--stats-file, NULL=共有しない)
+    struct PingSharedStats *shared; // mmapした共有ファイル（NULL=共有しない）
+    unsigned long long shared_next_ms; // 次に統計を共有ファイルへ写す時刻(ミリ秒)
+    PingSocketType socket_type;  // ソケットの種類（AUTOはソケット作成時に決まる）
+    PingFormat format;           // 受信結果の出力形式
+    int quiet;                   // 受信結果を表示しない (-q)
+    PingOutput out;              // 受信結果の出力バッファ
+    long kernel_tx_count;        // カーネルのTX時刻を取得できた送信数
+    PingRttStats user_rtt;       // ユーザ空間の時計で測ったRTT（比較用）
+    PingRttStats overhead;       // ユーザ空間RTTとカーネルRTTの差（ツール自身の遅延）
+    struct timespec start_time;  // 最初のパケット送信時刻（pps計算用）
+    PingScheduler sched;         // 送信スケジューラ
+    PingTxEngine tx;             // 送信エンジン
+    PingRxEngine rx;             // 受信エンジン
 } PingContext;
 
 #endif // PING_H
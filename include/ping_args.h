@@ -1,12 +1,47 @@
 #ifndef PING_ARGS_H
 #define PING_ARGS_H
 
+#include "ping.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// argc, argvからホスト名やヘルプフラグ、verboseフラグを抽出する
-// 戻り値: 0=正常, -1=エラー
-int parse_ping_args(int argc, char **argv, char *hostname_out, int *show_help, int *verbose_mode);
+// コマンドラインオプションの解析結果
+typedef struct {
+  int show_help;    // ヘルプ表示フラグ
+  int verbose_mode; // verboseモードフラグ
+  int flood_mode;   // floodモードフラグ (-f)
+  int preload;      // 応答を待たずに送信できるパケット数 (-l)
+  double interval;  // 送信間隔(秒) (-i, 0=既定値)
+  int count;        // 宛先ごとの送信数 (-c, 0=無制限)
+  double deadline;  // 実行時間の上限(秒) (-w, 0=無制限)
+  double linger;    // 応答を待つ時間(秒) (-W, 0=既定値)
+  int data_size;    // ICMPデータ部サイズ (-s)
+  int sweep;        // データ部サイズを掃引する (--sweep)
+  int sweep_min, sweep_max, sweep_step; // --sweepの範囲と刻み（刻み0=既定の数に分ける）
+  int kernel_timestamps; // カーネルタイムスタンプでRTTを測る (--kernel-timestamps)
+  char **hosts;     // 宛先ホスト名（argvを指す。配列は動的割り当て）
+  int host_count;   // 宛先ホスト名の数
+  const char *targets_file; // 宛先を1行ずつ書いたファイル (--file)
+  int threads;      // 宛先を分担するワーカースレッド数 (--threads)
+  int resolvers;    // 同時に名前解決する数 (--resolvers)
+  const char *dns_cache; // 名前解決のキャッシュファイル (--dns-cache)
+  int no_filter;    // BPFフィルタを使わない (--no-filter)
+  int io_uring;     // io_uringで送受信する (--io-uring)
+  int profile;      // 段階ごとの処理時間を計測する (-X)
+  PingSocketType socket_type; // ソケットの種類 (--socket raw|dgram)
+  PingFormat format; // 受信結果の出力形式 (--format=text|jsonl|csv)
+  int quiet;        // 受信結果を表示しない (-q)
+  double report_interval; // 区間統計を表示する間隔(秒) (--report-interval, 0=表示しない)
+  const char *record; // 送信ごとの記録ファイル (--record)
+  const char *stats_file; // 実行中の統計を共有するファイル (--stats-file)
+  const char *replay; // 再生するキャプチャファイル (--replay)
+  int ident;        // 再生するEcho Requestの識別子 (--ident, -1=最初のEcho Requestの値)
+} PingOptions;
+
+// argc, argvから宛先ホスト名と各種オプションを抽出する
+// 戻り値: 0=正常, -1=引数エラー(usageを表示), -2=不正な値(メッセージ出力済み)
+int parse_ping_args(int argc, char **argv, PingOptions *opts);
+void free_ping_args(PingOptions *opts);
 
 #endif // PING_ARGS_H
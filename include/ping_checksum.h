@@ -0,0 +1,22 @@
+#ifndef PING_CHECKSUM_H
+#define PING_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CPUに合わせて最速の実装を使う
+unsigned short ping_checksum(void *b, int len);
+uint16_t ping_checksum_update(uint16_t checksum, const void *old_data,
+                              const void *new_data, size_t len);
+
+// 個別の実装（検証・ベンチマーク用）
+unsigned short ping_checksum_scalar(const void *b, int len);
+unsigned short ping_checksum_wide(const void *b, int len);
+#if defined(__x86_64__) || defined(__i386__)
+#define PING_CHECKSUM_HAVE_SIMD 1
+unsigned short ping_checksum_sse2(const void *b, int len);
+unsigned short ping_checksum_avx2(const void *b, int len);
+int ping_checksum_avx2_supported(void);
+#endif
+
+#endif // PING_CHECKSUM_H
@@ -0,0 +1,33 @@
+#ifndef PING_ENGINE_H
+#define PING_ENGINE_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int initialize_context(PingContext *ctx);
+// 送信スケジューラ・送受信エンジン・ソケットを準備する
+// intervalは各宛先への送信間隔(秒)で、宛先数で割って全体の送信間隔にする
+int setup_engine(PingContext *ctx, double interval);
+
+// 送受信ループを1回ずつ進めるAPI（呼び出し側のイベントループに組み込む用）
+// start_ping_loopの後、ctx->epoll_fdが読めるようになるか
+// ping_loop_timeout_msが過ぎるたびにstep_ping_loop(ctx, 0)を呼ぶ
+// 最初の送信をしてループを始める（ctx->epoll_fdを作る）
+int start_ping_loop(PingContext *ctx);
+// 次にstep_ping_loopを呼ぶべき時刻までのミリ秒（-1=fdが読めるまで待てばよい）
+int ping_loop_timeout_ms(const PingContext *ctx);
+// 最大timeout_msミリ秒待ち、届いた応答・満了したタイマー・送信期限を処理する
+// 戻り値: 1=継続, 0=-c/-w/stop_ping_loopで終了, -1=エラー
+// シグナルで待ちが中断された場合も1を返す
+int step_ping_loop(PingContext *ctx, int timeout_ms);
+// ループを終える（ためている受信結果を書き出す。シグナルハンドラからは
+// ping_runningを下ろすだけにする）
+void stop_ping_loop(PingContext *ctx);
+// 終了するまでstep_ping_loopを繰り返す
+int run_ping_loop(PingContext *ctx);
+void cleanup_context(PingContext *ctx);
+
+#endif // PING_ENGINE_H
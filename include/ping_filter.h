@@ -0,0 +1,12 @@
+#ifndef PING_FILTER_H
+#define PING_FILTER_H
+
+#include "ping.h"
+#include <stdio.h>
+
+// RAWソケットに自分の識別子宛てのICMPだけを通すBPFフィルタを設定する
+// 通すのは識別子がidentのEcho Replyと、識別子がidentのEcho Requestを
+// 引用したICMPエラー（到達不能・時間超過など）だけ
+int attach_icmp_filter(int sock_fd, int ident);
+
+#endif // PING_FILTER_H
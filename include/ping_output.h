@@ -0,0 +1,35 @@
+#ifndef PING_OUTPUT_H
+#define PING_OUTPUT_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int init_output(PingOutput *out, int fd);
+// バッファの内容を書き出す（先に標準出力のstdioバッファも書き出し、行の順序を保つ）
+int flush_output(PingOutput *out);
+// 書き出し期限を過ぎていれば書き出す
+// 戻り値: 1=書き出した, 0=期限前か空, -1=書き込みエラー
+int flush_output_if_due(PingOutput *out);
+// 書き出し期限までのミリ秒（epoll_waitのタイムアウト用、空なら-1）
+int output_timeout_ms(const PingOutput *out);
+void close_output(PingOutput *out);
+
+// 受信結果を1行出力する（形式はctx->formatに従う）
+void output_reply(PingContext *ctx, const PingTarget *target,
+                  const char *addr_str, int icmp_len, int seq, int ttl,
+                  double rtt, int duplicate);
+// 応答待ちがタイムアウトした送信を1行出力する
+void output_lost(PingContext *ctx, const PingTarget *target, int seq);
+// 書式付きの文章を1行出力する（テキスト形式のICMPエラー表示用）
+void output_text(PingContext *ctx, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+// ヘッダ・統計など人が読む行の出力先（JSON Lines/CSVでは標準出力を記録だけにする）
+FILE *text_stream(const PingContext *ctx);
+// CSV形式の列名の行
+// statusは reply（応答）・dup（重複）・lost（タイムアウト）のいずれか
+#define PING_CSV_HEADER "addr,seq,ttl,bytes,rtt_ms,status\n"
+
+#endif // PING_OUTPUT_H
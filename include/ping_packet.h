@@ -13,7 +13,26 @@
 #include <unistd.h>
 
 
-int send_ping(PingContext *ctx, int print_header, const struct timespec *timestamp);
+void print_ping_header(PingContext *ctx);
+int queue_ping(PingContext *ctx, const struct timespec *timestamp);
+int flush_pings(PingContext *ctx);
+// 送信の失敗が宛先ごとのエラー（経路がない・拒否された）か
+int send_error_is_per_target(int err);
+// 応答1つ分の受信数とRTT統計（全体・宛先ごと・区間）を更新する
+void count_reply(PingContext *ctx, PingTarget *target, double rtt);
+int process_reply(PingContext *ctx, char *buffer, int bytes_received,
+                  const struct sockaddr_in *from,
+                  const struct timespec *ts_recv,
+                  const struct timespec *kernel_rx);
+int process_icmp(PingContext *ctx, struct icmphdr *icmp_hdr, int icmp_len,
+                 int ttl, const struct sockaddr_in *from,
+                 const struct timespec *ts_recv,
+                 const struct timespec *kernel_rx);
+int receive_tx_timestamps(PingContext *ctx);
+// 応答待ちがタイムアウトした送信を失ったものとして数え、表示する
+void expire_probe(void *arg, int index);
+// 時刻nowまでにタイムアウトした送信を処理する（戻り値: タイムアウトした数）
+int expire_probes(PingContext *ctx, const struct timespec *now);
 int receive_ping(PingContext *ctx);
 
 
@@ -0,0 +1,102 @@
+#ifndef PING_PROFILE_H
+#define PING_PROFILE_H
+
+#include "ping.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 送受信ループの段階ごとの処理時間の計測（-X）
+// PING_PROFILEを定義してビルドした場合（make PROFILE=1）だけ計測のコードが入り、
+// 定義しなければPING_PROF_BEGIN/PING_PROF_ENDは何も生成しない
+// 時間はx86ではTSC（rdtsc）のサイクル、それ以外ではCLOCK_MONOTONIC_RAWのナノ秒で数え、
+// 表示するときに計測期間全体でのカウンタと時計の比からナノ秒に直す
+
+typedef enum {
+  PING_PROF_WAIT,     // epoll_waitでの待ち（itemsは起床したfdの数）
+  PING_PROF_RECV,     // recvmmsg・io_uringの完了キューからの受信（itemsはパケット数）
+  PING_PROF_REPLY,    // 受信1パケットの処理（照合・統計・出力の整形を含む）
+  PING_PROF_CHECKSUM, // 受信したICMPのチェックサム検証（REPLYの内訳、itemsはバイト数）
+  PING_PROF_FORMAT,   // 受信結果の1行の整形（REPLYの内訳）
+  PING_PROF_QUEUE,    // 送信1パケットの準備（送信記録・チェックサムの差分更新）
+  PING_PROF_SEND,     // sendmmsg・io_uringでの送信（itemsはパケット数）
+  PING_PROF_EXPIRE,   // 応答待ちのタイムアウト処理
+  PING_PROF_OUTPUT,   // 出力バッファの書き出し（write）
+  PING_PROF_STAGES
+} PingProfStage;
+
+#define PING_PROF_BUCKETS 40 // 1回あたりの時間の分布（2のべき乗ごと、2^39以上は最上位）
+
+typedef struct {
+  unsigned long long calls; // 計測した回数
+  unsigned long long items; // 処理したパケット数など
+  unsigned long long ticks; // 合計時間（カウンタの値）
+  unsigned long long max;   // 最大時間
+  unsigned long long hist[PING_PROF_BUCKETS]; // バケットbは[2^(b-1), 2^b)
+} PingProfStat;
+
+typedef struct PingProfile {
+  PingProfStat stages[PING_PROF_STAGES];
+  uint64_t start_ticks;  // 計測開始時のカウンタ
+  struct timespec start; // 計測開始時刻（CLOCK_MONOTONIC_RAW）
+  int contexts;          // 合算したエンジンの数（スレッド分割時はワーカー数）
+} PingProfile;
+
+#ifdef PING_PROFILE
+// 計測用のカウンタ
+static inline uint64_t profile_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline void profile_record(PingProfile *prof, PingProfStage stage,
+                                  uint64_t ticks, unsigned long long items) {
+  PingProfStat *stat = &prof->stages[stage];
+  int bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+  if (bucket >= PING_PROF_BUCKETS) {
+    bucket = PING_PROF_BUCKETS - 1;
+  }
+  stat->calls++;
+  stat->items += items;
+  stat->ticks += ticks;
+  if (ticks > stat->max) {
+    stat->max = ticks;
+  }
+  stat->hist[bucket]++;
+}
+
+// 区間の開始時刻をvarに取り、PING_PROF_ENDでstageに記録する（-Xでなければ時刻を読まない）
+#define PING_PROF_BEGIN(ctx, var) \
+  uint64_t var = (ctx)->prof ? profile_clock() : 0
+#define PING_PROF_END(ctx, stage, var, items)                              \
+  do {                                                                     \
+    if ((ctx)->prof) {                                                     \
+      profile_record((ctx)->prof, (stage), profile_clock() - (var), (items)); \
+    }                                                                      \
+  } while (0)
+#else
+#define PING_PROF_BEGIN(ctx, var) \
+  do {                            \
+  } while (0)
+#define PING_PROF_END(ctx, stage, var, items) \
+  do {                                        \
+    (void)(items);                            \
+  } while (0)
+#endif
+
+// ctx->profを確保して計測を始める
+// 戻り値: 0=成功, -1=失敗（PING_PROFILEなしのビルドでは常に失敗）
+int open_profile(PingContext *ctx);
+// srcの計測値をdstに合算する（dstに計測値がなければ確保する）
+void merge_profile(PingContext *dst, const PingContext *src);
+// 段階ごとの回数・時間・分布を表示する
+void print_profile(const PingContext *ctx, FILE *stream);
+void close_profile(PingContext *ctx);
+
+#endif // PING_PROFILE_H
@@ -0,0 +1,75 @@
+#ifndef PING_RECORD_H
+#define PING_RECORD_H
+
+#include "ping.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 送信ごとの記録ファイル（--record）
+//
+// ヘッダ(32バイト、リトルエンディアン)
+//   magic[8]="FTPINGR1", version(4), data_size(4), clock_offset_ns(8),
+//   linger_ms(4), ident(4)
+//   送信時刻 + clock_offset_ns がUNIX時刻(ナノ秒)になる
+// 続いてレコードが並ぶ。先頭1バイトが種類で、0はファイルの終わり
+// （異常終了してファイルの末尾が0のまま残っていても、そこまでは読める）
+// 数値は符号なしLEB128のvarint、符号付きの値はzigzagで符号なしにしてから書く
+//   TARGET     : 宛先番号, IP文字列の長さ, IP文字列, ホスト名の長さ, ホスト名
+//   REPLY      : 送信番号の差, 送信時刻の差(ns), RTT(ns), TTL(1バイト), ICMPのバイト数, 宛先番号
+//   LATE_REPLY : REPLYと同じ（タイムアウトした後に届いた応答）
+//   DUPLICATE  : REPLYと同じ（重複した応答）
+//   LOST       : 送信番号の差, 送信時刻の差(ns), 宛先番号（応答待ちのタイムアウト）
+//   UNANSWERED : LOSTと同じ（終了時にまだ応答を待っていた送信）
+//   LATE       : なし（照合できる範囲より古い応答）
+// 差は直前の送信のレコード（REPLY〜UNANSWERED）との差
+#define PING_RECORD_MAGIC "FTPINGR1"
+#define PING_RECORD_VERSION 1
+#define PING_RECORD_HEADER_SIZE 32
+#define PING_RECORD_CHUNK (4 << 20) // ファイルを伸ばしてmmapする単位(バイト)
+
+typedef enum {
+  PING_RECORD_TARGET = 1,
+  PING_RECORD_REPLY,
+  PING_RECORD_LATE_REPLY,
+  PING_RECORD_DUPLICATE,
+  PING_RECORD_LOST,
+  PING_RECORD_UNANSWERED,
+  PING_RECORD_LATE,
+} PingRecordKind;
+
+// 記録ファイルの書き込み側
+// ファイルをPING_RECORD_CHUNKずつ伸ばしてmmapし、レコードはその窓に直接書く
+// 書き出しはカーネルのページキャッシュに任せ、送受信ループではシステムコールを使わない
+typedef struct PingRecorder {
+  int fd;                  // 記録ファイル
+  unsigned char *map;      // mmapした窓
+  size_t map_offset;       // 窓のファイル内の位置（ページ境界）
+  size_t map_size;         // 窓の大きさ
+  size_t used;             // 窓の中で書き込んだバイト数
+  int targets_written;     // TARGETレコードを書いた宛先数
+  long long prev_number;   // 直前の送信のレコードの送信番号
+  long long prev_send_ns;  // 直前の送信のレコードの送信時刻(ns)
+} PingRecorder;
+
+// ctx->record_pathに記録を始める（スレッド分割時のワーカーは「パス.ワーカー番号」）
+// clock_offset_nsは送信時刻に足すとUNIX時刻になる値
+int start_recording(PingContext *ctx, long long clock_offset_ns);
+// 応答（kindはREPLY・LATE_REPLY・DUPLICATE）を記録する
+void record_reply(PingContext *ctx, PingRecordKind kind, long long number,
+                  const PingSeqSlot *slot, double rtt, int ttl, int icmp_len);
+// 応答のない送信（kindはLOST・UNANSWERED）を記録する
+void record_lost(PingContext *ctx, PingRecordKind kind, long long number,
+                 const PingSeqSlot *slot);
+// 照合できなかった古い応答を記録する
+void record_late(PingContext *ctx);
+// まだ応答を待っている送信をUNANSWEREDとして書き、ファイルを実際の長さに切り詰めて閉じる
+void stop_recording(PingContext *ctx);
+
+// 記録ファイルを読み、送受信数・RTT統計・宛先ごとの統計をctxに足し込む
+// 宛先はIPとホスト名が同じものを1つにまとめるので、複数のファイルを続けて読める
+// 戻り値: 読んだレコード数, -1=読めない・形式が不正
+long read_record_file(PingContext *ctx, const char *path);
+
+#endif // PING_RECORD_H
@@ -0,0 +1,16 @@
+#ifndef PING_REPLAY_H
+#define PING_REPLAY_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// pcap/pcapngのキャプチャを読み、ICMPを受信処理・統計に流す（--replay）
+// Echo Requestは送信として記録し、その他のICMPはprocess_replyで受信として処理する
+// 時刻はキャプチャのタイムスタンプを使う。ctx->identが負ならキャプチャ内の最初の
+// Echo Requestの識別子を使う
+// 戻り値: 0=正常, -1=ファイルを読めない・形式が不正
+int run_replay(PingContext *ctx, const char *path);
+
+#endif // PING_REPLAY_H
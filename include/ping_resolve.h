@@ -5,12 +5,16 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 
-int resolve_hostname(PingContext *ctx, const char *hostname);
+int resolve_hostname(PingTarget *target, const char *hostname);
+// 解決済みのアドレスを宛先に設定する（表示用のIP文字列とホスト名も作る）
+int set_target_address(PingTarget *target, const char *hostname,
+                       const struct sockaddr_in *addr);
 
 
 #endif // PING_RESOLVE_H
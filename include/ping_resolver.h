@@ -0,0 +1,75 @@
+#ifndef PING_RESOLVER_H
+#define PING_RESOLVER_H
+
+#include "ping.h"
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 名前解決1件分（ワーカースレッドが結果を書き込み、メインスレッドが受け取る）
+typedef struct {
+  char *name;              // 解決するホスト名（動的割り当て）
+  struct sockaddr_in addr; // 解決したアドレス
+  int error;               // getaddrinfoのエラー（0=成功）
+  long ttl;                // キャッシュに残す秒数（0=TTLを問い合わせ中）
+} PingResolveJob;
+
+// 名前解決のキャッシュの1件分（--dns-cache）
+typedef struct {
+  char *name;           // ホスト名（動的割り当て）
+  struct in_addr addr;  // アドレス
+  long long expires;    // 有効期限（UNIX時刻、秒）
+} PingDnsCacheEntry;
+
+// 名前解決のワーカープール
+// ワーカーはjobsを先頭から1件ずつ取り出して解決し、終えた順にdoneへ積んでevent_fdで知らせる
+// --dns-cacheでは全ての名前を解決した後で、解決を終えた順にTTLを問い合わせ、
+// 揃ったらもう一度event_fdで知らせる
+typedef struct PingResolver {
+  PingResolveJob *jobs;       // 解決する名前の配列
+  int job_count;              // 解決する名前の数
+  int job_capacity;           // jobsの容量
+  int next_job;               // 次にワーカーが取り出すジョブ
+  int *done;                  // 解決を終えたジョブの番号（完了順）
+  int done_count;             // 解決を終えたジョブ数
+  int collected;              // メインスレッドが受け取ったジョブ数
+  int stopping;               // 新しいジョブを取り出さない
+  int next_ttl;               // 次にTTLを問い合わせるジョブ（doneの位置）
+  int ttl_pending;            // 解決を終え、キャッシュに書くTTLをまだ得ていないジョブ数
+  int event_fd;               // 解決とTTLの問い合わせの完了通知用eventfd
+  pthread_mutex_t lock;       // next_job・done・stopping・TTLの問い合わせの状態を保護する
+  pthread_t *threads;         // ワーカースレッド
+  int thread_count;           // 起動したワーカースレッド数
+  int concurrency;            // 同時に解決する名前の最大数
+  PingDnsCacheEntry *cache;   // 読み込んだキャッシュ（名前順）
+  int cache_count;            // キャッシュの件数
+  char *cache_path;           // キャッシュファイル（NULL=使わない）
+  int cache_dirty;            // 書き戻していない解決結果があるか
+} PingResolver;
+
+// concurrency個までのワーカーで解決するプールを作る
+// cache_pathがあれば有効期限内のエントリを読み込む（ファイルがなくてもよい）
+PingResolver *create_resolver(int concurrency, const char *cache_path);
+// キャッシュにあれば、そのアドレスを返す
+// 戻り値: 1=見つかった, 0=ない・期限切れ
+int resolver_lookup(const PingResolver *resolver, const char *name,
+                    struct sockaddr_in *addr);
+// 解決する名前を追加する（start_resolverより前に呼ぶ）
+int resolver_add(PingResolver *resolver, const char *name);
+// ワーカーを起動する（ジョブがなければ何もしない）
+int start_resolver(PingResolver *resolver);
+// まだ受け取っていない（解決中を含む）ジョブの数
+int resolver_pending(const PingResolver *resolver);
+// 解決を終えたジョブを1件取り出す（なければNULL）
+// 取りこぼさないよう、event_fdを読んで通知を消してから取り出す
+PingResolveJob *resolver_next_result(PingResolver *resolver);
+// 解決結果をキャッシュファイルへ書き戻す（書き戻すものがなければ何もしない）
+// TTLを問い合わせ中の名前があれば、close_resolverから呼ばれたとき以外は書かずに待つ
+int save_resolver_cache(PingResolver *resolver);
+// ワーカーを止め、残りのTTLの問い合わせを待ってキャッシュを書き戻して解放する
+// 解決中のワーカーがあれば待たずに切り離す（プールは解放しないので、終了時だけ呼ぶ）
+void close_resolver(PingResolver *resolver);
+
+#endif // PING_RESOLVER_H
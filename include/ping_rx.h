@@ -0,0 +1,17 @@
+#ifndef PING_RX_H
+#define PING_RX_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+int init_rx_engine(PingRxEngine *rx, size_t buffer_size);
+int receive_batch(PingRxEngine *rx, int sock_fd, int flags);
+unsigned char *rx_buffer(PingRxEngine *rx, int index);
+int rx_kernel_timestamp(PingRxEngine *rx, int index, struct timespec *ts);
+int rx_ttl(PingRxEngine *rx, int index);
+void close_rx_engine(PingRxEngine *rx);
+
+#endif // PING_RX_H
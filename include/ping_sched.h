@@ -0,0 +1,26 @@
+#ifndef PING_SCHED_H
+#define PING_SCHED_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+int init_scheduler(PingScheduler *sched, double interval);
+// 送信間隔を変える（送信中に宛先が増えたとき用）
+void set_scheduler_interval(PingScheduler *sched, double interval);
+int arm_scheduler(PingScheduler *sched, const struct timespec *deadline);
+void record_send_jitter(PingScheduler *sched, const struct timespec *now);
+void close_scheduler(PingScheduler *sched);
+// interval秒ごとに満了するtimerfdを作る（定期レポート用）
+int create_report_timer(double interval);
+
+void timespec_add(struct timespec *ts, const struct timespec *delta);
+int timespec_cmp(const struct timespec *a, const struct timespec *b);
+void timespec_from_seconds(struct timespec *ts, double seconds);
+// タイマーホイール用のミリ秒単位の時刻
+unsigned long long timespec_to_ms(const struct timespec *ts);
+
+#endif // PING_SCHED_H
@@ -0,0 +1,15 @@
+#ifndef PING_SHARD_H
+#define PING_SHARD_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 宛先をthreads個のワーカースレッドに分割してpingを実行し、
+// 終了後に各ワーカーの統計をctxへ合算する
+// intervalは各宛先への送信間隔(秒)
+int run_sharded(PingContext *ctx, int threads, double interval);
+
+#endif // PING_SHARD_H
@@ -0,0 +1,79 @@
+#ifndef PING_SHARED_H
+#define PING_SHARED_H
+
+#include "ping.h"
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 実行中の統計を他のプロセスと共有するファイル（--stats-file）
+// 送受信ループが起床するたびに（最短PING_SHARED_PUBLISH_MSごとに）統計をmmapしたファイルへ写し、
+// ft_ping_exporterなどの読み手は同じファイルをmmapして好きな頻度で読む
+// /dev/shm に置けばディスクに書かれない共有メモリになる
+//
+// 書き込みはseqlockで囲む: 書く前と書いた後にseqを1ずつ進めるので、書いている間は奇数
+// 読み手はseqが偶数で、写し取る前後で変わっていなければ一貫した写しとみなし、変わっていれば読み直す
+// 書き手は読み手を待たないので、読み手がいくつあっても送受信ループは止まらない
+// 値はこのマシンのバイト順・構造体の配置のままなので、同じビルドの読み手で読む
+#define PING_SHARED_MAGIC "FTPINGS1"
+#define PING_SHARED_VERSION 2
+#define PING_SHARED_PUBLISH_MS 10 // 統計を写す最小間隔(ミリ秒)
+#define PING_SHARED_NAME_MAX 128  // 宛先のホスト名を残す最大長（終端を含む）
+
+// 宛先1つ分の統計
+typedef struct {
+  char hostname[PING_SHARED_NAME_MAX]; // ホスト名（長い名前は切り詰める）
+  char ip[INET_ADDRSTRLEN];            // 宛先IP文字列
+  int64_t packets_sent;                // 送信パケット数
+  int64_t packets_received;            // 受信パケット数
+  int64_t packets_duplicate;           // 重複受信パケット数
+  PingRttStats rtt;                    // RTT統計
+} PingSharedTarget;
+
+// ファイルの先頭（続けてtarget_capacity行の宛先が並ぶ）
+typedef struct PingSharedStats {
+  char magic[8];             // PING_SHARED_MAGIC
+  uint32_t version;          // PING_SHARED_VERSION
+  uint32_t seq;              // seqlockの番号（奇数=書き込み中）
+  uint32_t target_capacity;  // 宛先の行数（ファイルの大きさを決める）
+  uint32_t target_count;     // 書き込んだ宛先の数
+  int32_t pid;               // 書いているプロセス
+  int32_t worker_id;         // ワーカースレッド番号（-1=スレッド分割なし）
+  int32_t ident;             // ICMP識別子
+  int32_t running;           // 1=送受信中, 0=終了済み（最後の統計）
+  double linger;             // 応答を待つ時間(秒)
+  int64_t start_unix_ns;     // 送受信の開始時刻(UNIX時刻、ナノ秒)
+  int64_t updated_unix_ns;   // 最後に写した時刻(UNIX時刻、ナノ秒)
+  int64_t packets_sent;      // 送信パケット数
+  int64_t packets_received;  // 受信パケット数
+  int64_t packets_duplicate; // 重複受信パケット数
+  int64_t packets_late;      // 照合できる範囲より古い応答の数
+  int64_t packets_timeout;   // 応答待ちがタイムアウトしたパケット数
+  PingRttStats rtt;          // RTT統計
+  PingHistogram hist;        // RTTの分布
+  PingSharedTarget targets[]; // 宛先ごとの統計
+} PingSharedStats;
+
+// ctx->stats_pathに共有ファイルを作る（スレッド分割時のワーカーは「パス.ワーカー番号」）
+// 宛先の行数は、その時点の宛先数と解決中の名前の数の合計
+int open_shared_stats(PingContext *ctx);
+// 統計を共有ファイルへ写す
+void publish_shared_stats(PingContext *ctx);
+// 前回写してからPING_SHARED_PUBLISH_MS過ぎていれば写す
+void publish_shared_stats_if_due(PingContext *ctx, const struct timespec *now);
+// 最後の統計を終了済みとして写し、ファイルを閉じる（ファイルは残す）
+void close_shared_stats(PingContext *ctx);
+
+// 読み手: 共有ファイルを読み取り専用でmmapする（sizeにファイルの大きさを返す）
+// ft_pingを起動し直すとファイルは置き換わるので、読み手は読むたびにmmapし直す
+// 戻り値: mmapした先頭, NULL=読めない・形式が不正（メッセージ出力済み）
+const PingSharedStats *map_shared_stats(const char *path, size_t *size);
+void unmap_shared_stats(const PingSharedStats *shared, size_t size);
+// seqlockで一貫した写しをoutへ取る（outはsizeバイト以上）
+// 戻り値: 0=成功, -1=書き込みが続いて一貫した写しを取れなかった
+int snapshot_shared_stats(const PingSharedStats *shared, size_t size,
+                          PingSharedStats *out);
+
+#endif // PING_SHARED_H
@@ -7,16 +7,18 @@
 #endif
 
 #include <signal.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include "ping.h"
 
 
 void signal_handler(int sig, siginfo_t *info, void *ucontext);
-int get_exit_flag(void);
-void print_statistics(PingContext *ctx);
+// SIGINT/SIGTERMでctxのping_runningを下ろし、SIGQUITで統計の表示を要求するハンドラを登録する
+int setup_signal_handlers(PingContext *ctx);
+// SIGQUITで統計の表示が要求されていれば1を返し、要求をクリアする
+int take_stats_request(void);
 
 
 #endif // PING_SIGNAL_H
@@ -0,0 +1,21 @@
+#ifndef PING_STATS_H
+#define PING_STATS_H
+
+#include "ping.h"
+#include <string.h>
+
+void add_rtt_sample(PingRttStats *stats, double rtt);
+void merge_rtt_stats(PingRttStats *dst, const PingRttStats *src);
+
+// RTT(ミリ秒)をヒストグラムに記録する（O(1)、メモリ確保なし）
+void histogram_record(PingHistogram *hist, double rtt);
+// p(0〜100)パーセンタイルのRTT(ミリ秒)を返す（記録がなければ0）
+double histogram_percentile(const PingHistogram *hist, double p);
+// RTT(ミリ秒)以下のバケットに入っている記録数（rttを含むバケットは、上端がrtt以下なら数える）
+unsigned long long histogram_count_below(const PingHistogram *hist, double rtt);
+void histogram_merge(PingHistogram *dst, const PingHistogram *src);
+
+void merge_interval_stats(PingIntervalStats *dst, const PingIntervalStats *src);
+void reset_interval_stats(PingIntervalStats *stats);
+
+#endif // PING_STATS_H
@@ -0,0 +1,13 @@
+#ifndef PING_SUMMARY_H
+#define PING_SUMMARY_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// 累積の統計（宛先ごと・全体・パーセンタイル・verbose時の内訳）を表示する
+void print_statistics(PingContext *ctx);
+// 前回のレポート以降の区間統計を1行で表示する
+void print_interval_report(PingContext *ctx);
+
+#endif // PING_SUMMARY_H
@@ -0,0 +1,48 @@
+#ifndef PING_SWEEP_H
+#define PING_SWEEP_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// データ部サイズの掃引（--sweep MIN:MAX[:STEP]）
+// 各宛先への送信ごとにMINからMAXまでのサイズを順に使い、サイズごとに送受信数とRTTを集計する
+// 終了時にサイズとRTTの最小値を直線で近似し、1バイトあたりの遅延と帯域を推定する
+#define PING_SWEEP_DEFAULT_SIZES 16 // STEPを省略したときのサイズの数
+#define PING_SWEEP_LOSS_JUMP 20.0   // 1つ小さいサイズよりロス率がこのポイント以上高ければ知らせる
+
+// サイズとRTTの直線近似（RTT = base_ms + ms_per_byte * バイト数）
+typedef struct {
+  int points;         // 近似に使ったサイズの数（応答のあったサイズ）
+  double base_ms;     // 切片（データ部0バイトのRTT）
+  double ms_per_byte; // 傾き（データ部1バイトあたりのRTTの増加）
+  double r2;          // 決定係数
+} PingSweepFit;
+
+// サイズの範囲を設定し、ctx->data_sizeを最大のサイズにする
+// stepが0ならPING_SWEEP_DEFAULT_SIZES個に分ける
+// 戻り値: 0=成功, -1=サイズの数がPING_MAX_SWEEP_SIZESを超える
+int setup_sweep(PingContext *ctx, int min, int max, int step);
+// index番目のサイズ（最後のサイズはMAX）
+int sweep_data_size(const PingContext *ctx, int index);
+// -cによる宛先ごとの送信数の上限（-cはサイズごとの数なので、サイズの数を掛ける）
+// -cはINT_MAXまで受け付けるので64ビットで数える（-cがなければ0）
+long long sweep_probe_limit(const PingContext *ctx);
+// 次の送信に使うサイズの番号（宛先ごとに順に使う）
+int next_sweep_index(const PingContext *ctx, const PingTarget *target);
+// 送信・応答をサイズごとの統計に数える
+void count_sweep_send(PingContext *ctx, PingTarget *target, int index);
+void count_sweep_reply(PingContext *ctx, PingTarget *target, int index,
+                       double rtt);
+// サイズごとのRTTの最小値を最小二乗法で直線に近似する
+// 戻り値: 0=成功, -1=応答のあったサイズが2つ未満
+int fit_sweep(const PingContext *ctx, const PingTarget *target,
+              PingSweepFit *fit);
+// index番目のサイズで、1つ小さいサイズよりロス率が跳ね上がったか
+int sweep_loss_jump(const PingContext *ctx, const PingTarget *target,
+                    int index);
+// 宛先ごとにサイズごとの統計・近似・ロス率の跳ね上がりを表示する
+void print_sweep_statistics(const PingContext *ctx, FILE *stream);
+
+#endif // PING_SWEEP_H
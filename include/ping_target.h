@@ -0,0 +1,24 @@
+#ifndef PING_TARGET_H
+#define PING_TARGET_H
+
+#include "ping.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int add_target(PingContext *ctx, const char *hostname);
+// 解決済みのアドレスで宛先を追加する
+// 戻り値: 追加した宛先のインデックス, -1=メモリ不足
+int add_resolved_target(PingContext *ctx, const char *hostname,
+                        const struct sockaddr_in *addr);
+// 宛先を登録する（ctx->resolverがなければadd_targetと同じく、その場で解決する）
+// IPアドレスとキャッシュにある名前はすぐに追加し、それ以外はワーカーに解決させる
+// 戻り値: 0=追加または解決待ち, -1=解決失敗またはメモリ不足
+int request_target(PingContext *ctx, const char *hostname);
+// 解決を終えた宛先を受け取って追加する（解決できなかった名前は報告して捨てる）
+// 戻り値: 追加した宛先数
+int collect_targets(PingContext *ctx);
+int load_targets_file(PingContext *ctx, const char *path);
+void free_targets(PingContext *ctx);
+
+#endif // PING_TARGET_H
@@ -0,0 +1,18 @@
+#ifndef PING_TX_H
+#define PING_TX_H
+
+#include "ping.h"
+#include <netinet/ip_icmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+int init_tx_engine(PingTxEngine *tx, int ident, size_t packet_size);
+// packet_sizeはinit_tx_engineの大きさ以下（--sweepでは送信ごとに短くする）
+int prepare_tx_slot(PingTxEngine *tx, int seq, const struct timespec *timestamp,
+                    const struct sockaddr_in *dest_addr, size_t packet_size);
+int flush_tx_engine(PingTxEngine *tx, int sock_fd);
+void close_tx_engine(PingTxEngine *tx);
+
+#endif // PING_TX_H
@@ -0,0 +1,80 @@
+#ifndef PING_URING_H
+#define PING_URING_H
+
+#include "ping.h"
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// io_uringでの送受信（--io-uring）
+// liburingは使わず、io_uring_setup/io_uring_enterを直接呼ぶ
+//
+// 受信: ソケットにmultishotのrecvmsgを1つだけ登録し、カーネルが登録済みのバッファ群
+// （provided buffer ring）へ次々に受信して完了キューに積む。完了キューはmmapしてあるので、
+// 読み出しにシステムコールは要らない（リングのfdをepollに登録して起床だけに使う）
+// 送信: 溜めたパケットをリンクしたsendmsgとして並べ、1回のio_uring_enterで投入する。
+// 途中で失敗すると残りは取り消されるので、送信できた数の扱いはsendmmsgと同じ
+#define PING_URING_ENTRIES 128  // 投入キューの長さ（送信のバッチと受信の登録が入る）
+#define PING_URING_CQ_ENTRIES 1024 // 完了キューの長さ
+#define PING_URING_BUFFERS 128  // 受信用に登録するバッファ数（2のべき乗）
+
+// 受信した1パケット（完了キューから取り出し、まだ処理していないもの）
+typedef struct {
+  int bid; // 受信したバッファの番号
+  int len; // 受信したバイト数（recvmsgの出力ヘッダを含む）
+} PingUringPacket;
+
+typedef struct PingUring {
+  int ring_fd;  // io_uringのfd（epollに登録する）
+  int sock_fd;  // 送受信するソケット
+  // 投入キュー（mmap）
+  void *sq_ring;
+  size_t sq_ring_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned sq_entries;
+  unsigned sq_local_tail; // 書き込み済みのSQEの末尾（まだ投入していない分を含む）
+  unsigned sq_submitted;  // 投入済みのSQEの末尾
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  // 完了キュー（mmap、単一mmapに対応したカーネルではsq_ringと同じ領域）
+  void *cq_ring;
+  size_t cq_ring_size;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  // 受信バッファ（provided buffer ring）
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_size;
+  unsigned char *buffers;
+  size_t buffer_size;     // バッファ1つの大きさ（出力ヘッダ・送信元・制御メッセージ・パケット）
+  unsigned short buf_tail; // バッファリングの末尾
+  struct msghdr recv_msg;  // multishot recvmsgの雛形（送信元・制御メッセージの領域の大きさ）
+  int recv_armed;          // multishot recvmsgが登録されている
+  int recv_error;          // 受信の完了で返ったエラー（0=なし、errnoの値）
+  // 完了キューから取り出したが、まだ処理していない受信
+  // （送信の完了を待つ間に届いた受信を、次のreceive_pingで処理する）
+  PingUringPacket ready[PING_URING_BUFFERS];
+  int ready_head, ready_count;
+  int held[PING_RX_BATCH]; // 前回のバッチで渡し、次の呼び出しで返すバッファ番号
+  int held_count;
+  // 送信
+  int send_inflight;               // 完了待ちのsendmsgの数
+  int send_res[PING_TX_BATCH];     // スロットごとのsendmsgの結果
+} PingUring;
+
+// io_uringを準備し、ソケットにmultishot recvmsgを登録する
+// payload_sizeは受信するパケットの最大の大きさ
+// 戻り値: 準備したリング, NULL=使えない（理由をerrnoに残す。呼び出し側が従来の経路に切り替える）
+PingUring *open_uring(int sock_fd, size_t payload_size);
+// 溜めた送信パケットをsendmsgとして投入し、全て完了するまで待つ
+// 戻り値: 先頭から続けて送信できた数, -1=最初のパケットから送信できなかった
+int uring_send_batch(PingUring *ring, PingTxEngine *tx);
+// 受信済みのパケットを最大PING_RX_BATCH個、rxの配列（iovs・addrs・msgs）に並べる
+// 前回並べたパケットのバッファはここでカーネルに返す
+// 戻り値: 並べた数, -1=受信エラー(errnoを参照)
+int uring_receive_batch(PingUring *ring, PingRxEngine *rx);
+// 処理していない受信があるか、止まった受信を登録し直す必要があるか
+int uring_ready(const PingUring *ring);
+void close_uring(PingUring *ring);
+
+#endif // PING_URING_H
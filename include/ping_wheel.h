@@ -0,0 +1,23 @@
+#ifndef PING_WHEEL_H
+#define PING_WHEEL_H
+
+#include "ping.h"
+#include <stdlib.h>
+
+// capacity個のタイマー(id=0..capacity-1)を扱うタイマーホイールを作る
+// nowは現在時刻(ミリ秒)で、以降の時刻は全て同じ時計のミリ秒で渡す
+int init_timer_wheel(PingTimerWheel *wheel, int capacity,
+                     unsigned long long now);
+// タイマーidをexpires(ミリ秒)に満了するよう登録する（登録済みなら付け替える）
+void timer_wheel_add(PingTimerWheel *wheel, int id, unsigned long long expires);
+void timer_wheel_cancel(PingTimerWheel *wheel, int id);
+int timer_wheel_pending(const PingTimerWheel *wheel, int id);
+// 時刻nowまで進め、満了したタイマーごとにexpire(arg, id)を呼ぶ
+// 戻り値: 満了したタイマー数
+int timer_wheel_advance(PingTimerWheel *wheel, unsigned long long now,
+                        void (*expire)(void *arg, int id), void *arg);
+// 次に進める必要がある時刻までのミリ秒（タイマーがなければ-1）
+long timer_wheel_next(const PingTimerWheel *wheel);
+void close_timer_wheel(PingTimerWheel *wheel);
+
+#endif // PING_WHEEL_H
@@ -0,0 +1,24 @@
+#ifndef PING_WINDOW_H
+#define PING_WINDOW_H
+
+#include "ping.h"
+#include <stdlib.h>
+
+// size個（2のべき乗、PING_SEQ_WINDOW_MAX以下）のスロットを確保する
+int create_seq_window(PingSeqWindow *window, int size);
+// 応答待ちになりうる送信数が収まるスロット数（PING_SEQ_WINDOW以上の2のべき乗）
+// 16ビットのシーケンス番号で区別できる数を超える場合は-1
+int seq_window_size(long long in_flight);
+// 送信番号numberが使うスロットの位置（応答待ちタイマーのidにも使う）
+int seq_slot_index(const PingSeqWindow *window, long long number);
+// 送信番号numberのスロットを送信用に確保する（古い記録は上書きされる）
+PingSeqSlot *claim_seq_slot(PingSeqWindow *window, long long number);
+// 送信済みのスロットを送信番号で引く（範囲外ならNULL）
+PingSeqSlot *seq_slot(PingSeqWindow *window, long long number, long long sent);
+// 16ビットのシーケンス番号から送信番号を復元する
+// sentはこれまでの送信数。照合できる範囲より古い場合は-1
+long long seq_window_number(const PingSeqWindow *window, int seq,
+                            long long sent);
+void free_seq_window(PingSeqWindow *window);
+
+#endif // PING_WINDOW_H
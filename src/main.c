@@ -1,189 +1,249 @@
 #include "ping.h"
 #include "ping_args.h"
+#include "ping_engine.h"
+#include "ping_output.h"
 #include "ping_packet.h"
-#include "ping_resolve.h"
+#include "ping_replay.h"
+#include "ping_resolver.h"
+#include "ping_shard.h"
+#include "ping_target.h"
 #include "ping_signal.h"
-
-static int initialize_context(PingContext *ctx);
-static int setup_signal_handlers(void);
-static int create_socket(PingContext *ctx);
-static int run_ping_loop(PingContext *ctx);
-static void cleanup_context(PingContext *ctx);
-
-static int initialize_context(PingContext *ctx) {
-  if (!ctx) {
-    return -1;
-  }
-
-  memset(ctx, 0, sizeof(*ctx));
-  ctx->packets_duplicate = 0;
-  ctx->ping_running = 1;
-  ctx->sock_fd = -1;
-  ctx->verbose_mode = 0;
-  
-  // 初期容量を設定
-  ctx->rtt_capacity = 64;
-  ctx->sent_times_capacity = 64;
-  ctx->received_seq_size = 8; // 256ビット分（64個のシーケンス番号まで対応）
-  
-  // 動的メモリ割り当て
-  ctx->rtt_times = malloc(ctx->rtt_capacity * sizeof(double));
-  ctx->sent_times = malloc(ctx->sent_times_capacity * sizeof(struct timespec));
-  ctx->received_seq = calloc(ctx->received_seq_size, sizeof(int));
-  
-  if (!ctx->rtt_times || !ctx->sent_times || !ctx->received_seq) {
-    free(ctx->rtt_times);
-    free(ctx->sent_times);
-    free(ctx->received_seq);
-    return -1;
+#include "ping_summary.h"
+#include "ping_sweep.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+
+// 名前解決の完了を待って宛先を受け取る
+// allが0なら宛先が1つでも揃った時点で、1なら全て解決し終えるまで待つ
+static int wait_for_targets(PingContext *ctx, int all) {
+  struct pollfd pfd = {ctx->resolver->event_fd, POLLIN, 0};
+  sigset_t block, orig;
+
+  // 終了シグナルを確認してから待つまでの間に届いても取りこぼさないよう、ppollで待つ
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &block, &orig);
+  while (resolver_pending(ctx->resolver) > 0 &&
+         (all || ctx->target_count == 0) && ctx->ping_running) {
+    if (ppoll(&pfd, 1, NULL, &orig) < 0 && errno != EINTR) {
+      perror("ft_ping: ppoll failed");
+      break;
+    }
+    collect_targets(ctx);
   }
-  
-  return 0;
+  pthread_sigmask(SIG_SETMASK, &orig, NULL);
+  return ctx->ping_running ? 0 : -1;
 }
 
-static int setup_signal_handlers(void) {
-  struct sigaction sa;
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_sigaction = signal_handler;
-  sa.sa_flags = SA_SIGINFO;
-  sigemptyset(&sa.sa_mask);
-
-  if (sigaction(SIGINT, &sa, NULL) < 0) {
-    perror("sigaction SIGINT failed");
+// コマンドライン引数と宛先ファイルの宛先を登録する
+// 宛先が1つだけの場合は解決に失敗したら終了し、複数の場合は解決できた宛先だけで続ける
+// 名前はワーカーで並列に解決し、解決できた宛先から送信を始める
+// スレッド分割時は宛先を最初にワーカーへ振り分けるので、全て解決してから始める
+static int load_targets(PingContext *ctx, const PingOptions *opts) {
+  ctx->resolver = create_resolver(opts->resolvers, opts->dns_cache);
+  if (!ctx->resolver) {
     return -1;
   }
-
-  if (sigaction(SIGTERM, &sa, NULL) < 0) {
-    perror("sigaction SIGTERM failed");
-    return -1;
+  for (int i = 0; i < opts->host_count; i++) {
+    if (request_target(ctx, opts->hosts[i]) < 0 && opts->host_count == 1 &&
+        !opts->targets_file) {
+      return -1;
+    }
   }
-
-  return 0;
-}
-
-static int create_socket(PingContext *ctx) {
-  ctx->sock_fd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-  if (ctx->sock_fd < 0) {
-    perror("socket creation failed");
-    printf("Note: This program must be run as root\n");
+  if (opts->targets_file && load_targets_file(ctx, opts->targets_file) < 0) {
     return -1;
   }
-  return 0;
-}
-
-static int run_ping_loop(PingContext *ctx) {
-  int first = 1;
-  struct timespec last_send_time;
-
-  if (clock_gettime(CLOCK_MONOTONIC, &last_send_time) != 0) {
-    perror("clock_gettime failed");
+  if (start_resolver(ctx->resolver) < 0 ||
+      wait_for_targets(ctx, opts->threads > 1) < 0) {
     return -1;
   }
-
-  while (ctx->ping_running && !get_exit_flag()) {
-    fd_set read_fds;
-    struct timeval timeout;
-
-    FD_ZERO(&read_fds);
-    FD_SET(ctx->sock_fd, &read_fds);
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 100000;
-
-    int sel_ret = select(ctx->sock_fd + 1, &read_fds, NULL, NULL, &timeout);
-    if (sel_ret > 0 && FD_ISSET(ctx->sock_fd, &read_fds)) {
-      if (receive_ping(ctx) < 0) {
-        perror("receive_ping error");
-      }
-    } else if (sel_ret < 0) {
-      perror("select error");
-    }
-
-    if (sel_ret == 0) {
-      struct timespec current_time;
-      if (clock_gettime(CLOCK_MONOTONIC, &current_time) != 0) {
-        perror("clock_gettime failed");
-        continue;
-      }
-
-      double elapsed =
-          (current_time.tv_sec - last_send_time.tv_sec) +
-          (current_time.tv_nsec - last_send_time.tv_nsec) / 1000000000.0;
-
-      if (elapsed >= PING_INTERVAL) {
-        if (send_ping(ctx, first, &current_time) == 0) {
-          first = 0;
-          last_send_time = current_time;
-        }
-      }
+  if (ctx->target_count == 0) {
+    // 宛先が1つだけなら、解決できなかった理由は報告済み
+    if (opts->host_count != 1 || opts->targets_file) {
+      fprintf(stderr, "ft_ping: no reachable host to ping\n");
     }
+    return -1;
   }
-
   return 0;
 }
 
-static void cleanup_context(PingContext *ctx) {
-  if (ctx) {
-    if (ctx->sock_fd >= 0) {
-      close(ctx->sock_fd);
-      ctx->sock_fd = -1;
-    }
-    
-    // 動的メモリを解放
-    free(ctx->rtt_times);
-    free(ctx->sent_times);
-    free(ctx->received_seq);
-    
-    ctx->rtt_times = NULL;
-    ctx->sent_times = NULL;
-    ctx->received_seq = NULL;
-  }
-}
 int main(int argc, char *argv[]) {
   PingContext ctx;
-  char hostname[256] = {0};
-  int show_help = 0;
-  int verbose_mode = 0;
+  PingOptions opts;
 
   if (initialize_context(&ctx) < 0) {
     fprintf(stderr, "ft_ping: failed to initialize context\n");
     return EXIT_FAILURE;
   }
-  if (parse_ping_args(argc, argv, hostname, &show_help, &verbose_mode) != 0) {
-    fprintf(stderr, "ft_ping: missing host operand\nTry 'ft_ping --help' or 'ft_ping "
-                    "--usage' for more information.\n");
+  int parse_ret = parse_ping_args(argc, argv, &opts);
+  if (parse_ret != 0) {
+    if (parse_ret == -1) {
+      fprintf(stderr, "ft_ping: missing host operand\nTry 'ft_ping --help' or "
+                      "'ft_ping --usage' for more information.\n");
+    }
+    free_ping_args(&opts);
+    cleanup_context(&ctx);
     return EXIT_FAILURE;
   }
-  ctx.verbose_mode = verbose_mode;
-  if (show_help) {
-    printf("Usage: ft_ping [-v] <destination>\n");
+  ctx.verbose_mode = opts.verbose_mode;
+  ctx.flood_mode = opts.flood_mode;
+  ctx.preload = opts.preload;
+  ctx.kernel_timestamps = opts.kernel_timestamps;
+  ctx.data_size = opts.data_size;
+  ctx.no_filter = opts.no_filter;
+  ctx.io_uring = opts.io_uring;
+  ctx.profile = opts.profile;
+  ctx.socket_type = opts.socket_type;
+  ctx.report_interval = opts.report_interval;
+  ctx.format = opts.format;
+  ctx.quiet = opts.quiet;
+  ctx.count = opts.count;
+  ctx.deadline = opts.deadline;
+  ctx.record_path = opts.record;
+  ctx.stats_path = opts.stats_file;
+  if (opts.linger > 0.0) {
+    ctx.linger = opts.linger;
+  }
+  if (opts.sweep) {
+    if (setup_sweep(&ctx, opts.sweep_min, opts.sweep_max, opts.sweep_step) <
+        0) {
+      fprintf(stderr, "ft_ping: too many sizes in the sweep (max %d)\n",
+              PING_MAX_SWEEP_SIZES);
+      free_ping_args(&opts);
+      cleanup_context(&ctx);
+      return EXIT_FAILURE;
+    }
+  }
+  if (opts.show_help) {
+    printf("Usage: ft_ping [-v] [-q] [-f] [-X] [-c count] [-i interval] [-l preload] "
+           "[-s size] [--sweep MIN:MAX[:STEP]] [-w deadline] [-W timeout] "
+           "[--file FILE] [--threads N] [--record FILE] [--stats-file FILE] "
+           "<destination>...\n");
+    printf("       ft_ping [-q] [-W timeout] [--format=FORMAT] --replay FILE "
+           "[--ident N] [--record FILE]\n");
     printf("Send ICMP ECHO_REQUEST packets to network hosts.\n");
     printf("\nOptions:\n");
     printf("  -v         verbose output\n");
+    printf("  -q         quiet output: print only the summary\n");
+    printf("  -f         flood ping: send as fast as replies come back\n");
+    printf("  -c NUMBER  stop after sending NUMBER packets to each destination\n");
+    printf("  -i NUMBER  wait NUMBER seconds between sending each packet\n");
+    printf("  -l NUMBER  send NUMBER packets without waiting for replies\n");
+    printf("  -s NUMBER  send NUMBER data octets (default 56, max 65507)\n");
+    printf("  --sweep MIN:MAX[:STEP]\n");
+    printf("             cycle the data size from MIN to MAX and fit RTT "
+           "against size (-c counts per size)\n");
+    printf("  -w NUMBER  stop after NUMBER seconds\n");
+    printf("  -X         print time spent in each stage of the send/receive "
+           "loop (needs make PROFILE=1)\n");
+    printf("  -W NUMBER  number of seconds to wait for each reply (default "
+           "10)\n");
+    printf("  --file FILE\n");
+    printf("             read destinations from FILE, one per line\n");
+    printf("  --threads N\n");
+    printf("             split destinations across N worker threads\n");
+    printf("  --resolvers N\n");
+    printf("             resolve up to N host names in parallel (default "
+           "16)\n");
+    printf("  --dns-cache FILE\n");
+    printf("             reuse host name resolutions from FILE until their "
+           "TTL expires\n");
+    printf("  --socket TYPE\n");
+    printf("             use a raw or dgram ICMP socket (default: raw, falling "
+           "back to dgram)\n");
+    printf("  --no-filter\n");
+    printf("             do not attach the in-kernel ICMP socket filter\n");
+    printf("  --io-uring send and receive through io_uring (falls back to "
+           "sendmmsg/recvmmsg)\n");
+    printf("  --format=FORMAT\n");
+    printf("             print replies as text, jsonl or csv (statistics go "
+           "to stderr for jsonl/csv)\n");
+    printf("  --report-interval N\n");
+    printf("             print statistics for each N-second interval\n");
+    printf("  --kernel-timestamps\n");
+    printf("             measure RTT with kernel send/receive timestamps\n");
+    printf("  --record FILE\n");
+    printf("             write every probe to a compact binary log (read it "
+           "with ft_ping_read)\n");
+    printf("  --stats-file FILE\n");
+    printf("             publish live statistics in a shared file (read it "
+           "with ft_ping_exporter)\n");
+    printf("  --replay FILE\n");
+    printf("             compute replies and statistics from the ICMP packets "
+           "in a pcap/pcapng capture\n");
+    printf("  --ident N  replay only echo requests with identifier N (default: "
+           "the first one)\n");
     printf("  -?         display this help and exit\n");
     printf("  --help     display this help and exit\n");
     printf("  --usage    display this help and exit\n");
+    free_ping_args(&opts);
+    cleanup_context(&ctx);
     return EXIT_SUCCESS;
   }
-  if (setup_signal_handlers() < 0) {
+  if (setup_signal_handlers(&ctx) < 0) {
+    free_ping_args(&opts);
     cleanup_context(&ctx);
     return EXIT_FAILURE;
   }
-  ctx.dest_addr.sa_family = AF_INET;
-  if (resolve_hostname(&ctx, hostname) < 0) {
+  if (opts.replay) {
+    // キャプチャの再生ではソケットも名前解決も使わず、キャプチャの時刻で処理する
+    ctx.replay = 1;
+    ctx.kernel_timestamps = 0;
+    ctx.ident = opts.ident;
+    int replay_ret = run_replay(&ctx, opts.replay);
+    free_ping_args(&opts);
+    if (replay_ret < 0) {
+      cleanup_context(&ctx);
+      return EXIT_FAILURE;
+    }
+    print_statistics(&ctx);
     cleanup_context(&ctx);
-    return EXIT_FAILURE;
+    return EXIT_SUCCESS;
   }
-  if (create_socket(&ctx) < 0) {
+  int target_ret = load_targets(&ctx, &opts);
+  free_ping_args(&opts);
+  if (target_ret < 0) {
     cleanup_context(&ctx);
     return EXIT_FAILURE;
   }
-  if (run_ping_loop(&ctx) < 0) {
-    cleanup_context(&ctx);
-    return EXIT_FAILURE;
+  // 各宛先への送信間隔が-iになるよう、全宛先の送信を間隔内に均等に並べる
+  double interval = opts.interval > 0.0 ? opts.interval : PING_INTERVAL;
+  if (opts.threads > 1 && ctx.target_count > 1) {
+    // 宛先をワーカースレッドに分割し、スレッドごとのソケットで並列に送受信する
+    if (run_sharded(&ctx, opts.threads, interval) < 0) {
+      cleanup_context(&ctx);
+      return EXIT_FAILURE;
+    }
+  } else {
+    if (setup_engine(&ctx, interval) < 0) {
+      cleanup_context(&ctx);
+      return EXIT_FAILURE;
+    }
+    print_ping_header(&ctx);
+    // SIGQUITで待ちが中断されるので、そのたびに累積の統計を表示する
+    int step = start_ping_loop(&ctx);
+    while (step >= 0 &&
+           (step = step_ping_loop(&ctx, ping_loop_timeout_ms(&ctx))) > 0) {
+      if (take_stats_request()) {
+        flush_output(&ctx.out);
+        print_statistics(&ctx);
+      }
+    }
+    if (step < 0) {
+      cleanup_context(&ctx);
+      return EXIT_FAILURE;
+    }
   }
-  if (get_exit_flag()) {
-    print_statistics(&ctx);
+  // シグナルか-c/-wで送受信を終えたので統計を表示する
+  print_statistics(&ctx);
+  // -c/-wを指定した場合、応答が1つもなければ失敗として終了する（スクリプトでの判定用）
+  int status = EXIT_SUCCESS;
+  if ((ctx.count > 0 || ctx.deadline > 0.0) && ctx.packets_received == 0) {
+    status = EXIT_FAILURE;
   }
   cleanup_context(&ctx);
-  return EXIT_SUCCESS;
+  return status;
 }
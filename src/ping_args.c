@@ -1,17 +1,113 @@
+#include "ping.h"
 #include "ping_args.h"
 
+#include <errno.h>
+#include <limits.h>
+
 #define MAX_HOSTNAME_LEN 255
+#define MAX_PRELOAD PING_SEQ_WINDOW
+#define MAX_INTERVAL 3600.0
+#define MAX_THREADS 256
+#define MAX_RESOLVERS 1024
+#define MIN_REPORT_INTERVAL 0.1
+#define MIN_WAIT 0.001
+
+// 数値オプションの値を解析する (min <= 値 <= max のみ許可)
+static int parse_int_value(const char *str, int min, int max, int *out) {
+  char *end = NULL;
+  long value;
 
-int parse_ping_args(int argc, char **argv, char *hostname_out, int *show_help,
-                    int *verbose_mode) {
-  if (!argv || !show_help || !verbose_mode) {
+  if (!str || *str == '\0') {
+    return -1;
+  }
+  errno = 0;
+  value = strtol(str, &end, 10);
+  if (errno != 0 || *end != '\0' || value < min || value > max) {
     return -1;
   }
+  *out = (int)value;
+  return 0;
+}
+
+// 秒数オプションの値を解析する (min <= 値 <= max のみ許可)
+static int parse_seconds_value(const char *str, double min, double max,
+                               double *out) {
+  char *end = NULL;
+  double value;
+
+  if (!str || *str == '\0') {
+    return -1;
+  }
+  errno = 0;
+  value = strtod(str, &end);
+  if (errno != 0 || *end != '\0' || !(value >= min && value <= max)) {
+    return -1;
+  }
+  *out = value;
+  return 0;
+}
+
+// --sweepの "MIN:MAX" または "MIN:MAX:STEP" を解析する
+static int parse_sweep_value(const char *str, PingOptions *opts) {
+  char buf[64];
+  char *fields[3] = {NULL, NULL, NULL};
+  int count = 0;
+
+  if (strlen(str) >= sizeof(buf)) {
+    return -1;
+  }
+  strcpy(buf, str);
+  char *p = buf;
+  while (count < 3) {
+    fields[count++] = p;
+    p = strchr(p, ':');
+    if (!p) {
+      break;
+    }
+    *p++ = '\0';
+  }
+  if (p || count < 2) {
+    return -1;
+  }
+  opts->sweep_step = 0;
+  if (parse_int_value(fields[0], 0, PING_MAX_DATA_SIZE, &opts->sweep_min) < 0 ||
+      parse_int_value(fields[1], opts->sweep_min, PING_MAX_DATA_SIZE,
+                      &opts->sweep_max) < 0 ||
+      (count == 3 && parse_int_value(fields[2], 1, PING_MAX_DATA_SIZE,
+                                     &opts->sweep_step) < 0)) {
+    return -1;
+  }
+  opts->sweep = 1;
+  return 0;
+}
+
+// "-l N" と "-lN" の両方の形式から値の文字列を取り出す
+static const char *option_value(int argc, char **argv, int *i) {
+  if (argv[*i][2] != '\0') {
+    return &argv[*i][2];
+  }
+  if (*i + 1 >= argc) {
+    return NULL;
+  }
+  (*i)++;
+  return argv[*i];
+}
 
-  *show_help = 0;
-  *verbose_mode = 0;
+int parse_ping_args(int argc, char **argv, PingOptions *opts) {
+  if (!argv || !opts) {
+    return -1;
+  }
 
-  int hostname_index = -1;
+  memset(opts, 0, sizeof(*opts));
+  opts->preload = 1;
+  opts->data_size = ICMP_DATA_SIZE;
+  opts->threads = 1;
+  opts->resolvers = PING_RESOLVE_CONCURRENCY;
+  opts->ident = -1;
+  opts->hosts = calloc(argc > 0 ? argc : 1, sizeof(char *));
+  if (!opts->hosts) {
+    return -1;
+  }
 
   for (int i = 1; i < argc; i++) {
     if (!argv[i]) {
@@ -20,12 +116,267 @@ int parse_ping_args(int argc, char **argv, char *hostname_out, int *show_help,
 
     if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "--usage") == 0 ||
         strcmp(argv[i], "-?") == 0) {
-      *show_help = 1;
+      opts->show_help = 1;
       return 0;
     }
 
     if (strcmp(argv[i], "-v") == 0) {
-      *verbose_mode = 1;
+      opts->verbose_mode = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--kernel-timestamps") == 0) {
+      opts->kernel_timestamps = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--socket") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      i++;
+      if (strcmp(argv[i], "raw") == 0) {
+        opts->socket_type = PING_SOCKET_RAW;
+      } else if (strcmp(argv[i], "dgram") == 0) {
+        opts->socket_type = PING_SOCKET_DGRAM;
+      } else {
+        fprintf(stderr, "ft_ping: invalid socket type (`%s')\n", argv[i]);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strcmp(argv[i], "--format") == 0 ||
+        strncmp(argv[i], "--format=", 9) == 0) {
+      // "--format jsonl" と "--format=jsonl" の両方を受け付ける
+      const char *value = argv[i] + 8;
+      if (*value == '=') {
+        value++;
+      } else if (i + 1 >= argc) {
+        return -1;
+      } else {
+        value = argv[++i];
+      }
+      if (strcmp(value, "text") == 0) {
+        opts->format = PING_FORMAT_TEXT;
+      } else if (strcmp(value, "jsonl") == 0) {
+        opts->format = PING_FORMAT_JSONL;
+      } else if (strcmp(value, "csv") == 0) {
+        opts->format = PING_FORMAT_CSV;
+      } else {
+        fprintf(stderr, "ft_ping: invalid output format (`%s')\n", value);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strcmp(argv[i], "-X") == 0) {
+#ifndef PING_PROFILE
+      fprintf(stderr, "ft_ping: -X needs a build with profiling counters "
+                      "(make PROFILE=1)\n");
+      return -2;
+#endif
+      opts->profile = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "-q") == 0) {
+      opts->quiet = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--no-filter") == 0) {
+      opts->no_filter = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--io-uring") == 0) {
+      opts->io_uring = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "-f") == 0) {
+      opts->flood_mode = 1;
+      continue;
+    }
+
+    if (strcmp(argv[i], "--file") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      opts->targets_file = argv[++i];
+      continue;
+    }
+
+    if (strcmp(argv[i], "--threads") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      i++;
+      if (parse_int_value(argv[i], 1, MAX_THREADS, &opts->threads) < 0) {
+        fprintf(stderr, "ft_ping: invalid thread count (`%s')\n", argv[i]);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strcmp(argv[i], "--resolvers") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      i++;
+      if (parse_int_value(argv[i], 1, MAX_RESOLVERS, &opts->resolvers) < 0) {
+        fprintf(stderr, "ft_ping: invalid resolver count (`%s')\n", argv[i]);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strcmp(argv[i], "--dns-cache") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      opts->dns_cache = argv[++i];
+      continue;
+    }
+
+    if (strcmp(argv[i], "--record") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      opts->record = argv[++i];
+      continue;
+    }
+
+    if (strcmp(argv[i], "--stats-file") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      opts->stats_file = argv[++i];
+      continue;
+    }
+
+    if (strcmp(argv[i], "--replay") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      opts->replay = argv[++i];
+      continue;
+    }
+
+    if (strcmp(argv[i], "--ident") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      i++;
+      if (parse_int_value(argv[i], 0, 0xFFFF, &opts->ident) < 0) {
+        fprintf(stderr, "ft_ping: invalid identifier (`%s')\n", argv[i]);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strcmp(argv[i], "--sweep") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      i++;
+      if (parse_sweep_value(argv[i], opts) < 0) {
+        fprintf(stderr, "ft_ping: invalid size sweep (`%s', expected "
+                        "MIN:MAX[:STEP])\n",
+                argv[i]);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strcmp(argv[i], "--report-interval") == 0) {
+      if (i + 1 >= argc) {
+        return -1;
+      }
+      i++;
+      if (parse_seconds_value(argv[i], MIN_REPORT_INTERVAL, MAX_INTERVAL,
+                              &opts->report_interval) < 0) {
+        fprintf(stderr, "ft_ping: invalid report interval (`%s')\n", argv[i]);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-c", 2) == 0) {
+      const char *value = option_value(argc, argv, &i);
+      if (!value) {
+        return -1;
+      }
+      if (parse_int_value(value, 1, INT_MAX, &opts->count) < 0) {
+        fprintf(stderr, "ft_ping: invalid count of packets to transmit (`%s')\n",
+                value);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-w", 2) == 0) {
+      const char *value = option_value(argc, argv, &i);
+      if (!value) {
+        return -1;
+      }
+      if (parse_seconds_value(value, MIN_WAIT, MAX_INTERVAL * 24,
+                              &opts->deadline) < 0) {
+        fprintf(stderr, "ft_ping: invalid deadline (`%s')\n", value);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-W", 2) == 0) {
+      const char *value = option_value(argc, argv, &i);
+      if (!value) {
+        return -1;
+      }
+      if (parse_seconds_value(value, MIN_WAIT, MAX_INTERVAL, &opts->linger) <
+          0) {
+        fprintf(stderr, "ft_ping: invalid timeout (`%s')\n", value);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-l", 2) == 0) {
+      const char *value = option_value(argc, argv, &i);
+      if (!value) {
+        return -1;
+      }
+      if (parse_int_value(value, 1, MAX_PRELOAD, &opts->preload) < 0) {
+        fprintf(stderr, "ft_ping: invalid preload value (`%s')\n", value);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-s", 2) == 0) {
+      const char *value = option_value(argc, argv, &i);
+      if (!value) {
+        return -1;
+      }
+      if (parse_int_value(value, 0, PING_MAX_DATA_SIZE, &opts->data_size) <
+          0) {
+        fprintf(stderr, "ft_ping: invalid packet size (`%s')\n", value);
+        return -2;
+      }
+      continue;
+    }
+
+    if (strncmp(argv[i], "-i", 2) == 0) {
+      const char *value = option_value(argc, argv, &i);
+      if (!value) {
+        return -1;
+      }
+      if (parse_seconds_value(value, PING_MIN_INTERVAL, MAX_INTERVAL,
+                              &opts->interval) < 0) {
+        fprintf(stderr, "ft_ping: invalid interval value (`%s')\n", value);
+        return -2;
+      }
       continue;
     }
 
@@ -33,25 +384,25 @@ int parse_ping_args(int argc, char **argv, char *hostname_out, int *show_help,
       return -1;
     }
 
-    if (hostname_index == -1) {
-      hostname_index = i;
-    } else {
+    size_t len = strlen(argv[i]);
+    if (len == 0 || len > MAX_HOSTNAME_LEN) {
       return -1;
     }
+    opts->hosts[opts->host_count++] = argv[i];
   }
 
-  if (hostname_index == -1) {
+  // キャプチャの再生では宛先をキャプチャから得るので、宛先の指定はいらない
+  if (opts->host_count == 0 && !opts->targets_file && !opts->replay) {
     return -1;
   }
 
-  if (hostname_out) {
-    size_t len = strlen(argv[hostname_index]);
-    if (len == 0 || len > MAX_HOSTNAME_LEN) {
-      return -1;
-    }
-    strncpy(hostname_out, argv[hostname_index], MAX_HOSTNAME_LEN);
-    hostname_out[MAX_HOSTNAME_LEN - 1] = '\0';
-  }
-
   return 0;
 }
+
+void free_ping_args(PingOptions *opts) {
+  if (opts) {
+    free(opts->hosts);
+    opts->hosts = NULL;
+    opts->host_count = 0;
+  }
+}
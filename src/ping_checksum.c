@@ -0,0 +1,214 @@
+#include "ping_checksum.h"
+
+#include <string.h>
+
+#ifdef PING_CHECKSUM_HAVE_SIMD
+#include <immintrin.h>
+#endif
+
+// ping_checksum.c: ICMPチェックサムの計算を担当するファイル
+// パケット全体からの計算と、一部のフィールドだけを書き換えた場合の
+// 差分更新(RFC1624)を行う
+//
+// 1の補数和はワードの並び順や桁上がりのまとめ方に依存しないため、
+// 32ビットや128/256ビット単位で加算しておき、最後に16ビットへ畳み込んでも
+// 16ビット単位で加算した結果と一致する。大きなペイロード(-s)向けに
+// 幅の広いワード・SIMDで加算する実装を用意し、CPUに合わせて選択する
+
+// 64ビットの部分和を16ビットに畳み込み、1の補数を返す
+static unsigned short fold_checksum(uint64_t sum) {
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (unsigned short)~sum;
+}
+
+// 末尾の奇数バイトは0のバイトを補ったワードとして加算する
+static uint32_t odd_byte_word(const unsigned char *p) {
+  uint16_t word = 0;
+  memcpy(&word, p, 1);
+  return word;
+}
+
+unsigned short ping_checksum_scalar(const void *b, int len) {
+  // ICMPパケットのチェックサム計算
+  // RFC792: The checksum is the 16-bit ones's complement of the one's
+  // complement sum of the ICMP message starting with the ICMP Type.
+  const unsigned char *buf = b;
+  uint64_t sum = 0;
+
+  // 16ビット単位で加算
+  while (len > 1) {
+    uint16_t word;
+    memcpy(&word, buf, sizeof(word));
+    sum += word;
+    buf += 2;
+    len -= 2;
+  }
+
+  // 奇数バイトの場合、最後の1バイトを処理
+  if (len == 1) {
+    sum += odd_byte_word(buf);
+  }
+
+  // キャリーを加算し、1の補数を取得
+  return fold_checksum(sum);
+}
+
+unsigned short ping_checksum_wide(const void *b, int len) {
+  // 8バイトずつ読み、上位・下位32ビットを64ビットの部分和に加算する
+  const unsigned char *buf = b;
+  uint64_t sum = 0;
+
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, buf, sizeof(word));
+    sum += (word & 0xFFFFFFFFu) + (word >> 32);
+    buf += 8;
+    len -= 8;
+  }
+  while (len > 1) {
+    uint16_t word;
+    memcpy(&word, buf, sizeof(word));
+    sum += word;
+    buf += 2;
+    len -= 2;
+  }
+  if (len == 1) {
+    sum += odd_byte_word(buf);
+  }
+  return fold_checksum(sum);
+}
+
+#ifdef PING_CHECKSUM_HAVE_SIMD
+// 各32ビットレーンには1回あたり最大0xFFFFしか加算しないため、
+// 65536回(SSE2で1MB)までは桁あふれしない。ICMPの最大長は64KB未満
+
+__attribute__((target("sse2"))) unsigned short
+ping_checksum_sse2(const void *b, int len) {
+  const unsigned char *buf = b;
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = _mm_setzero_si128();
+  uint64_t sum = 0;
+
+  while (len >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)buf);
+    acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+    acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+    buf += 16;
+    len -= 16;
+  }
+
+  uint32_t lanes[4];
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  sum = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+  while (len > 1) {
+    uint16_t word;
+    memcpy(&word, buf, sizeof(word));
+    sum += word;
+    buf += 2;
+    len -= 2;
+  }
+  if (len == 1) {
+    sum += odd_byte_word(buf);
+  }
+  return fold_checksum(sum);
+}
+
+__attribute__((target("avx2"))) unsigned short
+ping_checksum_avx2(const void *b, int len) {
+  const unsigned char *buf = b;
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = _mm256_setzero_si256();
+  uint64_t sum = 0;
+
+  while (len >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+    acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+    acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+    buf += 32;
+    len -= 32;
+  }
+
+  uint32_t lanes[8];
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  for (int i = 0; i < 8; i++) {
+    sum += lanes[i];
+  }
+
+  while (len > 1) {
+    uint16_t word;
+    memcpy(&word, buf, sizeof(word));
+    sum += word;
+    buf += 2;
+    len -= 2;
+  }
+  if (len == 1) {
+    sum += odd_byte_word(buf);
+  }
+  return fold_checksum(sum);
+}
+
+int ping_checksum_avx2_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+typedef unsigned short (*checksum_func)(const void *b, int len);
+
+// 初回呼び出し時にCPUの機能を調べて実装を選ぶ
+static checksum_func select_checksum(void) {
+#ifdef PING_CHECKSUM_HAVE_SIMD
+  if (ping_checksum_avx2_supported()) {
+    return ping_checksum_avx2;
+  }
+  return ping_checksum_sse2;
+#else
+  return ping_checksum_wide;
+#endif
+}
+
+unsigned short ping_checksum(void *b, int len) {
+  static checksum_func impl = NULL;
+
+  // 小さいパケットでは準備の手間の方が大きいので8バイト単位で足りる
+  if (len < 64) {
+    return ping_checksum_wide(b, len);
+  }
+  // --threadsでは複数のワーカーが同時に初回呼び出しをするので、
+  // 選んだ実装はアトミックに読み書きする
+  // どのスレッドが選んでも同じ関数になり、関数ポインタ以外に公開するデータは
+  // ないため、順序を保証しない読み書き(RELAXED)で足りる
+  checksum_func f = __atomic_load_n(&impl, __ATOMIC_RELAXED);
+  if (!f) {
+    f = select_checksum();
+    __atomic_store_n(&impl, f, __ATOMIC_RELAXED);
+  }
+  return f(b, len);
+}
+
+uint16_t ping_checksum_update(uint16_t checksum, const void *old_data,
+                              const void *new_data, size_t len) {
+  // RFC1624 式3: HC' = ~(~HC + ~m + m')
+  // 書き換えた16ビットワードごとに旧値の補数と新値を加算する
+  // lenは偶数バイトで、old_data/new_dataはパケット内と同じ位置合わせとする
+  const unsigned char *old_bytes = old_data;
+  const unsigned char *new_bytes = new_data;
+  uint32_t sum = (uint16_t)~checksum;
+
+  for (size_t i = 0; i + 1 < len; i += 2) {
+    uint16_t old_word;
+    uint16_t new_word;
+    memcpy(&old_word, old_bytes + i, sizeof(old_word));
+    memcpy(&new_word, new_bytes + i, sizeof(new_word));
+    sum += (uint16_t)~old_word;
+    sum += new_word;
+  }
+
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (uint16_t)~sum;
+}
@@ -0,0 +1,604 @@
+#include "ping_engine.h"
+#include "ping_filter.h"
+#include "ping_output.h"
+#include "ping_packet.h"
+#include "ping_profile.h"
+#include "ping_record.h"
+#include "ping_resolver.h"
+#include "ping_rx.h"
+#include "ping_sched.h"
+#include "ping_shared.h"
+#include "ping_stats.h"
+#include "ping_summary.h"
+#include "ping_sweep.h"
+#include "ping_target.h"
+#include "ping_tx.h"
+#include "ping_uring.h"
+#include "ping_wheel.h"
+#include "ping_window.h"
+
+#include <errno.h>
+#include <linux/net_tstamp.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// ping_engine.c:
+// 1つのソケットで送受信するpingエンジン（PingContext）の生成・実行・解放を担当するファイル
+// 単一スレッドではmainから1つ、スレッド分割時はワーカーごとに1つ使う
+
+int initialize_context(PingContext *ctx) {
+  if (!ctx) {
+    return -1;
+  }
+
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->packets_duplicate = 0;
+  ctx->ping_running = 1;
+  ctx->sock_fd = -1;
+  ctx->verbose_mode = 0;
+  ctx->flood_mode = 0;
+  ctx->preload = 1;
+  ctx->linger = PING_DEFAULT_LINGER;
+  ctx->data_size = ICMP_DATA_SIZE;
+  ctx->sched.timer_fd = -1;
+  ctx->worker_id = -1;
+  ctx->stop_fd = -1;
+  ctx->report_fd = -1;
+  ctx->report_timer_fd = -1;
+  ctx->epoll_fd = -1;
+  // 識別子はコンテキストごとに変え、同じプロセスの複数のコンテキストが応答を取り合わないようにする
+  // 最初のコンテキストはプロセスIDの下位16ビット（データグラムソケットではカーネルが割り当て直す）
+  static unsigned int contexts = 0;
+  unsigned int n = __atomic_fetch_add(&contexts, 1, __ATOMIC_RELAXED);
+  ctx->ident = (getpid() + n) & 0xFFFF;
+  
+  // 送信記録のリングは最小の大きさで確保し、setup_engineで送信レートに合わせて広げる
+  // 送信中には拡張しない
+  if (create_seq_window(&ctx->window, PING_SEQ_WINDOW) < 0) {
+    return -1;
+  }
+  
+  return 0;
+}
+
+// カーネルの送受信タイムスタンプを有効にする
+// SO_TIMESTAMPINGが使えない場合は受信時刻だけSO_TIMESTAMPNSで取得する
+static void enable_kernel_timestamps(PingContext *ctx) {
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+              SOF_TIMESTAMPING_SOFTWARE;
+  if (setsockopt(ctx->sock_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                 sizeof(flags)) == 0) {
+    return;
+  }
+
+  int on = 1;
+  if (setsockopt(ctx->sock_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) ==
+      0) {
+    return;
+  }
+
+  perror("ft_ping: kernel timestamps unavailable");
+  ctx->kernel_timestamps = 0;
+}
+
+// ICMPデータグラムソケットを開く
+// 識別子はカーネルが割り当ててソケットごとに振り分けるので、割り当てられた値をidentにする
+static int open_dgram_socket(PingContext *ctx) {
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  int on = 1;
+
+  ctx->sock_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+  if (ctx->sock_fd < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  if (bind(ctx->sock_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      getsockname(ctx->sock_fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+    close(ctx->sock_fd);
+    ctx->sock_fd = -1;
+    return -1;
+  }
+  ctx->ident = ntohs(addr.sin_port);
+  // IPヘッダを受け取らないので、TTLは制御メッセージで受け取る
+  if (setsockopt(ctx->sock_fd, IPPROTO_IP, IP_RECVTTL, &on, sizeof(on)) < 0) {
+    perror("ft_ping: IP_RECVTTL failed");
+  }
+  ctx->socket_type = PING_SOCKET_DGRAM;
+  return 0;
+}
+
+static int create_socket(PingContext *ctx) {
+  if (ctx->socket_type != PING_SOCKET_DGRAM) {
+    ctx->sock_fd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+    if (ctx->sock_fd < 0 && (ctx->socket_type == PING_SOCKET_RAW ||
+                             (errno != EPERM && errno != EACCES))) {
+      perror("socket creation failed");
+      printf("Note: This program must be run as root\n");
+      return -1;
+    }
+  }
+  if (ctx->sock_fd >= 0) {
+    ctx->socket_type = PING_SOCKET_RAW;
+    // 他のプロセス宛てのICMPはカーネル内で捨てる
+    // フィルタを付けられなくてもprocess_replyで識別子を確認するので続行する
+    if (!ctx->no_filter) {
+      attach_icmp_filter(ctx->sock_fd, ctx->ident);
+    }
+  } else if (open_dgram_socket(ctx) < 0) {
+    // RAWソケットを使えない場合は権限不要のデータグラムソケットを使う
+    perror("socket creation failed");
+    printf("Note: This program must be run as root, or the group must be "
+           "allowed by net.ipv4.ping_group_range\n");
+    return -1;
+  }
+  if (ctx->kernel_timestamps) {
+    enable_kernel_timestamps(ctx);
+  }
+  return 0;
+}
+
+// -cの上限までに送信できる残りの数（上限がなければLLONG_MAX）
+// -cはINT_MAXまで受け付けるので、宛先数・--sweepのサイズの数を掛けた上限は64ビットで数える
+static long long probes_left(const PingContext *ctx) {
+  if (ctx->count <= 0) {
+    return LLONG_MAX;
+  }
+  long long limit = sweep_probe_limit(ctx) * ctx->target_count;
+  long long queued = ctx->packets_sent + ctx->tx.pending + ctx->send_errors;
+  return queued < limit ? limit - queued : 0;
+}
+
+// 送信の失敗で送受信ループを終えるか
+// 送信バッファが一杯なだけなら、次の送信期限に送り直す
+// 経路がない・ファイアウォールで拒否されたなどは宛先ごとのエラーなので、
+// 宛先が複数あればほかの宛先への送信を続ける
+static int send_error_is_fatal(const PingContext *ctx, int err) {
+  switch (err) {
+  case ENOBUFS:
+  case EAGAIN:
+  case EINTR:
+    return 0;
+  default:
+    return !send_error_is_per_target(err) || ctx->target_count <= 1;
+  }
+}
+
+// 送信期限に達したパケットをまとめて送信し、次の送信期限をタイマーに設定する
+// 戻り値: 0=成功, -1=送信を続けられないエラー
+static int send_due_pings(PingContext *ctx) {
+  PingScheduler *sched = &ctx->sched;
+  struct timespec now;
+  int burst = 0;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+    perror("clock_gettime failed");
+    return -1;
+  }
+
+  if (ctx->flood_mode) {
+    // 応答待ちのパケットがpreload未満なら応答到着を待たずに送信する
+    // 応答待ちは応答待ちタイマーの数で数えるので、-Wでタイムアウトした送信は外れる
+    // （応答しない宛先があっても、失った数がpreloadを超えた後に送信が止まらない）
+    // 応答が途絶えた場合もPING_FLOOD_TIMEOUT経過で次を送信する
+    struct timespec flood_timeout;
+    timespec_from_seconds(&flood_timeout, PING_FLOOD_TIMEOUT);
+    while (probes_left(ctx) > 0 &&
+           (ctx->wheel.count + ctx->tx.pending < ctx->preload ||
+            timespec_cmp(&now, &sched->next_deadline) >= 0)) {
+      PING_PROF_BEGIN(ctx, queue_start);
+      int queued = queue_ping(ctx, &now);
+      PING_PROF_END(ctx, PING_PROF_QUEUE, queue_start, 1);
+      if (queued < 0) {
+        // 溜めたパケットの送信に失敗した（続けられるエラーなら次の期限に送り直す）
+        if (send_error_is_fatal(ctx, errno)) {
+          return -1;
+        }
+        break;
+      }
+      sched->next_deadline = now;
+      timespec_add(&sched->next_deadline, &flood_timeout);
+      if (++burst >= PING_MAX_BURST) {
+        break;
+      }
+    }
+  } else {
+    while (probes_left(ctx) > 0 &&
+           timespec_cmp(&now, &sched->next_deadline) >= 0) {
+      if (burst >= PING_MAX_BURST) {
+        // 追いつけないほど遅れた場合は、遅れを取り戻さず現在時刻から再開する
+        sched->next_deadline = now;
+        timespec_add(&sched->next_deadline, &sched->interval);
+        break;
+      }
+      record_send_jitter(sched, &now);
+      PING_PROF_BEGIN(ctx, queue_start);
+      int queued = queue_ping(ctx, &now);
+      PING_PROF_END(ctx, PING_PROF_QUEUE, queue_start, 1);
+      if (queued < 0) {
+        // 溜めたパケットの送信に失敗した（続けられるエラーなら次の期限に送り直す）
+        if (send_error_is_fatal(ctx, errno)) {
+          return -1;
+        }
+        break;
+      }
+      // 期限は前回の期限を基準に進めるので、送信処理の遅れが累積しない
+      timespec_add(&sched->next_deadline, &sched->interval);
+      burst++;
+      if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+        perror("clock_gettime failed");
+        return -1;
+      }
+    }
+  }
+
+  if (burst == 0) {
+    return 0;
+  }
+  // 溜めたパケットは1回のsendmmsg（--io-uringでは1回のio_uring_enter）で送信する
+  // 送信できなかったパケットは送信数に数えず、応答待ちにもしない
+  if (flush_pings(ctx) < 0 && send_error_is_fatal(ctx, errno)) {
+    return -1;
+  }
+  return arm_scheduler(sched, &sched->next_deadline);
+}
+
+// -c/-wによる終了条件を満たしたか
+// -cでは全て送信し、全ての送信が応答を受けるかタイムアウトしたら終わる
+// 解決中の宛先があれば、その宛先への送信もまだ残っている
+static int run_finished(const PingContext *ctx, unsigned long long now_ms) {
+  if (ctx->deadline > 0.0 && now_ms >= ctx->end_ms) {
+    return 1;
+  }
+  return ctx->count > 0 && probes_left(ctx) == 0 && ctx->tx.pending == 0 &&
+         ctx->wheel.count == 0 && resolver_pending(ctx->resolver) == 0;
+}
+
+int ping_loop_timeout_ms(const PingContext *ctx) {
+  // 出力の書き出し・応答待ちの満了・-wの期限のうち最も早いもの
+  // 送信期限はtimerfdとしてepollに登録してあるので含めない
+  struct timespec now;
+  long timeout = output_timeout_ms(&ctx->out);
+  long next = timer_wheel_next(&ctx->wheel);
+
+  // 送信の完了を待つ間に取り出した受信が残っていれば、待たずに処理する
+  if (ctx->uring && uring_ready(ctx->uring)) {
+    return 0;
+  }
+
+  if (next >= 0 && (timeout < 0 || next < timeout)) {
+    timeout = next;
+  }
+  if (ctx->deadline > 0.0 && clock_gettime(CLOCK_MONOTONIC, &now) == 0) {
+    unsigned long long now_ms = timespec_to_ms(&now);
+    long remaining = now_ms < ctx->end_ms ? (long)(ctx->end_ms - now_ms) : 0;
+    if (timeout < 0 || remaining < timeout) {
+      timeout = remaining;
+    }
+  }
+  return timeout > INT_MAX ? INT_MAX : (int)timeout;
+}
+
+int start_ping_loop(PingContext *ctx) {
+  struct epoll_event ev;
+  struct timespec current_time;
+
+  // ソケット・送信タイマー・通知用のfdを1つのepollにまとめ、
+  // 呼び出し側のイベントループにはそのepollだけを登録してもらう
+  ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (ctx->epoll_fd < 0) {
+    perror("epoll_create1 failed");
+    return -1;
+  }
+  // io_uringではソケットの代わりに、完了キューに受信が届くと読めるようになるリングを待つ
+  int rx_fd = ctx->uring ? ctx->uring->ring_fd : ctx->sock_fd;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = rx_fd;
+  if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, rx_fd, &ev) < 0) {
+    perror("epoll_ctl failed");
+    return -1;
+  }
+  ev.data.fd = ctx->sched.timer_fd;
+  if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, ctx->sched.timer_fd, &ev) < 0) {
+    perror("epoll_ctl failed");
+    return -1;
+  }
+  // スレッド分割時は停止通知とレポート要求のeventfd、
+  // 単一スレッドでは定期レポートのtimerfdと名前解決の完了通知も待ち受ける
+  int resolver_fd = ctx->resolver ? ctx->resolver->event_fd : -1;
+  int optional_fds[4] = {ctx->stop_fd, ctx->report_fd, ctx->report_timer_fd,
+                         resolver_fd};
+  for (int i = 0; i < 4; i++) {
+    ev.data.fd = optional_fds[i];
+    if (optional_fds[i] >= 0 &&
+        epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, optional_fds[i], &ev) < 0) {
+      perror("epoll_ctl failed");
+      return -1;
+    }
+  }
+
+  if (clock_gettime(CLOCK_MONOTONIC, &current_time) != 0) {
+    perror("clock_gettime failed");
+    return -1;
+  }
+  ctx->start_time = current_time;
+  ctx->end_ms = timespec_to_ms(&current_time) +
+                (unsigned long long)(ctx->deadline * 1000.0);
+
+  // preload分は応答を待たずに連続送信し、その後は送信期限に従う
+  for (int i = 1; i < ctx->preload && !ctx->flood_mode && probes_left(ctx) > 1;
+       i++) {
+    queue_ping(ctx, &current_time);
+  }
+  ctx->sched.next_deadline = current_time;
+  return send_due_pings(ctx);
+}
+
+void stop_ping_loop(PingContext *ctx) {
+  // 統計の表示より前に、ためている受信結果を書き出す
+  ctx->ping_running = 0;
+  flush_output(&ctx->out);
+}
+
+int step_ping_loop(PingContext *ctx, int timeout_ms) {
+  struct epoll_event events[6];
+  struct timespec current_time;
+  int received = 0;
+
+  if (!ctx->ping_running) {
+    stop_ping_loop(ctx);
+    return 0;
+  }
+  // 出力バッファの書き出し、応答待ちの満了、-wの期限のいずれかで起床する
+  PING_PROF_BEGIN(ctx, wait_start);
+  int nfds = epoll_wait(ctx->epoll_fd, events, 6, timeout_ms);
+  PING_PROF_END(ctx, PING_PROF_WAIT, wait_start, nfds > 0 ? nfds : 0);
+  if (nfds < 0) {
+    if (errno == EINTR) {
+      // シグナルで中断された場合は、呼び出し側に終了や統計表示の要求を確認させる
+      return 1;
+    }
+    perror("epoll_wait error");
+    return -1;
+  }
+
+  for (int i = 0; i < nfds; i++) {
+    int fd = events[i].data.fd;
+    if (fd == ctx->sock_fd || (ctx->uring && fd == ctx->uring->ring_fd)) {
+      // 受信エラーはreceive_ping内で報告済み
+      receive_ping(ctx);
+      received = 1;
+    } else if (fd == ctx->sched.timer_fd) {
+      uint64_t expirations;
+      // 満了回数を読み捨ててtimerfdの通知をクリアする
+      if (read(ctx->sched.timer_fd, &expirations, sizeof(expirations)) < 0 &&
+          errno != EAGAIN) {
+        perror("timerfd read failed");
+      }
+    } else if (fd == ctx->stop_fd) {
+      ctx->ping_running = 0;
+    } else if (fd == ctx->report_timer_fd) {
+      uint64_t expirations;
+      if (read(ctx->report_timer_fd, &expirations, sizeof(expirations)) > 0) {
+        flush_output(&ctx->out);
+        print_interval_report(ctx);
+        reset_interval_stats(&ctx->interval);
+      }
+    } else if (ctx->resolver && fd == ctx->resolver->event_fd) {
+      // 宛先が増えても各宛先への送信間隔が-iのままになるよう、全体の送信間隔を縮める
+      if (collect_targets(ctx) > 0) {
+        set_scheduler_interval(&ctx->sched,
+                               ctx->target_interval / ctx->target_count);
+      }
+    } else if (fd == ctx->report_fd) {
+      uint64_t request;
+      if (read(ctx->report_fd, &request, sizeof(request)) > 0 &&
+          ctx->on_report) {
+        ctx->on_report(ctx, request);
+      }
+    }
+  }
+  if (!received && ctx->uring && uring_ready(ctx->uring)) {
+    receive_ping(ctx);
+  }
+  if (!ctx->ping_running) {
+    stop_ping_loop(ctx);
+    return 0;
+  }
+
+  // 応答がないまま待ち時間を過ぎた送信は、その場で失ったものとして知らせる
+  if (clock_gettime(CLOCK_MONOTONIC, &current_time) != 0) {
+    perror("clock_gettime failed");
+    return -1;
+  }
+  PING_PROF_BEGIN(ctx, expire_start);
+  int expired = expire_probes(ctx, &current_time);
+  PING_PROF_END(ctx, PING_PROF_EXPIRE, expire_start, expired);
+
+  // 受信が続いても送信が遅れないよう、起床のたびに送信期限を確認する
+  if (send_due_pings(ctx) < 0) {
+    return -1;
+  }
+  PING_PROF_BEGIN(ctx, output_start);
+  if (flush_output_if_due(&ctx->out) > 0) {
+    PING_PROF_END(ctx, PING_PROF_OUTPUT, output_start, 1);
+  }
+  if (ctx->shared) {
+    publish_shared_stats_if_due(ctx, &current_time);
+  }
+  if (run_finished(ctx, timespec_to_ms(&current_time))) {
+    stop_ping_loop(ctx);
+    return 0;
+  }
+  return 1;
+}
+
+int run_ping_loop(PingContext *ctx) {
+  if (start_ping_loop(ctx) < 0) {
+    return -1;
+  }
+  int ret;
+  while ((ret = step_ping_loop(ctx, ping_loop_timeout_ms(ctx))) > 0) {
+  }
+  return ret < 0 ? -1 : 0;
+}
+
+// --io-uring: 使えない環境ではメッセージを出してsendmmsg/recvmmsgのまま続ける
+// スレッド分割時のメッセージは最初のワーカーだけが出す
+static void setup_uring(PingContext *ctx) {
+  // カーネルの送信タイムスタンプはエラーキューをrecvmmsgで読むので、io_uringは使わない
+  if (ctx->kernel_timestamps) {
+    if (ctx->worker_id <= 0) {
+      fprintf(stderr, "ft_ping: --io-uring is not used with "
+                      "--kernel-timestamps\n");
+    }
+    ctx->io_uring = 0;
+    return;
+  }
+  ctx->uring = open_uring(ctx->sock_fd, ctx->rx.buffer_size);
+  if (!ctx->uring) {
+    if (ctx->worker_id <= 0) {
+      fprintf(stderr, "ft_ping: io_uring unavailable (%s), using "
+                      "sendmmsg/recvmmsg\n",
+              strerror(errno));
+    }
+    ctx->io_uring = 0;
+  }
+}
+
+// 応答待ちになりうる送信数に合わせて送信記録のリングを確保し直す
+// 応答待ちの送信のスロットを上書きすると、その送信を-Wより前に失ったとみなしてしまう
+// 1つの識別子で区別できるシーケンス番号(16ビット)より多くなる場合は始めない
+static int size_seq_window(PingContext *ctx, double interval) {
+  // 解決中の宛先も、解決後に同じ間隔で送る
+  long long targets = ctx->target_count + resolver_pending(ctx->resolver);
+  double in_flight = PING_SEQ_WINDOW_MAX + 1.0;
+  if (ctx->flood_mode) {
+    // preload個まで応答を待たずに送り、応答が途絶えてもPING_FLOOD_TIMEOUTごとに1つ送る
+    in_flight = ctx->preload + ctx->linger / PING_FLOOD_TIMEOUT;
+  } else if (interval > 0.0) {
+    // 全体の送信間隔は宛先の数で割った間隔
+    in_flight = ctx->preload + ctx->linger * targets / interval;
+  }
+  // 送信バッファに溜めている分も送信番号を使う
+  in_flight += PING_TX_BATCH;
+  // -cでは全体の送信数より多くは応答を待たない
+  long long limit = sweep_probe_limit(ctx) * targets;
+  if (limit > 0 && in_flight > limit) {
+    in_flight = limit;
+  }
+
+  int size = seq_window_size(in_flight > PING_SEQ_WINDOW_MAX
+                                 ? PING_SEQ_WINDOW_MAX + 1LL
+                                 : (long long)in_flight + 1);
+  if (size < 0) {
+    fprintf(stderr, "ft_ping: about %.0f probes would await replies within "
+                    "-W %g s, more than the %d sequence numbers of one "
+                    "identifier; use a longer -i, a shorter -W or --threads\n",
+            in_flight, ctx->linger, PING_SEQ_WINDOW_MAX);
+    return -1;
+  }
+  if (size != ctx->window.size) {
+    free_seq_window(&ctx->window);
+    if (create_seq_window(&ctx->window, size) < 0) {
+      fprintf(stderr, "ft_ping: failed to allocate the probe window\n");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int setup_engine(PingContext *ctx, double interval) {
+  if (size_seq_window(ctx, interval) < 0) {
+    return -1;
+  }
+  // データグラムソケットでは識別子が決まるので、パケットの組み立てより先に開く
+  if (create_socket(ctx) < 0) {
+    return -1;
+  }
+  ctx->target_interval = interval;
+  if (init_scheduler(&ctx->sched, interval / ctx->target_count) < 0) {
+    return -1;
+  }
+  if (init_tx_engine(&ctx->tx, ctx->ident, ICMP_HDRLEN + ctx->data_size) < 0) {
+    fprintf(stderr, "ft_ping: failed to initialize transmit buffers\n");
+    return -1;
+  }
+  if (init_rx_engine(&ctx->rx,
+                     PING_MAX_IPHDR_LEN + ICMP_HDRLEN + ctx->data_size) < 0) {
+    fprintf(stderr, "ft_ping: failed to initialize receive buffers\n");
+    return -1;
+  }
+  if (ctx->io_uring) {
+    setup_uring(ctx);
+  }
+  if (init_output(&ctx->out, STDOUT_FILENO) < 0) {
+    fprintf(stderr, "ft_ping: failed to initialize output buffer\n");
+    return -1;
+  }
+  // 応答待ちのタイマーは送信記録のスロットと1対1に対応させる
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (init_timer_wheel(&ctx->wheel, ctx->window.size, timespec_to_ms(&now)) < 0) {
+    fprintf(stderr, "ft_ping: failed to initialize probe timers\n");
+    return -1;
+  }
+  // 記録ファイルの送信時刻はCLOCK_MONOTONICなので、UNIX時刻との差をヘッダに残す
+  struct timespec wall;
+  clock_gettime(CLOCK_REALTIME, &wall);
+  if (start_recording(ctx, (wall.tv_sec - now.tv_sec) * 1000000000LL +
+                               (wall.tv_nsec - now.tv_nsec)) < 0) {
+    return -1;
+  }
+  if (open_shared_stats(ctx) < 0) {
+    return -1;
+  }
+  if (ctx->profile && open_profile(ctx) < 0) {
+    return -1;
+  }
+  // スレッド分割時はメインスレッドがレポートの時刻を決めるので、ワーカーにはタイマーを作らない
+  if (ctx->report_interval > 0 && ctx->worker_id < 0) {
+    ctx->report_timer_fd = create_report_timer(ctx->report_interval);
+    if (ctx->report_timer_fd < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void cleanup_context(PingContext *ctx) {
+  if (ctx) {
+    if (ctx->epoll_fd >= 0) {
+      close(ctx->epoll_fd);
+      ctx->epoll_fd = -1;
+    }
+    close_uring(ctx->uring);
+    ctx->uring = NULL;
+    if (ctx->sock_fd >= 0) {
+      close(ctx->sock_fd);
+      ctx->sock_fd = -1;
+    }
+    close_scheduler(&ctx->sched);
+    if (ctx->report_timer_fd >= 0) {
+      close(ctx->report_timer_fd);
+      ctx->report_timer_fd = -1;
+    }
+    close_output(&ctx->out);
+    close_resolver(ctx->resolver);
+    ctx->resolver = NULL;
+    // 応答待ちの送信を記録に残してから、タイマーホイールを解放する
+    stop_recording(ctx);
+    close_shared_stats(ctx);
+    close_timer_wheel(&ctx->wheel);
+    close_tx_engine(&ctx->tx);
+    close_rx_engine(&ctx->rx);
+    close_profile(ctx);
+    
+    // 動的メモリを解放
+    free_seq_window(&ctx->window);
+    free_targets(ctx);
+  }
+}
@@ -0,0 +1,56 @@
+#include "ping_filter.h"
+
+#include <linux/filter.h>
+#include <netinet/ip_icmp.h>
+
+// ping_filter.c:
+// RAWソケットに付けるclassic BPFフィルタを担当するファイル
+// RAWのICMPソケットはホストに届く全てのICMPの複製を受け取るため、
+// 他のpingプロセス宛ての応答をカーネル内で捨ててユーザ空間に上げないようにする
+
+// 受信パケットはIPヘッダから始まるので、ICMPヘッダの位置はXレジスタに持つ
+int attach_icmp_filter(int sock_fd, int ident) {
+  struct sock_filter code[] = {
+      // X = 外側IPヘッダ長
+      BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+      // A = ICMP Type
+      BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, 0, 2),
+      // Echo Reply: A = Identifier
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)ident, 15, 16),
+      // 元パケットを引用するICMPエラーか
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_DEST_UNREACH, 4, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_SOURCE_QUENCH, 3, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_REDIRECT, 2, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIME_EXCEEDED, 1, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_PARAMETERPROB, 0, 11),
+      // X = 外側IPヘッダ長 + ICMPヘッダ(8) + 引用されたIPヘッダ長
+      BPF_STMT(BPF_LD | BPF_B | BPF_IND, ICMP_HDRLEN),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0F),
+      BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 2),
+      BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+      BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, ICMP_HDRLEN),
+      BPF_STMT(BPF_MISC | BPF_TAX, 0),
+      // 引用されたのが自分のEcho Requestか
+      BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHO, 0, 3),
+      BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)ident, 0, 1),
+      // 受理（パケット全体を渡す）
+      BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+      // 破棄
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  };
+  struct sock_fprog prog = {
+      .len = sizeof(code) / sizeof(code[0]),
+      .filter = code,
+  };
+
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) <
+      0) {
+    perror("ft_ping: SO_ATTACH_FILTER failed");
+    return -1;
+  }
+  return 0;
+}
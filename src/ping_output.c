@@ -0,0 +1,296 @@
+#include "ping_output.h"
+
+#include <errno.h>
+#include <stdarg.h>
+
+// ping_output.c: 受信結果の出力を担当するファイル
+// 応答ごとにprintfすると、端末では行ごとにwriteが発生し、floodや多数の宛先では
+// 出力が送受信より遅くなる。行を自前のバッファに整形してためておき、
+// バッファが埋まるか、前回の書き出しからPING_OUTPUT_FLUSH_MS経ったときにまとめて書き出す
+// 応答がまばらなとき（前回の書き出しから十分経っているとき）は1行ずつすぐに書き出す
+
+// 1行の最大長（アドレス・数値を全て最大桁で書いても収まる長さ）
+#define OUTPUT_LINE_MAX 160
+// エスケープで1文字が広がる最大の倍率（JSONの\u00XX）
+#define OUTPUT_ESCAPE_MAX 6
+
+static long elapsed_ms(const struct timespec *from, const struct timespec *to) {
+  return (to->tv_sec - from->tv_sec) * 1000L +
+         (to->tv_nsec - from->tv_nsec) / 1000000L;
+}
+
+int init_output(PingOutput *out, int fd) {
+  out->fd = fd;
+  out->len = 0;
+  out->cap = PING_OUTPUT_BUFSIZE;
+  out->buf = malloc(out->cap);
+  if (!out->buf) {
+    out->cap = 0;
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &out->last_flush);
+  return 0;
+}
+
+int flush_output(PingOutput *out) {
+  if (!out->buf) {
+    return 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &out->last_flush);
+  if (out->len == 0) {
+    return 0;
+  }
+
+  // ヘッダなどstdioで出力した行より後ろに出るよう、先にstdioを書き出す
+  fflush(stdout);
+  size_t done = 0;
+  while (done < out->len) {
+    ssize_t n = write(out->fd, out->buf + done, out->len - done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("ft_ping: write failed");
+      out->len = 0;
+      return -1;
+    }
+    done += (size_t)n;
+  }
+  out->len = 0;
+  return 0;
+}
+
+int flush_output_if_due(PingOutput *out) {
+  struct timespec now;
+
+  if (out->len == 0) {
+    return 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (elapsed_ms(&out->last_flush, &now) < PING_OUTPUT_FLUSH_MS) {
+    return 0;
+  }
+  return flush_output(out) < 0 ? -1 : 1;
+}
+
+int output_timeout_ms(const PingOutput *out) {
+  struct timespec now;
+
+  if (out->len == 0) {
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long remaining = PING_OUTPUT_FLUSH_MS - elapsed_ms(&out->last_flush, &now);
+  return remaining > 0 ? (int)remaining : 0;
+}
+
+void close_output(PingOutput *out) {
+  flush_output(out);
+  free(out->buf);
+  out->buf = NULL;
+  out->cap = 0;
+}
+
+// 1行分（固定部分とextraバイト）の空きを確保し、書き込み位置を返す
+// 空きが足りなければそれまでの行を書き出すので、行の途中で書き出すことはない
+static char *output_reserve(PingOutput *out, size_t extra) {
+  if (out->len + OUTPUT_LINE_MAX + extra > out->cap) {
+    flush_output(out);
+  }
+  return out->buf + out->len;
+}
+
+// 1行書き終えたら、しきい値を過ぎていれば書き出す
+static void output_commit(PingOutput *out, char *end) {
+  out->len = (size_t)(end - out->buf);
+  flush_output_if_due(out);
+}
+
+static char *put_str(char *p, const char *s, size_t len) {
+  memcpy(p, s, len);
+  return p + len;
+}
+
+#define PUT_LITERAL(p, s) put_str((p), (s), sizeof(s) - 1)
+
+// JSONの文字列の中身として書く（"と\\と制御文字をエスケープする）
+static char *put_json_str(char *p, const char *s, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c == '"' || c == '\\') {
+      *p++ = '\\';
+      *p++ = (char)c;
+    } else if (c < 0x20) {
+      p = PUT_LITERAL(p, "\\u00");
+      *p++ = hex[c >> 4];
+      *p++ = hex[c & 0xF];
+    } else {
+      *p++ = (char)c;
+    }
+  }
+  return p;
+}
+
+// CSVの1列として書く（,や"や改行を含めば"で囲み、"は2つ重ねる: RFC 4180）
+static char *put_csv_field(char *p, const char *s, size_t len) {
+  if (strcspn(s, ",\"\r\n") >= len) {
+    return put_str(p, s, len);
+  }
+  *p++ = '"';
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] == '"') {
+      *p++ = '"';
+    }
+    *p++ = s[i];
+  }
+  *p++ = '"';
+  return p;
+}
+
+static char *put_int(char *p, long value) {
+  char digits[24];
+  int n = 0;
+  unsigned long v = value < 0 ? -(unsigned long)value : (unsigned long)value;
+
+  if (value < 0) {
+    *p++ = '-';
+  }
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v > 0);
+  while (n > 0) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+// ミリ秒を小数点以下3桁で書く（printfの%.3fと同じ丸め）
+static char *put_ms(char *p, double ms) {
+  unsigned long us = ms > 0.0 ? (unsigned long)(ms * 1000.0 + 0.5) : 0;
+  unsigned long frac = us % 1000;
+
+  p = put_int(p, (long)(us / 1000));
+  *p++ = '.';
+  *p++ = (char)('0' + frac / 100);
+  *p++ = (char)('0' + frac / 10 % 10);
+  *p++ = (char)('0' + frac % 10);
+  return p;
+}
+
+void output_reply(PingContext *ctx, const PingTarget *target,
+                  const char *addr_str, int icmp_len, int seq, int ttl,
+                  double rtt, int duplicate) {
+  // 宛先から届いた応答は、宛先ごとにキャッシュしたアドレス文字列をそのまま使う
+  // （IPアドレスの文字列にはエスケープの必要な文字がない）
+  int cached = addr_str == target->ip;
+  size_t addr_len = cached ? (size_t)target->ip_len : strlen(addr_str);
+  char *p = output_reserve(&ctx->out,
+                           cached ? 0 : addr_len * OUTPUT_ESCAPE_MAX + 2);
+
+  switch (ctx->format) {
+  case PING_FORMAT_JSONL:
+    p = PUT_LITERAL(p, "{\"addr\":\"");
+    p = cached ? put_str(p, addr_str, addr_len)
+               : put_json_str(p, addr_str, addr_len);
+    p = PUT_LITERAL(p, "\",\"seq\":");
+    p = put_int(p, seq);
+    p = PUT_LITERAL(p, ",\"ttl\":");
+    p = put_int(p, ttl);
+    p = PUT_LITERAL(p, ",\"bytes\":");
+    p = put_int(p, icmp_len);
+    p = PUT_LITERAL(p, ",\"rtt_ms\":");
+    p = put_ms(p, rtt);
+    p = duplicate ? PUT_LITERAL(p, ",\"status\":\"dup\"}\n")
+                  : PUT_LITERAL(p, ",\"status\":\"reply\"}\n");
+    break;
+  case PING_FORMAT_CSV:
+    p = cached ? put_str(p, addr_str, addr_len)
+               : put_csv_field(p, addr_str, addr_len);
+    *p++ = ',';
+    p = put_int(p, seq);
+    *p++ = ',';
+    p = put_int(p, ttl);
+    *p++ = ',';
+    p = put_int(p, icmp_len);
+    *p++ = ',';
+    p = put_ms(p, rtt);
+    p = duplicate ? PUT_LITERAL(p, ",dup\n") : PUT_LITERAL(p, ",reply\n");
+    break;
+  default:
+    // "%d bytes from %s: icmp_seq=%d ttl=%d time=%.3f ms" と同じ行
+    p = put_int(p, icmp_len);
+    p = PUT_LITERAL(p, " bytes from ");
+    p = put_str(p, addr_str, addr_len);
+    p = PUT_LITERAL(p, ": icmp_seq=");
+    p = put_int(p, seq);
+    p = PUT_LITERAL(p, " ttl=");
+    p = put_int(p, ttl);
+    p = PUT_LITERAL(p, " time=");
+    p = put_ms(p, rtt);
+    p = duplicate ? PUT_LITERAL(p, " ms (DUP!)\n") : PUT_LITERAL(p, " ms\n");
+    break;
+  }
+  output_commit(&ctx->out, p);
+}
+
+void output_lost(PingContext *ctx, const PingTarget *target, int seq) {
+  char *p = output_reserve(&ctx->out, 0);
+
+  switch (ctx->format) {
+  case PING_FORMAT_JSONL:
+    p = PUT_LITERAL(p, "{\"addr\":\"");
+    p = put_str(p, target->ip, (size_t)target->ip_len);
+    p = PUT_LITERAL(p, "\",\"seq\":");
+    p = put_int(p, seq);
+    p = PUT_LITERAL(p, ",\"status\":\"lost\"}\n");
+    break;
+  case PING_FORMAT_CSV:
+    // 応答がないのでttl・bytes・rtt_msは空欄
+    p = put_str(p, target->ip, (size_t)target->ip_len);
+    *p++ = ',';
+    p = put_int(p, seq);
+    p = PUT_LITERAL(p, ",,,,lost\n");
+    break;
+  default:
+    p = PUT_LITERAL(p, "no reply from ");
+    p = put_str(p, target->ip, (size_t)target->ip_len);
+    p = PUT_LITERAL(p, ": icmp_seq=");
+    p = put_int(p, seq);
+    *p++ = '\n';
+    break;
+  }
+  output_commit(&ctx->out, p);
+}
+
+void output_text(PingContext *ctx, const char *fmt, ...) {
+  va_list ap;
+
+  if (ctx->format != PING_FORMAT_TEXT || !ctx->out.buf) {
+    // 記録以外の行は標準出力に混ぜない
+    va_start(ap, fmt);
+    vfprintf(text_stream(ctx), fmt, ap);
+    va_end(ap);
+    return;
+  }
+
+  char *p = output_reserve(&ctx->out, 0);
+  va_start(ap, fmt);
+  int n = vsnprintf(p, OUTPUT_LINE_MAX, fmt, ap);
+  va_end(ap);
+  if (n < 0) {
+    return;
+  }
+  if (n >= OUTPUT_LINE_MAX) {
+    // 収まらない行は切り詰め、改行で終える
+    n = OUTPUT_LINE_MAX - 1;
+    p[n - 1] = '\n';
+  }
+  output_commit(&ctx->out, p + n);
+}
+
+FILE *text_stream(const PingContext *ctx) {
+  return ctx->format == PING_FORMAT_TEXT ? stdout : stderr;
+}
@@ -1,5 +1,20 @@
 #define _POSIX_C_SOURCE 199309L
 #include "ping_packet.h"
+#include "ping_checksum.h"
+#include "ping_output.h"
+#include "ping_profile.h"
+#include "ping_record.h"
+#include "ping_resolver.h"
+#include "ping_rx.h"
+#include "ping_sched.h"
+#include "ping_stats.h"
+#include "ping_sweep.h"
+#include "ping_tx.h"
+#include "ping_uring.h"
+#include "ping_wheel.h"
+#include "ping_window.h"
+
+#include <errno.h>
 
 // ICMPヘッダ構造体（RFC792に準拠、最低限のフィールドのみ）
 // struct icmphdr {
@@ -58,170 +73,315 @@
 //
 // 詳細: RFC792参照
 
-static unsigned short ping_checksum(void *b, int len) {
-  // ICMPパケットのチェックサム計算
-  // RFC792: The checksum is the 16-bit ones's complement of the one's
-  // complement sum of the ICMP message starting with the ICMP Type.
-  unsigned short *buf = b;
-  unsigned int sum = 0;
-  unsigned short result;
+void print_ping_header(PingContext *ctx) {
+  FILE *stream = text_stream(ctx);
 
-  // 16ビット単位で加算
-  while (len > 1) {
-    sum += *buf++;
-    len -= 2;
+  // 解決中の宛先も、解決でき次第送信するので宛先の数に含める
+  int resolving = resolver_pending(ctx->resolver);
+  if (ctx->target_count + resolving > 1) {
+    fprintf(stream, "PING %d hosts: ", ctx->target_count + resolving);
+  } else {
+    fprintf(stream, "PING %s (%s): ", ctx->targets[0].hostname,
+            ctx->targets[0].ip);
+  }
+  if (ctx->sweep_count > 1) {
+    fprintf(stream, "%d-%d data bytes (%d sizes)", ctx->sweep_min,
+            ctx->sweep_max, ctx->sweep_count);
+  } else {
+    fprintf(stream, "%d data bytes", ctx->data_size);
   }
+  if (ctx->verbose_mode) {
+    fprintf(stream, ", id 0x%04x = %d", ctx->ident, ctx->ident);
+  }
+  fprintf(stream, "\n");
+  if (ctx->format == PING_FORMAT_CSV && !ctx->quiet) {
+    fputs(PING_CSV_HEADER, stdout);
+  }
+}
 
-  // 奇数バイトの場合、最後の1バイトを処理
-  if (len == 1) {
-    sum += *(unsigned char *)buf << 8;
+int queue_ping(PingContext *ctx, const struct timespec *timestamp) {
+  if (!ctx || !timestamp) {
+    return -1;
   }
 
-  // キャリーを加算（16ビットを超えた分を下位16ビットに加算）
-  while (sum >> 16) {
-    sum = (sum & 0xFFFF) + (sum >> 16);
+  // 送信バッファが一杯ならまとめて送信してから積む
+  if (ctx->tx.pending >= PING_TX_BATCH && flush_pings(ctx) < 0) {
+    return -1;
   }
 
-  // 1の補数を取得
-  result = ~sum;
-  return result;
+  // 送信番号: 送信回数（送信待ちの分を含む）
+  // Sequence Numberはこの下位16ビット
+  long long number = ctx->packets_sent + ctx->tx.pending;
+  // 応答もタイムアウトもまだのスロットを上書きする場合は、その送信をここで失ったとみなす
+  int index = seq_slot_index(&ctx->window, number);
+  if (timer_wheel_pending(&ctx->wheel, index)) {
+    timer_wheel_cancel(&ctx->wheel, index);
+    expire_probe(ctx, index);
+  }
+  PingSeqSlot *slot = claim_seq_slot(&ctx->window, number);
+
+  // 宛先はラウンドロビンで選び、応答の照合用に送信記録へ残す
+  // -cでは上限まで送った宛先を飛ばす（送信中に追加された宛先にも同じ数を送る）
+  int target_index = ctx->next_target;
+  long long limit = sweep_probe_limit(ctx);
+  for (int tries = 1; limit > 0 && tries < ctx->target_count &&
+                      ctx->targets[target_index].packets_sent +
+                              ctx->targets[target_index].probes_pending +
+                              ctx->targets[target_index].send_errors >=
+                          limit;
+       tries++) {
+    target_index = (target_index + 1) % ctx->target_count;
+  }
+  ctx->next_target = (target_index + 1) % ctx->target_count;
+  slot->target = target_index;
+  // --sweepでは宛先ごとにサイズを順に変える
+  size_t packet_size = ICMP_HDRLEN + ctx->data_size;
+  slot->size_index = 0;
+  if (ctx->sweep_count > 0) {
+    slot->size_index = next_sweep_index(ctx, &ctx->targets[target_index]);
+    packet_size = ICMP_HDRLEN + sweep_data_size(ctx, slot->size_index);
+  }
+  ctx->targets[target_index].probes_pending++;
+
+  // 送信時刻を保存（RTT計算用）
+  slot->sent_time = *timestamp;
+  if (ctx->kernel_timestamps) {
+    // カーネルのタイムスタンプはCLOCK_REALTIMEなので同じ時計でも記録しておく
+    // TX時刻がエラーキューから届けばそちらで上書きする
+    clock_gettime(CLOCK_REALTIME, &slot->kernel_sent_time);
+  }
+  return prepare_tx_slot(&ctx->tx, (int)(number & 0xFFFF), timestamp,
+                         &ctx->targets[target_index].addr, packet_size);
 }
 
-static int expand_arrays_if_needed(PingContext *ctx, int seq) {
-  // sent_times配列を拡張
-  if (seq >= ctx->sent_times_capacity) {
-    int new_capacity = ctx->sent_times_capacity * 2;
-    while (new_capacity <= seq) {
-      new_capacity *= 2;
-    }
-    struct timespec *new_sent_times = realloc(ctx->sent_times, new_capacity * sizeof(struct timespec));
-    if (!new_sent_times) {
-      return -1;
-    }
-    ctx->sent_times = new_sent_times;
-    ctx->sent_times_capacity = new_capacity;
-  }
-  
-  // received_seq配列を拡張
-  int required_size = (seq + 31) / 32 + 1;
-  if (required_size > ctx->received_seq_size) {
-    int new_size = ctx->received_seq_size * 2;
-    while (new_size < required_size) {
-      new_size *= 2;
+int send_error_is_per_target(int err) {
+  return err == ENETUNREACH || err == EHOSTUNREACH || err == EPERM ||
+         err == EACCES;
+}
+
+int flush_pings(PingContext *ctx) {
+  if (!ctx) {
+    return -1;
+  }
+
+  // ICMPパケット送信
+  // IPヘッダの送信元アドレスはEcho Requestの宛先、Echo Replyでは逆転
+  long long first = ctx->packets_sent;
+  int pending = ctx->tx.pending;
+  PING_PROF_BEGIN(ctx, send_start);
+  int sent = ctx->uring ? uring_send_batch(ctx->uring, &ctx->tx)
+                        : flush_tx_engine(&ctx->tx, ctx->sock_fd);
+  int err = errno;
+  PING_PROF_END(ctx, PING_PROF_SEND, send_start, sent > 0 ? sent : 0);
+  // 送信できなかった分は破棄され、次の送信で同じ送信番号を使い直す
+  for (long long i = first; i < first + pending; i++) {
+    int index = seq_slot_index(&ctx->window, i);
+    ctx->targets[ctx->window.slots[index].target].probes_pending--;
+  }
+  if (sent < 0) {
+    // 送信失敗時は packets_sent をインクリメントしない
+    // 宛先ごとのエラーは先頭のパケットの宛先へ送ったものとして-cの上限に数える
+    // （数えないと-cで送れない宛先を待ち続け、終わらない）
+    if (send_error_is_per_target(err)) {
+      int index = seq_slot_index(&ctx->window, first);
+      PingTarget *target = &ctx->targets[ctx->window.slots[index].target];
+      target->send_errors++;
+      ctx->send_errors++;
     }
-    int *new_received_seq = realloc(ctx->received_seq, new_size * sizeof(int));
-    if (!new_received_seq) {
-      return -1;
+    errno = err;
+    return -1;
+  }
+  ctx->packets_sent += sent;
+  ctx->interval.packets_sent += sent;
+  // 送信したパケットごとに応答待ちのタイマーを登録する
+  unsigned long long linger_ms = (unsigned long long)(ctx->linger * 1000.0);
+  for (long long i = ctx->packets_sent - sent; i < ctx->packets_sent; i++) {
+    PingSeqSlot *slot = seq_slot(&ctx->window, i, ctx->packets_sent);
+    ctx->targets[slot->target].packets_sent++;
+    if (ctx->sweep_count > 0) {
+      count_sweep_send(ctx, &ctx->targets[slot->target], slot->size_index);
     }
-    // 新しい領域を0で初期化
-    for (int i = ctx->received_seq_size; i < new_size; i++) {
-      new_received_seq[i] = 0;
+    timer_wheel_add(&ctx->wheel, seq_slot_index(&ctx->window, i),
+                    timespec_to_ms(&slot->sent_time) + linger_ms);
+  }
+  if (ctx->flood_mode && ctx->worker_id < 0 && !ctx->quiet &&
+      ctx->format == PING_FORMAT_TEXT) {
+    // floodモードでは送信ごとに'.'を出力し、受信ごとに1文字消す
+    // スレッド分割時は標準出力のロックを奪い合わないよう出力しない
+    // -qやJSON Lines/CSVでは記録以外を標準出力に出さない
+    for (int i = 0; i < sent; i++) {
+      putchar('.');
     }
-    ctx->received_seq = new_received_seq;
-    ctx->received_seq_size = new_size;
   }
-  
-  return 0;
+  return sent;
 }
 
-int send_ping(PingContext *ctx, int print_header,
-              const struct timespec *timestamp) {
-  if (!ctx || !timestamp) {
-    return -1;
+static double rtt_ms(const struct timespec *ts_sent,
+                     const struct timespec *ts_recv) {
+  return (ts_recv->tv_sec - ts_sent->tv_sec) * 1000.0 +
+         (ts_recv->tv_nsec - ts_sent->tv_nsec) / 1000000.0;
+}
+
+// RTTを計算する
+// カーネルの受信時刻があればカーネル同士の時刻差を使い、
+// ユーザ空間の時計で測った値は比較用に集計する
+static double compute_rtt(PingContext *ctx, const PingSeqSlot *slot,
+                          const struct timespec *ts_recv,
+                          const struct timespec *kernel_rx, int record) {
+  double rtt = rtt_ms(&slot->sent_time, ts_recv);
+
+  if (!ctx->kernel_timestamps || !kernel_rx) {
+    return rtt;
   }
 
-  // 配列サイズを動的に拡張
-  if (expand_arrays_if_needed(ctx, ctx->packets_sent) < 0) {
-    fprintf(stderr, "Failed to expand arrays\n");
-    return -1;
+  double kernel_rtt = rtt_ms(&slot->kernel_sent_time, kernel_rx);
+  if (record) {
+    add_rtt_sample(&ctx->user_rtt, rtt);
+    add_rtt_sample(&ctx->overhead, rtt - kernel_rtt);
   }
-  struct icmphdr icmp_hdr; // ICMPヘッダ（Type, Code, Checksum, Identifier,
-                           // Sequence Number）
-  char packet[PACKET_SIZE];
-  char data[ICMP_DATA_SIZE]; // データ部バッファ（RTT計測や任意データ格納）
-
-  // ICMPヘッダ初期化
-  memset(&icmp_hdr, 0, sizeof(icmp_hdr));
-  icmp_hdr.type = ICMP_ECHO; // Type: 8 (Echo Request)
-  icmp_hdr.code = 0;         // Code: 0固定
-  icmp_hdr.un.echo.id =
-      htons(getpid() & 0xFFFF); // Identifier: プロセスID下位16bit
-  icmp_hdr.un.echo.sequence =
-      htons(ctx->packets_sent); // Sequence Number: 送信回数
-
-  // データ部初期化（全体を0埋め）
-  memset(data, 0, sizeof(data));
-  // 送信時刻を保存（RTT計算用）
-  ctx->sent_times[ctx->packets_sent] = *timestamp;
-  memcpy(data, timestamp, sizeof(struct timespec));
-
-  // パケットバッファ初期化・ヘッダ/データ部コピー
-  memset(packet, 0, PACKET_SIZE);
-  memcpy(packet, &icmp_hdr, ICMP_HDRLEN); // 8バイト固定: Type, Code, Checksum,
-                                          // Identifier, Sequence Number
-  memcpy(packet + ICMP_HDRLEN, data, ICMP_DATA_SIZE); // Data部
-
-  // チェックサム計算
-  // Checksum: ICMPメッセージ全体の16ビット1の補数和の1の補数
-  ((struct icmphdr *)packet)->checksum = 0; // 計算前に0クリア
-  ((struct icmphdr *)packet)->checksum =
-      ping_checksum(packet, PACKET_SIZE); // 計算結果をセット
-
-  // 最初の1回だけヘッダ出力
-  if (print_header) {
-    if (ctx->verbose_mode) {
-      printf("PING %s (%s): %d data bytes, id 0x%04x = %d\n",
-             ctx->dest_hostname, ctx->dest_ip, ICMP_DATA_SIZE,
-             ntohs(icmp_hdr.un.echo.id), ntohs(icmp_hdr.un.echo.id));
-    } else {
-      printf("PING %s (%s): %d data bytes\n", ctx->dest_hostname, ctx->dest_ip,
-             ICMP_DATA_SIZE);
-    }
+  return kernel_rtt;
+}
+
+// データ部に埋め込んだ送信時刻が送信記録と一致するか
+// シーケンス番号が一周する前に送った同じ番号への遅延応答を取り違えないようにする
+// (データ部が送信時刻より小さい場合は確認できないので一致とみなす)
+// キャプチャの再生では、記録しておいたEcho Requestのデータ部の先頭と比べる
+static int payload_matches(const PingContext *ctx, const PingSeqSlot *slot,
+                           const struct icmphdr *icmp_hdr, int icmp_len) {
+  const struct timespec *expected =
+      ctx->replay ? &slot->kernel_sent_time : &slot->sent_time;
+  struct timespec sent;
+
+  if (icmp_len < ICMP_HDRLEN + (int)sizeof(sent)) {
+    return 1;
   }
+  memcpy(&sent, (const unsigned char *)icmp_hdr + ICMP_HDRLEN, sizeof(sent));
+  return sent.tv_sec == expected->tv_sec && sent.tv_nsec == expected->tv_nsec;
+}
 
-  // ICMPパケット送信
-  // IPヘッダの送信元アドレスはEcho Requestの宛先、Echo Replyでは逆転
-  if (sendto(ctx->sock_fd, packet, PACKET_SIZE, 0, &ctx->dest_addr,
-             sizeof(ctx->dest_addr)) < 0) {
-    perror("sendto failed");
-    return -1; // 送信失敗時は packets_sent をインクリメントしない
-  } else {
-    ctx->packets_sent++;
-    return 0; // 送信成功
+// ICMPチェックサム検証
+// Checksum: 受信時はフィールドを0にして再計算し、値が一致するか確認
+static int icmp_checksum_ok(struct icmphdr *icmp_hdr, int len) {
+  unsigned short received_checksum = icmp_hdr->checksum;
+  icmp_hdr->checksum = 0; // チェックサム計算のため一時的に0に設定
+  unsigned short calculated_checksum = ping_checksum(icmp_hdr, len);
+  icmp_hdr->checksum = received_checksum; // 元の値に戻す
+  return received_checksum == calculated_checksum;
+}
+
+static const char *icmp_error_string(int type, int code) {
+  switch (type) {
+  case ICMP_DEST_UNREACH:
+    switch (code) {
+    case ICMP_NET_UNREACH:
+      return "Destination Net Unreachable";
+    case ICMP_HOST_UNREACH:
+      return "Destination Host Unreachable";
+    case ICMP_PROT_UNREACH:
+      return "Destination Protocol Unreachable";
+    case ICMP_PORT_UNREACH:
+      return "Destination Port Unreachable";
+    case ICMP_FRAG_NEEDED:
+      return "Fragmentation needed and DF set";
+    case ICMP_SR_FAILED:
+      return "Source Route Failed";
+    default:
+      return "Destination Unreachable";
+    }
+  case ICMP_SOURCE_QUENCH:
+    return "Source Quench";
+  case ICMP_REDIRECT:
+    return "Redirect";
+  case ICMP_TIME_EXCEEDED:
+    return code == ICMP_EXC_FRAGTIME ? "Frag reassembly time exceeded"
+                                     : "Time to live exceeded";
+  case ICMP_PARAMETERPROB:
+    return "Parameter problem";
+  default:
+    return NULL;
   }
 }
 
-int receive_ping(PingContext *ctx) {
-  if (!ctx) {
+// 自分のEcho Requestを引用したICMPエラー（到達不能・時間超過など）を表示する
+// 戻り値: 0=処理済みまたは自分宛てでない, -1=不正なパケット
+static int process_icmp_error(PingContext *ctx, struct icmphdr *icmp_hdr,
+                              int icmp_len, const struct sockaddr_in *from) {
+  const char *message = icmp_error_string(icmp_hdr->type, icmp_hdr->code);
+  if (!message) {
+    return 0;
+  }
+
+  // エラーの後ろには元のIPヘッダとICMPヘッダの先頭8バイトが引用されている
+  const unsigned char *quoted = (const unsigned char *)icmp_hdr + ICMP_HDRLEN;
+  int quoted_len = icmp_len - ICMP_HDRLEN;
+  if (quoted_len < (int)sizeof(struct iphdr)) {
+    return -1;
+  }
+  int quoted_ip_len = (quoted[0] & 0x0F) * 4;
+  if (quoted_ip_len < (int)sizeof(struct iphdr) ||
+      quoted_len < quoted_ip_len + ICMP_HDRLEN) {
+    return -1;
+  }
+  struct icmphdr request;
+  memcpy(&request, quoted + quoted_ip_len, sizeof(request));
+  if (request.type != ICMP_ECHO || ntohs(request.un.echo.id) != ctx->ident) {
+    return 0;
+  }
+  if (!icmp_checksum_ok(icmp_hdr, icmp_len)) {
     return -1;
   }
 
-  char buffer[2048];
-  struct sockaddr from;
-  socklen_t fromlen = sizeof(from);
-  struct timespec ts_recv;
-  struct timespec ts_sent = {0};
-  struct icmphdr *icmp_hdr;
-  struct iphdr *ip_hdr;
-  int bytes_received;
-  double rtt;
-  int ttl = 0;
+  if (ctx->flood_mode || ctx->quiet) {
+    return 0;
+  }
+  char addr_str[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &from->sin_addr, addr_str, sizeof(addr_str));
+  output_text(ctx, "%d bytes from %s: %s\n", icmp_len, addr_str, message);
+  return 0;
+}
 
-  // ICMPパケット受信
-  bytes_received =
-      recvfrom(ctx->sock_fd, buffer, sizeof(buffer), 0, &from, &fromlen);
+// 送信の結果を呼び出し側のon_resultに知らせる
+static void notify_result(PingContext *ctx, PingResultKind kind,
+                          const PingSeqSlot *slot, int seq, double rtt, int ttl,
+                          int bytes, const struct sockaddr_in *from) {
+  PingResult result = {kind, slot->target, seq, rtt, ttl, bytes, from};
+  ctx->on_result(ctx, &result);
+}
 
-  // 受信タイムスタンプを即座にキャプチャ（RTT精度向上のため）
-  if (clock_gettime(CLOCK_MONOTONIC, &ts_recv) != 0) {
-    perror("clock_gettime failed in receive_ping");
-    return -1;
+void count_reply(PingContext *ctx, PingTarget *target, double rtt) {
+  ctx->packets_received++;
+  ctx->interval.packets_received++;
+  target->packets_received++;
+  add_rtt_sample(&target->rtt, rtt);
+
+  // RTT統計情報を更新
+  // 個々のRTTは保存せず、分布はヒストグラムに記録する
+  histogram_record(&ctx->rtt_hist, rtt);
+  ctx->rtt_count++;
+  ctx->rtt_sum += rtt;
+  ctx->rtt_sum2 += rtt * rtt;
+  if (ctx->rtt_count == 1 || rtt < ctx->rtt_min)
+    ctx->rtt_min = rtt;
+  if (ctx->rtt_count == 1 || rtt > ctx->rtt_max)
+    ctx->rtt_max = rtt;
+  if (ctx->report_interval > 0) {
+    // 定期レポート用の区間統計もその場で更新し、レポート時に集計し直さない
+    add_rtt_sample(&ctx->interval.rtt, rtt);
+    histogram_record(&ctx->interval.hist, rtt);
   }
+}
 
-  if (bytes_received < 0) {
-    perror("recvfrom failed");
+int process_reply(PingContext *ctx, char *buffer, int bytes_received,
+                  const struct sockaddr_in *from,
+                  const struct timespec *ts_recv_ptr,
+                  const struct timespec *kernel_rx) {
+  // RAWソケットで受信したIPパケットからIPヘッダを外し、ICMP部分を処理する
+  if (!ctx || !buffer || !from || !ts_recv_ptr) {
     return -1;
   }
 
+  struct iphdr *ip_hdr;
+
   if (bytes_received < (int)(sizeof(struct iphdr) + sizeof(struct icmphdr))) {
     // パケットサイズが不十分
     return -1;
@@ -243,102 +403,290 @@ int receive_ping(PingContext *ctx) {
     return -1;
   }
 
-  icmp_hdr =
-      (struct icmphdr *)(buffer +
-                         ip_hdr_len); // ICMPヘッダ（Type, Code, Checksum,
-                                      // Identifier, Sequence Number）
+  // ICMPヘッダ（Type, Code, Checksum, Identifier, Sequence Number）
+  return process_icmp(ctx, (struct icmphdr *)(buffer + ip_hdr_len),
+                      bytes_received - ip_hdr_len, ip_hdr->ttl, from,
+                      ts_recv_ptr, kernel_rx);
+}
+
+int process_icmp(PingContext *ctx, struct icmphdr *icmp_hdr, int icmp_len,
+                 int ttl, const struct sockaddr_in *from,
+                 const struct timespec *ts_recv_ptr,
+                 const struct timespec *kernel_rx) {
+  // IPヘッダを除いたICMPメッセージを処理する
+  // データグラムソケットでは受信データがこの形なので、IPヘッダの解析を経ずに直接呼ぶ
+  if (!ctx || !icmp_hdr || !from || !ts_recv_ptr) {
+    return -1;
+  }
+  if (icmp_len < (int)sizeof(struct icmphdr)) {
+    return -1;
+  }
+
+  struct timespec ts_recv = *ts_recv_ptr;
+  double rtt;
+
+  // 自分宛てのEcho Reply以外は、チェックサムを計算する前に判定して捨てる
+  // (BPFフィルタを使わない場合は他のプロセス宛ての応答も全て届くため)
+  if (icmp_hdr->type != ICMP_ECHOREPLY) {
+    return process_icmp_error(ctx, icmp_hdr, icmp_len, from);
+  }
+  if (ntohs(icmp_hdr->un.echo.id) != ctx->ident) {
+    return 0;
+  }
 
   // ICMPチェックサム検証
-  // Checksum: 受信時はフィールドを0にして再計算し、値が一致するか確認
-  unsigned short received_checksum = icmp_hdr->checksum;
-  icmp_hdr->checksum = 0; // チェックサム計算のため一時的に0に設定
-  unsigned short calculated_checksum =
-      ping_checksum(icmp_hdr, bytes_received - ip_hdr_len);
-  icmp_hdr->checksum = received_checksum; // 元の値に戻す
+  // データグラムソケットではカーネルが検証済みなので省略する
+  if (ctx->socket_type != PING_SOCKET_DGRAM) {
+    PING_PROF_BEGIN(ctx, checksum_start);
+    int checksum_ok = icmp_checksum_ok(icmp_hdr, icmp_len);
+    PING_PROF_END(ctx, PING_PROF_CHECKSUM, checksum_start, icmp_len);
+    if (!checksum_ok) {
+      // チェックサムが不一致の場合、パケットを破棄
+      return -1;
+    }
+  }
 
-  if (received_checksum != calculated_checksum) {
-    // チェックサムが不一致の場合、パケットを破棄
+  // シーケンス番号から送信記録を引く
+  // 照合できる範囲より古い応答や、番号が一周する前の同じ番号への遅延応答は数えるだけ
+  int seq = ntohs(icmp_hdr->un.echo.sequence); // Sequence Number
+  long long number =
+      seq_window_number(&ctx->window, seq, ctx->packets_sent);
+  PingSeqSlot *slot = seq_slot(&ctx->window, number, ctx->packets_sent);
+  if (!slot || !payload_matches(ctx, slot, icmp_hdr, icmp_len)) {
+    ctx->packets_late++;
+    if (ctx->recorder) {
+      record_late(ctx);
+    }
+    return 0;
+  }
+
+  // 複数宛先の場合、送信先以外からの応答は照合できないので破棄する
+  PingTarget *target = &ctx->targets[slot->target];
+  int from_target = from->sin_addr.s_addr == target->addr.sin_addr.s_addr;
+  if (!from_target && ctx->target_count > 1) {
     return -1;
   }
 
-  // ICMP Echo Replyかつ自プロセスID宛か判定
-  if (icmp_hdr->type == ICMP_ECHOREPLY &&
-      ntohs(icmp_hdr->un.echo.id) == (getpid() & 0xFFFF)) {
-    int seq = ntohs(icmp_hdr->un.echo.sequence); // Sequence Number
-    if (seq < 0) {
-      // 負のシーケンス番号は無視
-      return -1;
+  // 表示用のアドレス文字列は宛先ごとにキャッシュしたものを使う
+  char addr_buf[INET_ADDRSTRLEN];
+  const char *addr_str = target->ip;
+  if (!from_target) {
+    inet_ntop(AF_INET, &from->sin_addr, addr_buf, sizeof(addr_buf));
+    addr_str = addr_buf;
+  }
+
+  if (slot->received) {
+    // 重複受信
+    ctx->packets_duplicate++;
+    ctx->interval.packets_duplicate++;
+    target->packets_duplicate++;
+
+    // 重複パケットのRTT計算
+    rtt = compute_rtt(ctx, slot, &ts_recv, kernel_rx, 0);
+    if (ctx->recorder) {
+      record_reply(ctx, PING_RECORD_DUPLICATE, number, slot, rtt, ttl, icmp_len);
     }
-    
-    // 配列サイズを動的に拡張（必要に応じて）
-    if (expand_arrays_if_needed(ctx, seq) < 0) {
-      return -1;
+    if (ctx->on_result) {
+      notify_result(ctx, PING_RESULT_DUPLICATE, slot, seq, rtt, ttl, icmp_len,
+                    from);
     }
-    int idx = seq / 32;
-    int bit = seq % 32;
-    if (ctx->received_seq[idx] & (1 << bit)) {
-      // 重複受信
-      ctx->packets_duplicate++;
-      ttl = ip_hdr->ttl;
-      char addr_str[INET_ADDRSTRLEN];
-      inet_ntop(AF_INET, &((struct sockaddr_in *)&from)->sin_addr, addr_str,
-                sizeof(addr_str));
-
-      // 重複パケットのRTT計算
-      ts_sent = ctx->sent_times[seq];
-      rtt = (ts_recv.tv_sec - ts_sent.tv_sec) * 1000.0 +
-            (ts_recv.tv_nsec - ts_sent.tv_nsec) / 1000000.0;
-
-      // ICMPペイロードサイズのみを表示（IPヘッダーを除く）
-      int icmp_payload_size = bytes_received - ip_hdr_len;
-      printf("%d bytes from %s: icmp_seq=%d ttl=%d time=%.3f ms (DUP!)\n",
-             icmp_payload_size, addr_str, seq, ttl, rtt);
+
+    if (ctx->flood_mode || ctx->quiet) {
       return 0;
     }
-    ctx->received_seq[idx] |= (1 << bit);
-    ctx->packets_received++;
-
-    // 送信時刻はPingContextのsent_timesから取得
-    ts_sent = ctx->sent_times[seq];
-
-    // RTT(往復遅延時間)を計算
-    rtt = (ts_recv.tv_sec - ts_sent.tv_sec) * 1000.0 +
-          (ts_recv.tv_nsec - ts_sent.tv_nsec) / 1000000.0;
-
-    // RTT統計情報を更新
-    // RTT配列を拡張（必要に応じて）
-    if (ctx->rtt_count >= ctx->rtt_capacity) {
-      int new_capacity = ctx->rtt_capacity * 2;
-      double *new_rtt_times = realloc(ctx->rtt_times, new_capacity * sizeof(double));
-      if (!new_rtt_times) {
-        return -1;
-      }
-      ctx->rtt_times = new_rtt_times;
-      ctx->rtt_capacity = new_capacity;
-    }
-    
-    ctx->rtt_times[ctx->rtt_count++] = rtt;
-    ctx->rtt_sum += rtt;
-    ctx->rtt_sum2 += rtt * rtt;
-    if (ctx->rtt_count == 1 || rtt < ctx->rtt_min)
-      ctx->rtt_min = rtt;
-    if (ctx->rtt_count == 1 || rtt > ctx->rtt_max)
-      ctx->rtt_max = rtt;
-
-    // TTL値を取得
-    ttl = ip_hdr->ttl;
-
-    // 受信結果を表示（icmp_seqは1始まりに合わせる）
-    char addr_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &((struct sockaddr_in *)&from)->sin_addr, addr_str,
-              sizeof(addr_str));
-
-    // verbose出力とnomal出力の違いはない
+
     // ICMPペイロードサイズのみを表示（IPヘッダーを除く）
-    int icmp_payload_size = bytes_received - ip_hdr_len;
-    printf("%d bytes from %s: icmp_seq=%d ttl=%d time=%.3f ms\n",
-           icmp_payload_size, addr_str, seq, ttl, rtt);
+    PING_PROF_BEGIN(ctx, format_start);
+    output_reply(ctx, target, addr_str, icmp_len, seq, ttl, rtt, 1);
+    PING_PROF_END(ctx, PING_PROF_FORMAT, format_start, 1);
+    return 0;
+  }
+  slot->received = 1;
+  // タイマーが残っていなければ、タイムアウトを知らせた後に届いた応答
+  int index = seq_slot_index(&ctx->window, number);
+  int timed_out = !timer_wheel_pending(&ctx->wheel, index);
+  timer_wheel_cancel(&ctx->wheel, index);
+
+  // RTT(往復遅延時間)を計算
+  // 送信時刻は送信記録のスロットから取得
+  rtt = compute_rtt(ctx, slot, &ts_recv, kernel_rx, 1);
+  count_reply(ctx, target, rtt);
+  if (ctx->sweep_count > 0) {
+    count_sweep_reply(ctx, target, slot->size_index, rtt);
+  }
+  if (ctx->recorder) {
+    record_reply(ctx, timed_out ? PING_RECORD_LATE_REPLY : PING_RECORD_REPLY,
+                 number, slot, rtt, ttl, icmp_len);
+  }
+  if (ctx->on_result) {
+    notify_result(ctx, timed_out ? PING_RESULT_LATE_REPLY : PING_RESULT_REPLY,
+                  slot, seq, rtt, ttl, icmp_len, from);
+  }
+
+  if (ctx->flood_mode) {
+    if (ctx->worker_id < 0 && !ctx->quiet && ctx->format == PING_FORMAT_TEXT) {
+      fputs("\b \b", stdout);
+    }
     return 0;
   }
+  if (ctx->quiet) {
+    return 0;
+  }
+
+  // 受信結果を表示（icmp_seqは1始まりに合わせる）
+  // verbose出力とnomal出力の違いはない
+  // ICMPペイロードサイズのみを表示（IPヘッダーを除く）
+  // printfを通さず出力バッファに整形し、まとめて書き出す
+  PING_PROF_BEGIN(ctx, format_start);
+  output_reply(ctx, target, addr_str, icmp_len, seq, ttl, rtt, 0);
+  PING_PROF_END(ctx, PING_PROF_FORMAT, format_start, 1);
   return 0;
 }
+
+void expire_probe(void *arg, int index) {
+  // 応答待ちのタイムアウト（またはスロットの再利用）で、送信を失ったことをすぐに知らせる
+  // その後に応答が届いた場合は、通常どおり受信として数える
+  PingContext *ctx = arg;
+  PingSeqSlot *slot = &ctx->window.slots[index];
+
+  if (slot->received) {
+    return;
+  }
+  ctx->packets_timeout++;
+  ctx->interval.packets_timeout++;
+  if (ctx->recorder) {
+    record_lost(ctx, PING_RECORD_LOST, slot->number, slot);
+  }
+  if (ctx->on_result) {
+    notify_result(ctx, PING_RESULT_LOST, slot, slot->number & 0xFFFF, 0.0, 0, 0,
+                  NULL);
+  }
+  if (ctx->flood_mode || ctx->quiet) {
+    return;
+  }
+  output_lost(ctx, &ctx->targets[slot->target], slot->number & 0xFFFF);
+}
+
+int expire_probes(PingContext *ctx, const struct timespec *now) {
+  return timer_wheel_advance(&ctx->wheel, timespec_to_ms(now), expire_probe,
+                             ctx);
+}
+
+// 送信済みパケットのICMPヘッダから、自分が送ったEcho Requestのシーケンス番号を得る
+// エラーキューに返るパケットはデバイスに渡した形のままなので、
+// Ethernetヘッダ(14バイト)やIPヘッダが前に付いている場合がある
+static int echo_request_seq(PingContext *ctx, const unsigned char *packet,
+                            int len) {
+  int offset = 0;
+
+  if (len > 14 && packet[12] == 0x08 && packet[13] == 0x00 &&
+      (packet[14] >> 4) == 4) {
+    offset = 14;
+  }
+  if (len > offset && (packet[offset] >> 4) == 4) {
+    offset += (packet[offset] & 0x0F) * 4;
+  }
+  if (len < offset + (int)sizeof(struct icmphdr)) {
+    return -1;
+  }
+
+  struct icmphdr icmp_hdr;
+  memcpy(&icmp_hdr, packet + offset, sizeof(icmp_hdr));
+  if (icmp_hdr.type != ICMP_ECHO || ntohs(icmp_hdr.un.echo.id) != ctx->ident) {
+    return -1;
+  }
+  return ntohs(icmp_hdr.un.echo.sequence);
+}
+
+int receive_tx_timestamps(PingContext *ctx) {
+  // エラーキューに届いたカーネルの送信タイムスタンプを送信時刻に反映する
+  // 戻り値: 反映したタイムスタンプ数
+  int total = 0;
+
+  for (;;) {
+    int count = receive_batch(&ctx->rx, ctx->sock_fd, MSG_ERRQUEUE);
+    if (count <= 0) {
+      break;
+    }
+    for (int i = 0; i < count; i++) {
+      struct timespec kernel_tx;
+      int seq = echo_request_seq(ctx, rx_buffer(&ctx->rx, i),
+                                 (int)ctx->rx.msgs[i].msg_len);
+      long long number =
+          seq < 0 ? -1
+                  : seq_window_number(&ctx->window, seq, ctx->packets_sent);
+      PingSeqSlot *slot = seq_slot(&ctx->window, number, ctx->packets_sent);
+      if (!slot || rx_kernel_timestamp(&ctx->rx, i, &kernel_tx) < 0) {
+        continue;
+      }
+      slot->kernel_sent_time = kernel_tx;
+      ctx->kernel_tx_count++;
+      total++;
+    }
+    if (count < PING_RX_BATCH) {
+      break;
+    }
+  }
+  return total;
+}
+
+int receive_ping(PingContext *ctx) {
+  // ソケットに溜まった応答をrecvmmsg（--io-uringでは完了キュー）からまとめて読み出し、1つずつ処理する
+  // バッチが一杯だった場合はまだ残っている可能性があるので続けて読む
+  // 戻り値: 処理したパケット数, -1=受信エラー
+  if (!ctx) {
+    return -1;
+  }
+
+  // TX時刻を先に取り込んでおき、同じ起床で届いた応答のRTTに使う
+  if (ctx->kernel_timestamps) {
+    receive_tx_timestamps(ctx);
+  }
+
+  int total = 0;
+  for (;;) {
+    struct timespec ts_recv;
+    PING_PROF_BEGIN(ctx, recv_start);
+    int count = ctx->uring ? uring_receive_batch(ctx->uring, &ctx->rx)
+                           : receive_batch(&ctx->rx, ctx->sock_fd, 0);
+    PING_PROF_END(ctx, PING_PROF_RECV, recv_start, count > 0 ? count : 0);
+    if (count < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        break;
+      }
+      perror(ctx->uring ? "io_uring recvmsg failed" : "recvmmsg failed");
+      return -1;
+    }
+
+    // 受信タイムスタンプを即座にキャプチャ（RTT精度向上のため）
+    // 同じバッチのパケットはいずれもこの時点までに到着している
+    if (clock_gettime(CLOCK_MONOTONIC, &ts_recv) != 0) {
+      perror("clock_gettime failed in receive_ping");
+      return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+      struct timespec kernel_rx;
+      PING_PROF_BEGIN(ctx, reply_start);
+      int has_kernel_rx = ctx->kernel_timestamps &&
+                          rx_kernel_timestamp(&ctx->rx, i, &kernel_rx) == 0;
+      if (ctx->socket_type == PING_SOCKET_DGRAM) {
+        // データグラムソケットはIPヘッダを含まず、TTLは制御メッセージで届く
+        process_icmp(ctx, (struct icmphdr *)rx_buffer(&ctx->rx, i),
+                     (int)ctx->rx.msgs[i].msg_len, rx_ttl(&ctx->rx, i),
+                     &ctx->rx.addrs[i], &ts_recv,
+                     has_kernel_rx ? &kernel_rx : NULL);
+      } else {
+        process_reply(ctx, (char *)rx_buffer(&ctx->rx, i),
+                      (int)ctx->rx.msgs[i].msg_len, &ctx->rx.addrs[i],
+                      &ts_recv, has_kernel_rx ? &kernel_rx : NULL);
+      }
+      PING_PROF_END(ctx, PING_PROF_REPLY, reply_start, 1);
+    }
+    total += count;
+    if (count < PING_RX_BATCH) {
+      break;
+    }
+  }
+  return total;
+}
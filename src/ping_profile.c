@@ -0,0 +1,164 @@
+#include "ping_profile.h"
+
+#include <errno.h>
+
+// ping_profile.c: -Xで計測した段階ごとの処理時間の確保・合算・表示を担当するファイル
+// 計測そのもの（PING_PROF_BEGIN/PING_PROF_END）はホットパスにインライン展開する
+
+static const char *const stage_names[PING_PROF_STAGES] = {
+    [PING_PROF_WAIT] = "epoll_wait",
+    [PING_PROF_RECV] = "receive",
+    [PING_PROF_REPLY] = "reply",
+    [PING_PROF_CHECKSUM] = "  checksum",
+    [PING_PROF_FORMAT] = "  format",
+    [PING_PROF_QUEUE] = "queue",
+    [PING_PROF_SEND] = "send",
+    [PING_PROF_EXPIRE] = "expire",
+    [PING_PROF_OUTPUT] = "output",
+};
+
+// 他の段階の内訳（合計に足すと二重に数える）
+static int nested_stage(int stage) {
+  return stage == PING_PROF_CHECKSUM || stage == PING_PROF_FORMAT;
+}
+
+int open_profile(PingContext *ctx) {
+#ifdef PING_PROFILE
+  ctx->prof = calloc(1, sizeof(PingProfile));
+  if (!ctx->prof) {
+    perror("ft_ping: failed to allocate profile counters");
+    return -1;
+  }
+  ctx->prof->contexts = 1;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ctx->prof->start);
+  ctx->prof->start_ticks = profile_clock();
+  return 0;
+#else
+  (void)ctx;
+  fprintf(stderr, "ft_ping: -X needs a build with profiling counters "
+                  "(make PROFILE=1)\n");
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+void merge_profile(PingContext *dst, const PingContext *src) {
+  if (!src->prof) {
+    return;
+  }
+  if (!dst->prof) {
+    dst->prof = calloc(1, sizeof(PingProfile));
+    if (!dst->prof) {
+      return;
+    }
+    dst->prof->start = src->prof->start;
+    dst->prof->start_ticks = src->prof->start_ticks;
+  }
+  PingProfile *to = dst->prof;
+  const PingProfile *from = src->prof;
+  // 計測期間は最も早く始めたエンジンから数える
+  if (from->start.tv_sec < to->start.tv_sec ||
+      (from->start.tv_sec == to->start.tv_sec &&
+       from->start.tv_nsec < to->start.tv_nsec)) {
+    to->start = from->start;
+    to->start_ticks = from->start_ticks;
+  }
+  to->contexts += from->contexts;
+  for (int s = 0; s < PING_PROF_STAGES; s++) {
+    PingProfStat *d = &to->stages[s];
+    const PingProfStat *f = &from->stages[s];
+    d->calls += f->calls;
+    d->items += f->items;
+    d->ticks += f->ticks;
+    if (f->max > d->max) {
+      d->max = f->max;
+    }
+    for (int b = 0; b < PING_PROF_BUCKETS; b++) {
+      d->hist[b] += f->hist[b];
+    }
+  }
+}
+
+// 分布からpパーセンタイルを求める（バケット内は線形に補間し、最大値を超えない）
+static double stat_percentile(const PingProfStat *stat, double p) {
+  unsigned long long rank = (unsigned long long)(p / 100.0 * (double)stat->calls);
+  unsigned long long seen = 0;
+
+  if (rank >= stat->calls) {
+    rank = stat->calls - 1;
+  }
+  for (int b = 0; b < PING_PROF_BUCKETS; b++) {
+    if (seen + stat->hist[b] > rank) {
+      double low = b == 0 ? 0.0 : (double)(1ULL << (b - 1));
+      double high = b == 0 ? 1.0 : (double)(1ULL << b);
+      double value = low + (high - low) * (double)(rank - seen + 1) /
+                               (double)stat->hist[b];
+      return value < (double)stat->max ? value : (double)stat->max;
+    }
+    seen += stat->hist[b];
+  }
+  return (double)stat->max;
+}
+
+void print_profile(const PingContext *ctx, FILE *stream) {
+  const PingProfile *prof = ctx->prof;
+  struct timespec now;
+
+  if (!prof || prof->contexts == 0) {
+    return;
+  }
+  // カウンタの1刻みが何ナノ秒かを、計測期間全体の時計の進みから求める
+  uint64_t elapsed_ticks = 0;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+  double elapsed_ns = (double)(now.tv_sec - prof->start.tv_sec) * 1e9 +
+                      (double)(now.tv_nsec - prof->start.tv_nsec);
+#ifdef PING_PROFILE
+  elapsed_ticks = profile_clock() - prof->start_ticks;
+#endif
+  double ns_per_tick = elapsed_ticks > 0 && elapsed_ns > 0.0
+                           ? elapsed_ns / (double)elapsed_ticks
+                           : 1.0;
+  double budget = (double)elapsed_ticks * prof->contexts;
+
+  fprintf(stream, "--- profile (%.3f s", elapsed_ns / 1e9);
+#if defined(__x86_64__) || defined(__i386__)
+  fprintf(stream, ", tsc %.3f GHz", 1.0 / ns_per_tick);
+#endif
+  if (prof->contexts > 1) {
+    fprintf(stream, ", %d engines", prof->contexts);
+  }
+  fprintf(stream, ") ---\n");
+  fprintf(stream, "%-12s %10s %10s %10s %6s %9s %9s %9s %9s\n", "stage",
+          "calls", "items", "total_ms", "share", "avg_ns", "p50_ns", "p99_ns",
+          "max_ns");
+
+  double accounted = 0.0;
+  for (int s = 0; s < PING_PROF_STAGES; s++) {
+    const PingProfStat *stat = &prof->stages[s];
+    if (stat->calls == 0) {
+      continue;
+    }
+    if (!nested_stage(s)) {
+      accounted += (double)stat->ticks;
+    }
+    fprintf(stream, "%-12s %10llu %10llu %10.3f %5.1f%% %9.0f %9.0f %9.0f %9.0f\n",
+            stage_names[s], stat->calls, stat->items,
+            (double)stat->ticks * ns_per_tick / 1e6,
+            budget > 0.0 ? (double)stat->ticks * 100.0 / budget : 0.0,
+            (double)stat->ticks * ns_per_tick / (double)stat->calls,
+            stat_percentile(stat, 50.0) * ns_per_tick,
+            stat_percentile(stat, 99.0) * ns_per_tick,
+            (double)stat->max * ns_per_tick);
+  }
+  // どの段階にも入らない時間（ループの残り・統計の表示・計測自体の手間）
+  if (budget > accounted) {
+    fprintf(stream, "%-12s %10s %10s %10.3f %5.1f%%\n", "other", "", "",
+            (budget - accounted) * ns_per_tick / 1e6,
+            (budget - accounted) * 100.0 / budget);
+  }
+}
+
+void close_profile(PingContext *ctx) {
+  free(ctx->prof);
+  ctx->prof = NULL;
+}
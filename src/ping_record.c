@@ -0,0 +1,423 @@
+#include "ping_record.h"
+#include "ping_packet.h"
+#include "ping_target.h"
+#include "ping_wheel.h"
+#include "ping_window.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ping_record.c: 送信ごとの記録ファイル（--record）の書き込みと読み込みを担当するファイル
+// 送信ごとの結果（送信番号・送信時刻・RTTまたはロス・TTL・サイズ・宛先）を
+// 差分とvarintで詰めて追記する。1レコードは典型的に10バイト前後
+// 読み込み側は同じ集計(count_reply)を通してprint_statisticsと同じ統計を再計算する
+
+#define RECORD_MAX_PROBE 64 // 送信1つ分のレコードの最大バイト数
+#define RECORD_MAX_NAME 255 // TARGETに書くホスト名の最大長
+
+static unsigned char *put_varint(unsigned char *p, unsigned long long value) {
+  while (value >= 0x80) {
+    *p++ = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (unsigned char)value;
+  return p;
+}
+
+static unsigned long long zigzag(long long value) {
+  return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+static long long unzigzag(unsigned long long value) {
+  return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+static long long timespec_ns(const struct timespec *ts) {
+  return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void put_le(unsigned char *p, unsigned long long value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    p[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static unsigned long long get_le(const unsigned char *p, int bytes) {
+  unsigned long long value = 0;
+  for (int i = bytes - 1; i >= 0; i--) {
+    value = value << 8 | p[i];
+  }
+  return value;
+}
+
+// 窓を次の位置へ移す（書きかけのページは新しい窓の先頭に含める）
+static int advance_window(PingRecorder *rec) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t offset = rec->map_offset + (rec->used & ~(page - 1));
+
+  if (rec->map) {
+    munmap(rec->map, rec->map_size);
+    rec->map = NULL;
+  }
+  if (ftruncate(rec->fd, (off_t)(offset + PING_RECORD_CHUNK)) < 0) {
+    perror("ft_ping: record: ftruncate failed");
+    return -1;
+  }
+  void *map = mmap(NULL, PING_RECORD_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   rec->fd, (off_t)offset);
+  if (map == MAP_FAILED) {
+    perror("ft_ping: record: mmap failed");
+    return -1;
+  }
+  rec->used -= offset - rec->map_offset;
+  rec->map = map;
+  rec->map_offset = offset;
+  rec->map_size = PING_RECORD_CHUNK;
+  return 0;
+}
+
+// lenバイト書ける位置を返す（窓が足りなければ進める。失敗したら記録をやめる）
+static unsigned char *reserve(PingContext *ctx, size_t len) {
+  PingRecorder *rec = ctx->recorder;
+  if (rec->used + len > rec->map_size && advance_window(rec) < 0) {
+    fprintf(stderr, "ft_ping: record: stopped recording\n");
+    stop_recording(ctx);
+    return NULL;
+  }
+  return rec->map + rec->used;
+}
+
+// まだTARGETを書いていない宛先（実行中に追加された宛先を含む）を書く
+static int write_targets(PingContext *ctx, int target) {
+  PingRecorder *rec = ctx->recorder;
+
+  while (rec->targets_written <= target) {
+    const PingTarget *t = &ctx->targets[rec->targets_written];
+    size_t name_len = t->hostname ? strlen(t->hostname) : 0;
+    if (name_len > RECORD_MAX_NAME) {
+      name_len = RECORD_MAX_NAME;
+    }
+    unsigned char *p = reserve(ctx, 16 + t->ip_len + name_len);
+    if (!p) {
+      return -1;
+    }
+    unsigned char *start = p;
+    *p++ = PING_RECORD_TARGET;
+    p = put_varint(p, rec->targets_written);
+    p = put_varint(p, t->ip_len);
+    memcpy(p, t->ip, t->ip_len);
+    p += t->ip_len;
+    p = put_varint(p, name_len);
+    memcpy(p, t->hostname, name_len);
+    p += name_len;
+    rec->used += p - start;
+    rec->targets_written++;
+  }
+  return 0;
+}
+
+// 送信のレコードの共通部分（種類・送信番号の差・送信時刻の差）を書く
+static unsigned char *begin_probe(PingContext *ctx, PingRecordKind kind,
+                                  long long number, const PingSeqSlot *slot) {
+  PingRecorder *rec = ctx->recorder;
+  if (write_targets(ctx, slot->target) < 0) {
+    return NULL;
+  }
+  unsigned char *p = reserve(ctx, RECORD_MAX_PROBE);
+  if (!p) {
+    return NULL;
+  }
+  long long send_ns = timespec_ns(&slot->sent_time);
+  *p++ = kind;
+  p = put_varint(p, zigzag(number - rec->prev_number));
+  p = put_varint(p, zigzag(send_ns - rec->prev_send_ns));
+  rec->prev_number = number;
+  rec->prev_send_ns = send_ns;
+  return p;
+}
+
+int start_recording(PingContext *ctx, long long clock_offset_ns) {
+  char path[4096];
+
+  if (!ctx->record_path) {
+    return 0;
+  }
+  if (ctx->worker_id >= 0) {
+    snprintf(path, sizeof(path), "%s.%d", ctx->record_path, ctx->worker_id);
+  } else {
+    snprintf(path, sizeof(path), "%s", ctx->record_path);
+  }
+
+  PingRecorder *rec = calloc(1, sizeof(PingRecorder));
+  if (!rec) {
+    fprintf(stderr, "ft_ping: out of memory\n");
+    return -1;
+  }
+  rec->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (rec->fd < 0) {
+    fprintf(stderr, "ft_ping: %s: %s\n", path, strerror(errno));
+    free(rec);
+    return -1;
+  }
+  if (advance_window(rec) < 0) {
+    close(rec->fd);
+    free(rec);
+    return -1;
+  }
+
+  unsigned char *h = rec->map;
+  memcpy(h, PING_RECORD_MAGIC, 8);
+  put_le(h + 8, PING_RECORD_VERSION, 4);
+  put_le(h + 12, ctx->data_size, 4);
+  put_le(h + 16, (unsigned long long)clock_offset_ns, 8);
+  put_le(h + 24, (unsigned long long)(ctx->linger * 1000.0), 4);
+  put_le(h + 28, ctx->ident & 0xFFFF, 4);
+  rec->used = PING_RECORD_HEADER_SIZE;
+  ctx->recorder = rec;
+  return 0;
+}
+
+void record_reply(PingContext *ctx, PingRecordKind kind, long long number,
+                  const PingSeqSlot *slot, double rtt, int ttl, int icmp_len) {
+  unsigned char *p = begin_probe(ctx, kind, number, slot);
+  if (!p) {
+    return;
+  }
+  unsigned char *start = ctx->recorder->map + ctx->recorder->used;
+  p = put_varint(p, zigzag(llround(rtt * 1000000.0)));
+  *p++ = (unsigned char)ttl;
+  p = put_varint(p, icmp_len);
+  p = put_varint(p, slot->target);
+  ctx->recorder->used += p - start;
+}
+
+void record_lost(PingContext *ctx, PingRecordKind kind, long long number,
+                 const PingSeqSlot *slot) {
+  unsigned char *p = begin_probe(ctx, kind, number, slot);
+  if (!p) {
+    return;
+  }
+  unsigned char *start = ctx->recorder->map + ctx->recorder->used;
+  p = put_varint(p, slot->target);
+  ctx->recorder->used += p - start;
+}
+
+void record_late(PingContext *ctx) {
+  unsigned char *p = reserve(ctx, 1);
+  if (p) {
+    *p = PING_RECORD_LATE;
+    ctx->recorder->used++;
+  }
+}
+
+void stop_recording(PingContext *ctx) {
+  PingRecorder *rec = ctx->recorder;
+  if (!rec) {
+    return;
+  }
+  // 終了時に応答を待っていた送信は、送信番号の順に書く
+  // 途中で書き込みに失敗した場合は、reserveから呼んだstop_recordingが閉じ終えている
+  if (rec->map) {
+    long long first = ctx->packets_sent > ctx->window.size
+                          ? ctx->packets_sent - ctx->window.size
+                          : 0;
+    for (long long number = first; number < ctx->packets_sent && ctx->recorder;
+         number++) {
+      int index = seq_slot_index(&ctx->window, number);
+      if (timer_wheel_pending(&ctx->wheel, index) &&
+          ctx->window.slots[index].number == number) {
+        record_lost(ctx, PING_RECORD_UNANSWERED, number,
+                    &ctx->window.slots[index]);
+      }
+    }
+  }
+  if (!ctx->recorder) {
+    return;
+  }
+  ctx->recorder = NULL;
+  size_t length = rec->map_offset + rec->used;
+  if (rec->map) {
+    munmap(rec->map, rec->map_size);
+  }
+  if (ftruncate(rec->fd, (off_t)length) < 0) {
+    perror("ft_ping: record: ftruncate failed");
+  }
+  close(rec->fd);
+  free(rec);
+}
+
+// 読み込み中の位置
+typedef struct {
+  const unsigned char *p;
+  const unsigned char *end;
+  int error;
+} RecordCursor;
+
+static unsigned long long get_varint(RecordCursor *c) {
+  unsigned long long value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (c->p >= c->end) {
+      c->error = 1;
+      return 0;
+    }
+    unsigned char byte = *c->p++;
+    value |= (unsigned long long)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  c->error = 1;
+  return 0;
+}
+
+// TARGETレコードの宛先を、IPとホスト名が同じctxの宛先に対応付ける（なければ追加する）
+static int merge_target(PingContext *ctx, RecordCursor *c) {
+  char ip[INET_ADDRSTRLEN];
+  char name[RECORD_MAX_NAME + 1];
+
+  get_varint(c); // 宛先番号は書いた順なので、対応表の位置で分かる
+  size_t ip_len = get_varint(c);
+  if (c->error || ip_len >= sizeof(ip) || (size_t)(c->end - c->p) < ip_len) {
+    return -1;
+  }
+  memcpy(ip, c->p, ip_len);
+  ip[ip_len] = '\0';
+  c->p += ip_len;
+  size_t name_len = get_varint(c);
+  if (c->error || name_len > RECORD_MAX_NAME ||
+      (size_t)(c->end - c->p) < name_len) {
+    return -1;
+  }
+  memcpy(name, c->p, name_len);
+  name[name_len] = '\0';
+  c->p += name_len;
+
+  for (int i = 0; i < ctx->target_count; i++) {
+    if (strcmp(ctx->targets[i].ip, ip) == 0 &&
+        strcmp(ctx->targets[i].hostname, name) == 0) {
+      return i;
+    }
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+    return -1;
+  }
+  return add_resolved_target(ctx, name, &addr);
+}
+
+long read_record_file(PingContext *ctx, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "ft_ping: %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < PING_RECORD_HEADER_SIZE) {
+    fprintf(stderr, "ft_ping: %s: not a ft_ping record file\n", path);
+    close(fd);
+    return -1;
+  }
+  const unsigned char *data =
+      mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("ft_ping: mmap failed");
+    return -1;
+  }
+  madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+  if (memcmp(data, PING_RECORD_MAGIC, 8) != 0 ||
+      get_le(data + 8, 4) != PING_RECORD_VERSION) {
+    fprintf(stderr, "ft_ping: %s: not a ft_ping record file\n", path);
+    munmap((void *)data, st.st_size);
+    return -1;
+  }
+  ctx->data_size = (int)get_le(data + 12, 4);
+  ctx->linger = get_le(data + 24, 4) / 1000.0;
+
+  // ファイル内の宛先番号 → ctxの宛先番号
+  int *targets = NULL;
+  int target_count = 0;
+  long records = 0;
+  RecordCursor c = {data + PING_RECORD_HEADER_SIZE, data + st.st_size, 0};
+
+  while (c.p < c.end && *c.p != 0) {
+    int kind = *c.p++;
+    if (kind == PING_RECORD_TARGET) {
+      int *grown = realloc(targets, (target_count + 1) * sizeof(int));
+      if (!grown) {
+        c.error = 1;
+        break;
+      }
+      targets = grown;
+      targets[target_count] = merge_target(ctx, &c);
+      if (targets[target_count] < 0) {
+        c.error = 1;
+        break;
+      }
+      target_count++;
+      records++;
+      continue;
+    }
+    if (kind == PING_RECORD_LATE) {
+      ctx->packets_late++;
+      records++;
+      continue;
+    }
+    if (kind < PING_RECORD_REPLY || kind > PING_RECORD_UNANSWERED) {
+      c.error = 1;
+      break;
+    }
+
+    // 送信番号と送信時刻は統計に使わないので読み飛ばす
+    get_varint(&c);
+    get_varint(&c);
+    double rtt = 0.0;
+    if (kind <= PING_RECORD_DUPLICATE) {
+      rtt = unzigzag(get_varint(&c)) / 1000000.0;
+      c.p++; // TTL
+      get_varint(&c);
+    }
+    unsigned long long target = get_varint(&c);
+    if (c.error || c.p > c.end || target >= (unsigned long long)target_count) {
+      c.error = 1;
+      break;
+    }
+    PingTarget *t = &ctx->targets[targets[target]];
+
+    switch (kind) {
+    case PING_RECORD_REPLY:
+    case PING_RECORD_LATE_REPLY:
+      if (kind == PING_RECORD_REPLY) {
+        ctx->packets_sent++;
+        t->packets_sent++;
+      }
+      count_reply(ctx, t, rtt);
+      break;
+    case PING_RECORD_DUPLICATE:
+      ctx->packets_duplicate++;
+      t->packets_duplicate++;
+      break;
+    case PING_RECORD_LOST:
+      ctx->packets_timeout++;
+      // fall through
+    default:
+      ctx->packets_sent++;
+      t->packets_sent++;
+      break;
+    }
+    records++;
+  }
+
+  if (c.error) {
+    fprintf(stderr, "ft_ping: %s: corrupt record at offset %ld\n", path,
+            (long)(c.p - data));
+  }
+  free(targets);
+  munmap((void *)data, st.st_size);
+  return records;
+}
@@ -7,14 +7,30 @@
 
 // ping_resolve.c: ホスト名をIPアドレスに解決する処理を担当するファイル
 // IPアドレス文字列かどうか判定し、ホスト名の場合はDNS解決を行う
-int resolve_hostname(PingContext *ctx, const char *hostname) {
+
+#define MAX_HOSTNAME_LEN 255
+
+static int copy_hostname(PingTarget *target, const char *hostname) {
+  if (strlen(hostname) > MAX_HOSTNAME_LEN) {
+    printf("ft_ping: hostname string too long\n");
+    return -1;
+  }
+  free(target->hostname);
+  target->hostname = strdup(hostname);
+  if (!target->hostname) {
+    printf("ft_ping: out of memory\n");
+    return -1;
+  }
+  return 0;
+}
+
+int resolve_hostname(PingTarget *target, const char *hostname) {
   // 入力パラメータの検証
-  if (!ctx || !hostname || strlen(hostname) == 0) {
+  if (!target || !hostname || strlen(hostname) == 0) {
     return -1;
   }
 
-  // dest_addrをstruct sockaddr_inとして適切にキャスト
-  struct sockaddr_in *sin = (struct sockaddr_in *)&ctx->dest_addr;
+  struct sockaddr_in *sin = &target->addr;
 
   // sockaddr_in構造体を初期化
   memset(sin, 0, sizeof(struct sockaddr_in));
@@ -24,20 +40,14 @@ int resolve_hostname(PingContext *ctx, const char *hostname) {
   if (inet_pton(AF_INET, hostname, &sin->sin_addr) == 1) {
     // IPアドレス形式の場合
     // 安全な文字列コピー（snprintf使用）
-    int ret = snprintf(ctx->dest_ip, sizeof(ctx->dest_ip), "%s", hostname);
-    if ((size_t)ret >= sizeof(ctx->dest_ip) || ret < 0) {
+    int ret = snprintf(target->ip, sizeof(target->ip), "%s", hostname);
+    if ((size_t)ret >= sizeof(target->ip) || ret < 0) {
       printf("ft_ping: IP address string too long\n");
       return -1;
     }
+    target->ip_len = ret;
 
-    ret = snprintf(ctx->dest_hostname, sizeof(ctx->dest_hostname), "%s",
-                   hostname);
-    if ((size_t)ret >= sizeof(ctx->dest_hostname) || ret < 0) {
-      printf("ft_ping: hostname string too long\n");
-      return -1;
-    }
-
-    return 0;
+    return copy_hostname(target, hostname);
   }
 
   // ホスト名をDNSで解決
@@ -71,27 +81,27 @@ int resolve_hostname(PingContext *ctx, const char *hostname) {
   }
 
   // 安全なメモリコピー
-  memcpy(sin, res->ai_addr, sizeof(struct sockaddr_in));
+  struct sockaddr_in resolved;
+  memcpy(&resolved, res->ai_addr, sizeof(struct sockaddr_in));
+
+  // メモリリーク防止のため必ずfreeaddrinfoを呼び出す
+  freeaddrinfo(res);
+
+  return set_target_address(target, hostname, &resolved);
+}
+
+int set_target_address(PingTarget *target, const char *hostname,
+                       const struct sockaddr_in *addr) {
+  memcpy(&target->addr, addr, sizeof(struct sockaddr_in));
 
   // IPアドレス文字列を安全に作成
-  if (inet_ntop(AF_INET, &sin->sin_addr, ctx->dest_ip, sizeof(ctx->dest_ip)) ==
-      NULL) {
+  if (inet_ntop(AF_INET, &target->addr.sin_addr, target->ip,
+                sizeof(target->ip)) == NULL) {
     printf("ft_ping: inet_ntop failed\n");
-    freeaddrinfo(res);
     return -1;
   }
+  target->ip_len = (int)strlen(target->ip);
 
   // ホスト名を安全にコピー
-  int ret =
-      snprintf(ctx->dest_hostname, sizeof(ctx->dest_hostname), "%s", hostname);
-  if ((size_t)ret >= sizeof(ctx->dest_hostname) || ret < 0) {
-    printf("ft_ping: hostname string too long\n");
-    freeaddrinfo(res);
-    return -1;
-  }
-
-  // メモリリーク防止のため必ずfreeaddrinfoを呼び出す
-  freeaddrinfo(res);
-
-  return 0;
+  return copy_hostname(target, hostname);
 }
@@ -0,0 +1,434 @@
+#include "ping_resolver.h"
+
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <errno.h>
+#include <resolv.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// ping_resolver.c: 多数のホスト名を並列に解決するワーカープールを担当するファイル
+// getaddrinfoは1件ずつ応答を待つので、宛先が多いと起動時間のほとんどが名前解決になる
+// 名前をジョブとして並べ、最大concurrency個のワーカースレッドが並列に解決する
+// 解決できた宛先から送信を始められるよう、結果は終えた順にeventfdで知らせる
+// --dns-cacheでは解決結果をDNSのTTLの間ファイルに残し、次回の起動では解決を待たずに使う
+
+#define CACHE_LINE_MAX 512
+#define CACHE_NAME_MAX 255
+
+// DNSの応答からTTLを得る（CNAMEを含む応答レコードのTTLの最小値）
+// /etc/hostsの名前などDNSで引けない場合は-1
+static long query_ttl(const char *name) {
+  struct __res_state state;
+  unsigned char answer[NS_PACKETSZ];
+  ns_msg msg;
+  long ttl = -1;
+
+  memset(&state, 0, sizeof(state));
+  if (res_ninit(&state) < 0) {
+    return -1;
+  }
+  // getaddrinfoと同じく検索ドメインを付けて引く
+  int len = res_nsearch(&state, name, ns_c_in, ns_t_a, answer, sizeof(answer));
+  if (len > 0 && ns_initparse(answer, len, &msg) == 0) {
+    int count = ns_msg_count(msg, ns_s_an);
+    for (int i = 0; i < count; i++) {
+      ns_rr rr;
+      if (ns_parserr(&msg, ns_s_an, i, &rr) == 0 &&
+          (ttl < 0 || (long)ns_rr_ttl(rr) < ttl)) {
+        ttl = (long)ns_rr_ttl(rr);
+      }
+    }
+  }
+  res_nclose(&state);
+  return ttl;
+}
+
+static void resolve_job(PingResolveJob *job) {
+  struct addrinfo hints, *res = NULL;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_RAW;
+  hints.ai_protocol = IPPROTO_ICMP;
+
+  job->error = getaddrinfo(job->name, NULL, &hints, &res);
+  if (job->error == 0) {
+    if (res && res->ai_addr->sa_family == AF_INET &&
+        res->ai_addrlen == sizeof(struct sockaddr_in)) {
+      memcpy(&job->addr, res->ai_addr, sizeof(struct sockaddr_in));
+    } else {
+      job->error = EAI_NODATA;
+    }
+  }
+  freeaddrinfo(res);
+}
+
+static void notify_done(PingResolver *resolver) {
+  uint64_t one = 1;
+  if (write(resolver->event_fd, &one, sizeof(one)) < 0) {
+    perror("ft_ping: eventfd write failed");
+  }
+}
+
+// 名前を全て解決してから、解決を終えた順にキャッシュに書くTTLを問い合わせる
+// TTLは書き戻すときにだけ使うので、問い合わせを待たずに次の名前の解決と送信を進める
+static void *resolver_main(void *arg) {
+  PingResolver *resolver = arg;
+
+  for (;;) {
+    pthread_mutex_lock(&resolver->lock);
+    int index, resolve;
+    if (!resolver->stopping && resolver->next_job < resolver->job_count) {
+      index = resolver->next_job++;
+      resolve = 1;
+    } else if (resolver->next_ttl < resolver->done_count) {
+      index = resolver->done[resolver->next_ttl++];
+      resolve = 0;
+    } else {
+      pthread_mutex_unlock(&resolver->lock);
+      break;
+    }
+    pthread_mutex_unlock(&resolver->lock);
+
+    PingResolveJob *job = &resolver->jobs[index];
+    if (resolve) {
+      resolve_job(job);
+      pthread_mutex_lock(&resolver->lock);
+      resolver->done[resolver->done_count++] = index;
+      if (job->error == 0 && resolver->cache_path) {
+        resolver->ttl_pending++;
+      }
+      pthread_mutex_unlock(&resolver->lock);
+      notify_done(resolver);
+    } else if (job->error == 0 && resolver->cache_path) {
+      // getaddrinfoはTTLを返さないので、キャッシュに書くときだけDNSに問い合わせる
+      long ttl = query_ttl(job->name);
+      pthread_mutex_lock(&resolver->lock);
+      job->ttl = ttl < 0 ? PING_DNS_DEFAULT_TTL : ttl;
+      resolver->ttl_pending--;
+      pthread_mutex_unlock(&resolver->lock);
+      // TTLが揃ったらキャッシュを書き戻せるよう、もう一度知らせる
+      notify_done(resolver);
+    }
+  }
+  return NULL;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  const PingDnsCacheEntry *x = a;
+  const PingDnsCacheEntry *y = b;
+  return strcmp(x->name, y->name);
+}
+
+// キャッシュファイルを読み込む
+// 1行に「有効期限(UNIX時刻) IPアドレス ホスト名」を書き、期限切れの行は読み飛ばす
+// 形式の崩れた行や長すぎる行も、切り詰めた名前やアドレスで登録しないよう行ごと読み飛ばす
+static int load_cache(PingResolver *resolver) {
+  FILE *fp = fopen(resolver->cache_path, "r");
+  if (!fp) {
+    // 初回の実行ではまだファイルがない
+    if (errno == ENOENT) {
+      return 0;
+    }
+    fprintf(stderr, "ft_ping: %s: ", resolver->cache_path);
+    perror(NULL);
+    return -1;
+  }
+
+  long long now = (long long)time(NULL);
+  int capacity = 0;
+  char line[CACHE_LINE_MAX];
+  while (fgets(line, sizeof(line), fp)) {
+    long long expires;
+    // 1文字長く読み、上限を超える値を切り詰めずに見分ける
+    char ip[INET_ADDRSTRLEN + 1];
+    char name[CACHE_NAME_MAX + 2];
+    struct in_addr addr;
+
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] != '\n' && !feof(fp)) {
+      // バッファに収まらない行は、残りを読み捨てる
+      int c;
+      while ((c = fgetc(fp)) != EOF && c != '\n') {
+      }
+      continue;
+    }
+    if (sscanf(line, "%lld %16s %256s", &expires, ip, name) != 3 ||
+        strlen(name) > CACHE_NAME_MAX || expires <= now ||
+        inet_pton(AF_INET, ip, &addr) != 1) {
+      continue;
+    }
+    if (resolver->cache_count >= capacity) {
+      int new_capacity = capacity > 0 ? capacity * 2 : 64;
+      PingDnsCacheEntry *entries =
+          realloc(resolver->cache, new_capacity * sizeof(PingDnsCacheEntry));
+      if (!entries) {
+        break;
+      }
+      resolver->cache = entries;
+      capacity = new_capacity;
+    }
+    PingDnsCacheEntry *entry = &resolver->cache[resolver->cache_count];
+    entry->name = strdup(name);
+    if (!entry->name) {
+      break;
+    }
+    entry->addr = addr;
+    entry->expires = expires;
+    resolver->cache_count++;
+  }
+  fclose(fp);
+
+  // 名前で二分探索できるよう並べ、同じ名前は期限の遅いものだけ残す
+  qsort(resolver->cache, resolver->cache_count, sizeof(PingDnsCacheEntry),
+        compare_entries);
+  int kept = 0;
+  for (int i = 0; i < resolver->cache_count; i++) {
+    PingDnsCacheEntry *entry = &resolver->cache[i];
+    if (kept > 0 && strcmp(resolver->cache[kept - 1].name, entry->name) == 0) {
+      if (entry->expires > resolver->cache[kept - 1].expires) {
+        resolver->cache[kept - 1].addr = entry->addr;
+        resolver->cache[kept - 1].expires = entry->expires;
+      }
+      free(entry->name);
+      continue;
+    }
+    resolver->cache[kept++] = *entry;
+  }
+  resolver->cache_count = kept;
+  return 0;
+}
+
+PingResolver *create_resolver(int concurrency, const char *cache_path) {
+  PingResolver *resolver = calloc(1, sizeof(PingResolver));
+  if (!resolver) {
+    return NULL;
+  }
+  resolver->concurrency =
+      concurrency > 0 ? concurrency : PING_RESOLVE_CONCURRENCY;
+  resolver->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (resolver->event_fd < 0) {
+    perror("ft_ping: eventfd failed");
+    free(resolver);
+    return NULL;
+  }
+  pthread_mutex_init(&resolver->lock, NULL);
+  if (cache_path) {
+    resolver->cache_path = strdup(cache_path);
+    // 読めないキャッシュは使わずに、全て解決する
+    if (!resolver->cache_path || load_cache(resolver) < 0) {
+      free(resolver->cache_path);
+      resolver->cache_path = NULL;
+    }
+  }
+  return resolver;
+}
+
+int resolver_lookup(const PingResolver *resolver, const char *name,
+                    struct sockaddr_in *addr) {
+  PingDnsCacheEntry key;
+
+  if (!resolver || resolver->cache_count == 0) {
+    return 0;
+  }
+  key.name = (char *)name;
+  const PingDnsCacheEntry *entry =
+      bsearch(&key, resolver->cache, resolver->cache_count,
+              sizeof(PingDnsCacheEntry), compare_entries);
+  if (!entry || entry->expires <= (long long)time(NULL)) {
+    return 0;
+  }
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr = entry->addr;
+  return 1;
+}
+
+int resolver_add(PingResolver *resolver, const char *name) {
+  if (resolver->job_count >= resolver->job_capacity) {
+    int new_capacity =
+        resolver->job_capacity > 0 ? resolver->job_capacity * 2 : 16;
+    PingResolveJob *jobs =
+        realloc(resolver->jobs, new_capacity * sizeof(PingResolveJob));
+    if (!jobs) {
+      return -1;
+    }
+    resolver->jobs = jobs;
+    resolver->job_capacity = new_capacity;
+  }
+  PingResolveJob *job = &resolver->jobs[resolver->job_count];
+  memset(job, 0, sizeof(*job));
+  job->name = strdup(name);
+  if (!job->name) {
+    return -1;
+  }
+  resolver->job_count++;
+  return 0;
+}
+
+int start_resolver(PingResolver *resolver) {
+  if (resolver->job_count == 0) {
+    return 0;
+  }
+  resolver->done = malloc(resolver->job_count * sizeof(int));
+  int threads = resolver->concurrency < resolver->job_count
+                    ? resolver->concurrency
+                    : resolver->job_count;
+  resolver->threads = malloc(threads * sizeof(pthread_t));
+  if (!resolver->done || !resolver->threads) {
+    fprintf(stderr, "ft_ping: out of memory\n");
+    return -1;
+  }
+
+  // SIGINTなどはメインスレッドで受け取るよう、ワーカーではブロックしておく
+  sigset_t block, orig;
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTERM);
+  sigaddset(&block, SIGQUIT);
+  pthread_sigmask(SIG_BLOCK, &block, &orig);
+  for (int i = 0; i < threads; i++) {
+    int err = pthread_create(&resolver->threads[i], NULL, resolver_main,
+                             resolver);
+    if (err != 0) {
+      // 起動できたワーカーだけで全てのジョブを解決する
+      fprintf(stderr, "ft_ping: pthread_create failed: %s\n", strerror(err));
+      break;
+    }
+    resolver->thread_count++;
+  }
+  pthread_sigmask(SIG_SETMASK, &orig, NULL);
+  return resolver->thread_count > 0 ? 0 : -1;
+}
+
+int resolver_pending(const PingResolver *resolver) {
+  return resolver ? resolver->job_count - resolver->collected : 0;
+}
+
+PingResolveJob *resolver_next_result(PingResolver *resolver) {
+  PingResolveJob *job = NULL;
+
+  pthread_mutex_lock(&resolver->lock);
+  if (resolver->collected < resolver->done_count) {
+    job = &resolver->jobs[resolver->done[resolver->collected++]];
+    if (job->error == 0 && resolver->cache_path) {
+      resolver->cache_dirty = 1;
+    }
+  }
+  pthread_mutex_unlock(&resolver->lock);
+  return job;
+}
+
+// 1件をキャッシュの形式で書く
+static void write_cache_line(FILE *fp, long long expires, struct in_addr addr,
+                             const char *name) {
+  char ip[INET_ADDRSTRLEN];
+
+  if (inet_ntop(AF_INET, &addr, ip, sizeof(ip))) {
+    fprintf(fp, "%lld %s %s\n", expires, ip, name);
+  }
+}
+
+int save_resolver_cache(PingResolver *resolver) {
+  if (!resolver || !resolver->cache_dirty) {
+    return 0;
+  }
+  // TTLを問い合わせ中の名前があれば、揃ってから書く（終了時は揃った分だけ書く）
+  pthread_mutex_lock(&resolver->lock);
+  int waiting = resolver->ttl_pending > 0 && !resolver->stopping;
+  pthread_mutex_unlock(&resolver->lock);
+  if (waiting) {
+    return 0;
+  }
+  resolver->cache_dirty = 0;
+
+  // 途中で止まっても壊れたファイルを残さないよう、別名で書いてから置き換える
+  size_t path_len = strlen(resolver->cache_path) + sizeof(".tmp");
+  char *tmp_path = malloc(path_len);
+  if (!tmp_path) {
+    return -1;
+  }
+  snprintf(tmp_path, path_len, "%s.tmp", resolver->cache_path);
+  FILE *fp = fopen(tmp_path, "w");
+  if (!fp) {
+    fprintf(stderr, "ft_ping: %s: ", tmp_path);
+    perror(NULL);
+    free(tmp_path);
+    return -1;
+  }
+
+  long long now = (long long)time(NULL);
+  for (int i = 0; i < resolver->cache_count; i++) {
+    PingDnsCacheEntry *entry = &resolver->cache[i];
+    if (entry->expires > now) {
+      write_cache_line(fp, entry->expires, entry->addr, entry->name);
+    }
+  }
+  // キャッシュになかった名前だけを解決しているので、読み込んだ行と重ならない
+  // TTLをまだ得ていない名前（ttlが0）は書かず、次回にまた解決する
+  pthread_mutex_lock(&resolver->lock);
+  for (int i = 0; i < resolver->collected; i++) {
+    PingResolveJob *job = &resolver->jobs[resolver->done[i]];
+    if (job->error == 0 && job->ttl > 0) {
+      write_cache_line(fp, now + job->ttl, job->addr.sin_addr, job->name);
+    }
+  }
+  pthread_mutex_unlock(&resolver->lock);
+
+  int ret = 0;
+  if (fclose(fp) != 0 || rename(tmp_path, resolver->cache_path) < 0) {
+    fprintf(stderr, "ft_ping: %s: ", resolver->cache_path);
+    perror(NULL);
+    unlink(tmp_path);
+    ret = -1;
+  }
+  free(tmp_path);
+  return ret;
+}
+
+void close_resolver(PingResolver *resolver) {
+  if (!resolver) {
+    return;
+  }
+  // まだ取り出していない名前は解決しない
+  pthread_mutex_lock(&resolver->lock);
+  resolver->stopping = 1;
+  int busy = resolver->next_job - resolver->done_count;
+  pthread_mutex_unlock(&resolver->lock);
+  // 受け取る前に終えた結果もキャッシュには残す
+  while (resolver_next_result(resolver)) {
+  }
+  if (busy > 0) {
+    // 応答のないDNSサーバではgetaddrinfoが返るまで数十秒かかり、Ctrl-Cで止まらなくなる
+    // 終了間際に呼ばれるので、解決中のワーカーは待たずに切り離し、プールは解放しない
+    // TTLを得た名前だけをキャッシュに書く
+    save_resolver_cache(resolver);
+    for (int i = 0; i < resolver->thread_count; i++) {
+      pthread_detach(resolver->threads[i]);
+    }
+    return;
+  }
+  // 解決できた名前はDNSサーバが応答しているので、残りのTTLの問い合わせを待ってから書く
+  for (int i = 0; i < resolver->thread_count; i++) {
+    pthread_join(resolver->threads[i], NULL);
+  }
+  save_resolver_cache(resolver);
+
+  for (int i = 0; i < resolver->job_count; i++) {
+    free(resolver->jobs[i].name);
+  }
+  for (int i = 0; i < resolver->cache_count; i++) {
+    free(resolver->cache[i].name);
+  }
+  free(resolver->jobs);
+  free(resolver->done);
+  free(resolver->threads);
+  free(resolver->cache);
+  free(resolver->cache_path);
+  close(resolver->event_fd);
+  pthread_mutex_destroy(&resolver->lock);
+  free(resolver);
+}
@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include "ping_rx.h"
+
+#include <linux/errqueue.h>
+
+// ping_rx.c: ICMPパケットの受信バッファを管理するファイル
+// 受信バッファとrecvmmsg用のメッセージ配列を起動時に確保しておき、
+// ソケットに溜まったパケットを1回のシステムコールでまとめて読み出す
+
+int init_rx_engine(PingRxEngine *rx, size_t buffer_size) {
+  if (!rx) {
+    return -1;
+  }
+
+  memset(rx, 0, sizeof(*rx));
+  rx->buffer_size = buffer_size < PING_RX_BUFSIZE ? PING_RX_BUFSIZE : buffer_size;
+  rx->buffers = malloc((size_t)PING_RX_BATCH * rx->buffer_size);
+  if (!rx->buffers) {
+    return -1;
+  }
+
+  for (int i = 0; i < PING_RX_BATCH; i++) {
+    rx->iovs[i].iov_base = rx->buffers + (size_t)i * rx->buffer_size;
+    rx->iovs[i].iov_len = rx->buffer_size;
+    rx->msgs[i].msg_hdr.msg_iov = &rx->iovs[i];
+    rx->msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  return 0;
+}
+
+int receive_batch(PingRxEngine *rx, int sock_fd, int flags) {
+  // 受信済みのパケットをノンブロッキングで最大PING_RX_BATCH個読み出す
+  // flagsにMSG_ERRQUEUEを指定するとエラーキュー(送信タイムスタンプ)を読む
+  // 戻り値: 受信したパケット数, -1=エラー(errnoを参照)
+  for (int i = 0; i < PING_RX_BATCH; i++) {
+    // recvmmsgが書き換えるフィールドを毎回初期化する
+    rx->msgs[i].msg_hdr.msg_name = &rx->addrs[i];
+    rx->msgs[i].msg_hdr.msg_namelen = sizeof(rx->addrs[i]);
+    rx->msgs[i].msg_hdr.msg_control = rx->control[i];
+    rx->msgs[i].msg_hdr.msg_controllen = PING_RX_CONTROL_SIZE;
+    rx->msgs[i].msg_hdr.msg_flags = 0;
+  }
+
+  int count = recvmmsg(sock_fd, rx->msgs, PING_RX_BATCH, MSG_DONTWAIT | flags,
+                       NULL);
+  if (!(flags & MSG_ERRQUEUE)) {
+    rx->syscalls++;
+    if (count > 0) {
+      rx->packets += count;
+    }
+  }
+  return count;
+}
+
+int rx_kernel_timestamp(PingRxEngine *rx, int index, struct timespec *ts) {
+  // 受信したパケットの制御メッセージからカーネルのタイムスタンプを取り出す
+  // SO_TIMESTAMPINGではソフトウェアタイムスタンプがts[0]に入る
+  // 戻り値: 0=取得, -1=タイムスタンプなし
+  struct msghdr *msg = &rx->msgs[index].msg_hdr;
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET) {
+      continue;
+    }
+    if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+      struct scm_timestamping tss;
+      memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+      if (tss.ts[0].tv_sec == 0 && tss.ts[0].tv_nsec == 0) {
+        continue;
+      }
+      *ts = tss.ts[0];
+      return 0;
+    }
+    if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      memcpy(ts, CMSG_DATA(cmsg), sizeof(*ts));
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int rx_ttl(PingRxEngine *rx, int index) {
+  // IP_RECVTTLで受け取ったTTLを制御メッセージから取り出す
+  // 戻り値: TTL, -1=TTLなし
+  struct msghdr *msg = &rx->msgs[index].msg_hdr;
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TTL) {
+      int ttl;
+      memcpy(&ttl, CMSG_DATA(cmsg), sizeof(ttl));
+      return ttl;
+    }
+  }
+  return -1;
+}
+
+unsigned char *rx_buffer(PingRxEngine *rx, int index) {
+  // io_uringでは登録したバッファの中を指すので、iovecから引く
+  return rx->iovs[index].iov_base;
+}
+
+void close_rx_engine(PingRxEngine *rx) {
+  if (rx) {
+    free(rx->buffers);
+    rx->buffers = NULL;
+  }
+}
@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include "ping_sched.h"
+
+#include <sys/prctl.h>
+
+// ping_sched.c: 送信タイミングを管理するファイル
+// 送信期限をCLOCK_MONOTONICの絶対時刻で保持し、timerfdに設定する
+// 期限は前回の期限に間隔を足して求めるため、処理遅延が累積しない(ドリフトしない)
+
+#define NSEC_PER_SEC 1000000000L
+
+void timespec_add(struct timespec *ts, const struct timespec *delta) {
+  ts->tv_sec += delta->tv_sec;
+  ts->tv_nsec += delta->tv_nsec;
+  if (ts->tv_nsec >= NSEC_PER_SEC) {
+    ts->tv_sec++;
+    ts->tv_nsec -= NSEC_PER_SEC;
+  }
+}
+
+int timespec_cmp(const struct timespec *a, const struct timespec *b) {
+  if (a->tv_sec != b->tv_sec) {
+    return a->tv_sec < b->tv_sec ? -1 : 1;
+  }
+  if (a->tv_nsec != b->tv_nsec) {
+    return a->tv_nsec < b->tv_nsec ? -1 : 1;
+  }
+  return 0;
+}
+
+void timespec_from_seconds(struct timespec *ts, double seconds) {
+  ts->tv_sec = (time_t)seconds;
+  ts->tv_nsec = (long)((seconds - (double)ts->tv_sec) * NSEC_PER_SEC);
+  if (ts->tv_nsec >= NSEC_PER_SEC) {
+    ts->tv_sec++;
+    ts->tv_nsec -= NSEC_PER_SEC;
+  }
+}
+
+unsigned long long timespec_to_ms(const struct timespec *ts) {
+  return (unsigned long long)ts->tv_sec * 1000ULL +
+         (unsigned long long)ts->tv_nsec / 1000000ULL;
+}
+
+int init_scheduler(PingScheduler *sched, double interval) {
+  if (!sched || interval <= 0.0) {
+    return -1;
+  }
+
+  memset(sched, 0, sizeof(*sched));
+  timespec_from_seconds(&sched->interval, interval);
+
+  sched->timer_fd =
+      timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (sched->timer_fd < 0) {
+    perror("timerfd_create failed");
+    return -1;
+  }
+
+  // 1ms未満の間隔ではタイマースラック(既定50us)が送信遅れの大半を占めるため
+  // 最小値にしておく
+  if (interval < 0.001) {
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+  }
+  return 0;
+}
+
+void set_scheduler_interval(PingScheduler *sched, double interval) {
+  // 設定済みの次の送信期限はそのままにし、その次の送信から新しい間隔を使う
+  timespec_from_seconds(&sched->interval, interval);
+  if (interval < 0.001) {
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+  }
+}
+
+int arm_scheduler(PingScheduler *sched, const struct timespec *deadline) {
+  struct itimerspec its;
+
+  memset(&its, 0, sizeof(its));
+  its.it_value = *deadline;
+  // it_valueが0だとタイマー停止になるため、過去の時刻として1nsを使う
+  if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+    its.it_value.tv_nsec = 1;
+  }
+  if (timerfd_settime(sched->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+    perror("timerfd_settime failed");
+    return -1;
+  }
+  return 0;
+}
+
+void record_send_jitter(PingScheduler *sched, const struct timespec *now) {
+  // 予定した送信期限からの遅れ(マイクロ秒)を記録する
+  double late = (now->tv_sec - sched->next_deadline.tv_sec) * 1000000.0 +
+                (now->tv_nsec - sched->next_deadline.tv_nsec) / 1000.0;
+  if (late < 0.0) {
+    late = 0.0;
+  }
+  sched->jitter_count++;
+  sched->jitter_sum += late;
+  sched->jitter_sum2 += late * late;
+  if (sched->jitter_count == 1 || late < sched->jitter_min) {
+    sched->jitter_min = late;
+  }
+  if (sched->jitter_count == 1 || late > sched->jitter_max) {
+    sched->jitter_max = late;
+  }
+}
+
+void close_scheduler(PingScheduler *sched) {
+  if (sched && sched->timer_fd >= 0) {
+    close(sched->timer_fd);
+    sched->timer_fd = -1;
+  }
+}
+
+int create_report_timer(double interval) {
+  struct itimerspec its;
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    perror("timerfd_create failed");
+    return -1;
+  }
+
+  memset(&its, 0, sizeof(its));
+  timespec_from_seconds(&its.it_value, interval);
+  its.it_interval = its.it_value;
+  if (timerfd_settime(fd, 0, &its, NULL) < 0) {
+    perror("timerfd_settime failed");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
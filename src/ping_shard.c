@@ -0,0 +1,502 @@
+#include "ping_shard.h"
+#include "ping_engine.h"
+#include "ping_packet.h"
+#include "ping_profile.h"
+#include "ping_sched.h"
+#include "ping_signal.h"
+#include "ping_shared.h"
+#include "ping_stats.h"
+#include "ping_summary.h"
+#include "ping_window.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+// ping_shard.c:
+// 宛先を複数のワーカースレッドに分割して並列に送受信するファイル
+// 各ワーカーは専用のPingContext（ソケット・ICMP識別子・シーケンス番号・統計）を持ち、
+// 送受信中はスレッド間でロックもメモリも共有しない。統計は終了後にまとめて合算する
+// 実行中のレポートでは、メインスレッドがeventfdで要求し、各ワーカーが自分の統計の写しを渡す
+// 宛先ごとの統計もワーカーが担当する範囲を写して渡し、メインスレッドは写しだけを表示する
+
+// 宛先の統計の写し（--sweepのサイズごとの統計も写す）
+typedef struct {
+  PingTarget *targets;  // 宛先の配列
+  PingSweepStat *sweep; // 宛先ごとにsweep_count個ずつの--sweepの統計（NULL=--sweepなし）
+  int count;            // 宛先の数
+  int sweep_count;      // 宛先ごとの--sweepの統計の数
+} PingTargetCopy;
+
+typedef struct {
+  PingContext ctx;       // ワーカー専用のpingエンジン（先頭に置き、on_reportで戻せるようにする）
+  pthread_t thread;      // ワーカースレッド
+  pthread_t main_thread; // 異常終了を通知するメインスレッド
+  int cpu;               // 固定するCPU番号（-1=固定しない）
+  int result;            // run_ping_loopの戻り値
+  int done_fd;           // -c/-wで送受信を終えたことをメインスレッドへ知らせるeventfd
+  pthread_mutex_t lock;  // snapshotの受け渡し用
+  pthread_cond_t cond;   // snapshotの準備完了の通知用
+  int snapshot_ready;    // snapshotが要求後に更新されたか
+  int finished;          // 送受信を終えたか（snapshotは最終の統計）
+  PingContext snapshot;  // レポート要求時点のワーカーの統計の写し
+  PingTargetCopy snapshot_targets; // snapshotと同じ時点の担当する宛先の統計の写し
+  int first_target;      // 担当する宛先の先頭の番号
+} PingShard;
+
+static int alloc_target_copy(PingTargetCopy *copy, int count, int sweep_count) {
+  copy->count = count;
+  copy->sweep_count = sweep_count;
+  copy->targets = calloc(count, sizeof(PingTarget));
+  copy->sweep = NULL;
+  if (sweep_count > 0) {
+    copy->sweep = calloc((size_t)count * sweep_count, sizeof(PingSweepStat));
+  }
+  if (!copy->targets || (sweep_count > 0 && !copy->sweep)) {
+    return -1;
+  }
+  return 0;
+}
+
+static void free_target_copy(PingTargetCopy *copy) {
+  free(copy->targets);
+  free(copy->sweep);
+  copy->targets = NULL;
+  copy->sweep = NULL;
+}
+
+// src[0..copy->count)をcopyのfirst番目から写す
+// --sweepの統計は写しの側の領域へ写し、元の宛先と領域を共有しない
+static void copy_targets(PingTargetCopy *copy, int first, const PingTarget *src,
+                         int count) {
+  for (int i = 0; i < count; i++) {
+    PingTarget *dst = &copy->targets[first + i];
+    *dst = src[i];
+    if (src[i].sweep) {
+      dst->sweep = copy->sweep + (size_t)(first + i) * copy->sweep_count;
+      memcpy(dst->sweep, src[i].sweep,
+             copy->sweep_count * sizeof(PingSweepStat));
+    }
+  }
+}
+
+// ワーカーの統計をsnapshotへ写す（shard->lockを持って呼ぶ）
+static void take_snapshot(PingShard *shard) {
+  shard->snapshot = shard->ctx;
+  // -Xの計測値はワーカーが更新し続けるので写さない（終了後にまとめて合算する）
+  shard->snapshot.prof = NULL;
+  copy_targets(&shard->snapshot_targets, 0, shard->ctx.targets,
+               shard->ctx.target_count);
+}
+
+static void *shard_main(void *arg) {
+  PingShard *shard = arg;
+
+  if (shard->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(shard->cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0 && shard->ctx.verbose_mode) {
+      fprintf(stderr, "ft_ping: worker %d: cannot pin to cpu %d: %s\n",
+              shard->ctx.worker_id, shard->cpu, strerror(err));
+    }
+  }
+
+  shard->result = run_ping_loop(&shard->ctx);
+  if (shard->result < 0) {
+    // 他のワーカーも止めるため、メインスレッドに終了を通知する
+    pthread_kill(shard->main_thread, SIGTERM);
+  } else {
+    // 終了後のレポートには最終の統計を使う
+    pthread_mutex_lock(&shard->lock);
+    take_snapshot(shard);
+    shard->finished = 1;
+    pthread_cond_signal(&shard->cond);
+    pthread_mutex_unlock(&shard->lock);
+
+    uint64_t one = 1;
+    if (write(shard->done_fd, &one, sizeof(one)) < 0) {
+      perror("ft_ping: failed to notify worker completion");
+    }
+  }
+  return NULL;
+}
+
+// ワーカースレッドでレポート要求を受けたときの処理
+// 統計を写し、定期レポートの要求なら区間統計をリセットする
+static void shard_report(PingContext *ctx, unsigned long long request) {
+  PingShard *shard = (PingShard *)ctx;
+
+  pthread_mutex_lock(&shard->lock);
+  take_snapshot(shard);
+  if (request >= PING_REPORT_INTERVAL) {
+    reset_interval_stats(&ctx->interval);
+  }
+  shard->snapshot_ready = 1;
+  pthread_cond_signal(&shard->cond);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+// このプロセスが使えるCPU番号を列挙する
+static int list_cpus(int *cpus, int max) {
+  cpu_set_t set;
+  int count = 0;
+
+  if (sched_getaffinity(0, sizeof(set), &set) < 0) {
+    return 0;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++) {
+    if (CPU_ISSET(cpu, &set)) {
+      cpus[count++] = cpu;
+    }
+  }
+  return count;
+}
+
+// ワーカーの統計を合算する（宛先ごとの統計は宛先配列を共有しているので不要）
+static void merge_shard(PingContext *dst, const PingContext *src) {
+  dst->packets_sent += src->packets_sent;
+  dst->packets_received += src->packets_received;
+  dst->packets_duplicate += src->packets_duplicate;
+  dst->packets_late += src->packets_late;
+  dst->packets_timeout += src->packets_timeout;
+  dst->send_errors += src->send_errors;
+
+  if (src->rtt_count > 0) {
+    if (dst->rtt_count == 0 || src->rtt_min < dst->rtt_min) {
+      dst->rtt_min = src->rtt_min;
+    }
+    if (dst->rtt_count == 0 || src->rtt_max > dst->rtt_max) {
+      dst->rtt_max = src->rtt_max;
+    }
+    dst->rtt_count += src->rtt_count;
+    dst->rtt_sum += src->rtt_sum;
+    dst->rtt_sum2 += src->rtt_sum2;
+  }
+  histogram_merge(&dst->rtt_hist, &src->rtt_hist);
+
+  merge_rtt_stats(&dst->user_rtt, &src->user_rtt);
+  merge_rtt_stats(&dst->overhead, &src->overhead);
+  dst->kernel_tx_count += src->kernel_tx_count;
+
+  const PingScheduler *sched = &src->sched;
+  if (sched->jitter_count > 0) {
+    if (dst->sched.jitter_count == 0 || sched->jitter_min < dst->sched.jitter_min) {
+      dst->sched.jitter_min = sched->jitter_min;
+    }
+    if (dst->sched.jitter_count == 0 || sched->jitter_max > dst->sched.jitter_max) {
+      dst->sched.jitter_max = sched->jitter_max;
+    }
+    dst->sched.jitter_count += sched->jitter_count;
+    dst->sched.jitter_sum += sched->jitter_sum;
+    dst->sched.jitter_sum2 += sched->jitter_sum2;
+  }
+
+  dst->tx.probes += src->tx.probes;
+  dst->tx.syscalls += src->tx.syscalls;
+  dst->rx.packets += src->rx.packets;
+  dst->rx.syscalls += src->rx.syscalls;
+  // 表示するのはワーカーが実際に使った送受信の方法（io_uringを使えなければ0に戻っている）
+  dst->io_uring = src->io_uring;
+  merge_profile(dst, src);
+
+  if ((dst->start_time.tv_sec == 0 && dst->start_time.tv_nsec == 0) ||
+      src->start_time.tv_sec < dst->start_time.tv_sec ||
+      (src->start_time.tv_sec == dst->start_time.tv_sec &&
+       src->start_time.tv_nsec < dst->start_time.tv_nsec)) {
+    dst->start_time = src->start_time;
+  }
+}
+
+// ワーカーのPingContextを準備する
+// 宛先はctxの配列の一部をそのまま借りるので、宛先ごとの統計は直接ctxに入る
+static int setup_shard(PingShard *shard, const PingContext *ctx, int worker,
+                       int first, int last, int stop_fd, double interval) {
+  PingContext *wctx = &shard->ctx;
+
+  pthread_mutex_init(&shard->lock, NULL);
+  pthread_cond_init(&shard->cond, NULL);
+  shard->first_target = first;
+  if (alloc_target_copy(&shard->snapshot_targets, last - first,
+                        ctx->sweep_count) < 0) {
+    perror("ft_ping: failed to allocate target statistics");
+    return -1;
+  }
+  if (initialize_context(wctx) < 0) {
+    fprintf(stderr, "ft_ping: failed to initialize context\n");
+    return -1;
+  }
+  wctx->report_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (wctx->report_fd < 0) {
+    perror("ft_ping: eventfd failed");
+    return -1;
+  }
+  wctx->on_report = shard_report;
+  wctx->report_interval = ctx->report_interval;
+  // -cは宛先ごとの送信数なので、ワーカーは担当する宛先の分だけ送る
+  wctx->count = ctx->count;
+  wctx->deadline = ctx->deadline;
+  wctx->linger = ctx->linger;
+  wctx->verbose_mode = ctx->verbose_mode;
+  wctx->flood_mode = ctx->flood_mode;
+  wctx->preload = ctx->preload;
+  wctx->data_size = ctx->data_size;
+  wctx->sweep_min = ctx->sweep_min;
+  wctx->sweep_max = ctx->sweep_max;
+  wctx->sweep_step = ctx->sweep_step;
+  wctx->sweep_count = ctx->sweep_count;
+  wctx->kernel_timestamps = ctx->kernel_timestamps;
+  wctx->no_filter = ctx->no_filter;
+  wctx->io_uring = ctx->io_uring;
+  wctx->profile = ctx->profile;
+  wctx->socket_type = ctx->socket_type;
+  wctx->format = ctx->format;
+  wctx->quiet = ctx->quiet;
+  wctx->record_path = ctx->record_path;
+  wctx->stats_path = ctx->stats_path;
+  // ワーカーごとに識別子を変え、他のワーカー宛ての応答を区別する
+  wctx->ident = (ctx->ident + worker) & 0xFFFF;
+  wctx->worker_id = worker;
+  wctx->stop_fd = stop_fd;
+  wctx->targets = ctx->targets + first;
+  wctx->target_count = last - first;
+  wctx->target_capacity = last - first;
+  return setup_engine(wctx, interval);
+}
+
+static void cleanup_shard(PingShard *shard) {
+  // 最後の統計は宛先配列を手放す前に写す
+  close_shared_stats(&shard->ctx);
+  // 借りている宛先配列は解放しない
+  shard->ctx.targets = NULL;
+  shard->ctx.target_count = 0;
+  shard->ctx.target_capacity = 0;
+  if (shard->ctx.report_fd >= 0) {
+    close(shard->ctx.report_fd);
+    shard->ctx.report_fd = -1;
+  }
+  cleanup_context(&shard->ctx);
+  free_target_copy(&shard->snapshot_targets);
+  pthread_cond_destroy(&shard->cond);
+  pthread_mutex_destroy(&shard->lock);
+}
+
+// 実行中のワーカーに統計の写しを要求し、outへ合算する
+// 宛先ごとの統計はワーカーのロックを持ったままtargetsへ写し、outからはその写しを参照する
+// （ワーカーが更新し続けるctxの宛先配列は表示に使わない）
+// 終了済みなどで1秒以内に応答しないワーカーは合算しない
+static void collect_shards(PingShard *shards, int started, const PingContext *ctx,
+                           PingTargetCopy *targets, PingContext *out,
+                           uint64_t request) {
+  memset(out, 0, sizeof(*out));
+  out->verbose_mode = ctx->verbose_mode;
+  out->flood_mode = ctx->flood_mode;
+  out->data_size = ctx->data_size;
+  out->sweep_min = ctx->sweep_min;
+  out->sweep_max = ctx->sweep_max;
+  out->sweep_step = ctx->sweep_step;
+  out->sweep_count = ctx->sweep_count;
+  out->kernel_timestamps = ctx->kernel_timestamps;
+  out->format = ctx->format;
+  out->report_interval = ctx->report_interval;
+  out->linger = ctx->linger;
+  out->worker_id = -1;
+  // 応答しなかったワーカーの宛先は送信前の状態（統計0）として表示する
+  for (int i = 0; i < ctx->target_count; i++) {
+    PingTarget *target = &targets->targets[i];
+    memset(target, 0, sizeof(*target));
+    target->addr = ctx->targets[i].addr;
+    memcpy(target->ip, ctx->targets[i].ip, sizeof(target->ip));
+    target->ip_len = ctx->targets[i].ip_len;
+    target->hostname = ctx->targets[i].hostname;
+  }
+  out->targets = targets->targets;
+  out->target_count = ctx->target_count;
+
+  // 先に全ワーカーへ要求し、応答は並行して待つ（終了済みのワーカーには要求しない）
+  for (int w = 0; w < started; w++) {
+    pthread_mutex_lock(&shards[w].lock);
+    shards[w].snapshot_ready = 0;
+    int finished = shards[w].finished;
+    pthread_mutex_unlock(&shards[w].lock);
+    if (!finished &&
+        write(shards[w].ctx.report_fd, &request, sizeof(request)) < 0) {
+      perror("ft_ping: failed to request worker statistics");
+    }
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += 1;
+  for (int w = 0; w < started; w++) {
+    pthread_mutex_lock(&shards[w].lock);
+    while (!shards[w].snapshot_ready && !shards[w].finished &&
+           pthread_cond_timedwait(&shards[w].cond, &shards[w].lock,
+                                  &deadline) == 0) {
+    }
+    // 照合できる範囲の表示には、ワーカーのうち最も大きい送信記録のリングを使う
+    if (shards[w].ctx.window.size > out->window.size) {
+      out->window.size = shards[w].ctx.window.size;
+    }
+    if (shards[w].snapshot_ready || shards[w].finished) {
+      merge_shard(out, &shards[w].snapshot);
+      merge_interval_stats(&out->interval, &shards[w].snapshot.interval);
+      copy_targets(targets, shards[w].first_target,
+                   shards[w].snapshot_targets.targets,
+                   shards[w].snapshot_targets.count);
+    }
+    if (shards[w].finished && request >= PING_REPORT_INTERVAL) {
+      reset_interval_stats(&shards[w].snapshot.interval);
+    }
+    pthread_mutex_unlock(&shards[w].lock);
+  }
+}
+
+int run_sharded(PingContext *ctx, int threads, double interval) {
+  if (!ctx || threads < 1 || ctx->target_count < 1) {
+    return -1;
+  }
+  if (threads > ctx->target_count) {
+    threads = ctx->target_count;
+  }
+
+  PingShard *shards = calloc(threads, sizeof(PingShard));
+  int *cpus = malloc(threads * sizeof(int));
+  int stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  int done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  // 実行中のレポートで表示する宛先ごとの統計の写し
+  PingTargetCopy report_targets;
+  int copy_ret = alloc_target_copy(&report_targets, ctx->target_count,
+                                   ctx->sweep_count);
+  if (!shards || !cpus || stop_fd < 0 || done_fd < 0 || copy_ret < 0) {
+    perror("ft_ping: failed to prepare worker threads");
+    free(shards);
+    free(cpus);
+    free_target_copy(&report_targets);
+    if (stop_fd >= 0) {
+      close(stop_fd);
+    }
+    if (done_fd >= 0) {
+      close(done_fd);
+    }
+    return -1;
+  }
+  int cpu_count = list_cpus(cpus, threads);
+
+  // 宛先を連続した範囲に分けるので、合算後の宛先の並びは引数の順のまま
+  int ready = 0;
+  int ret = 0;
+  for (int w = 0; w < threads; w++) {
+    int first = (int)((long)ctx->target_count * w / threads);
+    int last = (int)((long)ctx->target_count * (w + 1) / threads);
+    shards[w].main_thread = pthread_self();
+    shards[w].done_fd = done_fd;
+    shards[w].cpu = cpu_count > 0 ? cpus[w % cpu_count] : -1;
+    ready++;
+    if (setup_shard(&shards[w], ctx, w, first, last, stop_fd, interval) < 0) {
+      ret = -1;
+      break;
+    }
+  }
+
+  int started = 0;
+  if (ret == 0) {
+    print_ping_header(ctx);
+
+    // シグナルはメインスレッドだけが受け取るよう、ワーカーではブロックしておく
+    sigset_t block;
+    sigset_t orig;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &block, &orig);
+
+    for (int w = 0; w < threads; w++) {
+      int err = pthread_create(&shards[w].thread, NULL, shard_main, &shards[w]);
+      if (err != 0) {
+        fprintf(stderr, "ft_ping: pthread_create failed: %s\n", strerror(err));
+        ret = -1;
+        break;
+      }
+      started++;
+    }
+
+    // シグナルを待ちながら、定期レポートのタイマーと-c/-wによるワーカーの終了を待ち受ける
+    struct pollfd pfds[2];
+    pfds[0].fd = -1;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = done_fd;
+    pfds[1].events = POLLIN;
+    if (ret == 0 && ctx->report_interval > 0) {
+      ctx->report_timer_fd = create_report_timer(ctx->report_interval);
+      pfds[0].fd = ctx->report_timer_fd;
+    }
+    int finished = 0;
+    while (ret == 0 && ctx->ping_running && finished < started) {
+      pfds[0].revents = 0;
+      pfds[1].revents = 0;
+      int n = ppoll(pfds, 2, NULL, &orig);
+      if (take_stats_request()) {
+        PingContext snapshot;
+        collect_shards(shards, started, ctx, &report_targets, &snapshot,
+                       PING_REPORT_SNAPSHOT);
+        print_statistics(&snapshot);
+      }
+      uint64_t expirations;
+      if (n > 0 && (pfds[0].revents & POLLIN) &&
+          read(pfds[0].fd, &expirations, sizeof(expirations)) > 0) {
+        PingContext snapshot;
+        collect_shards(shards, started, ctx, &report_targets, &snapshot,
+                       PING_REPORT_INTERVAL);
+        print_interval_report(&snapshot);
+      }
+      uint64_t done;
+      if (n > 0 && (pfds[1].revents & POLLIN) &&
+          read(done_fd, &done, sizeof(done)) > 0) {
+        finished += (int)done;
+      }
+    }
+    pthread_sigmask(SIG_SETMASK, &orig, NULL);
+
+    // 停止を通知する（eventfdは読まれないので全ワーカーで通知が残り続ける）
+    uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) < 0) {
+      perror("ft_ping: failed to stop worker threads");
+    }
+    for (int w = 0; w < started; w++) {
+      pthread_join(shards[w].thread, NULL);
+      if (shards[w].result < 0) {
+        ret = -1;
+      }
+    }
+  }
+
+  int window_size = 0;
+  for (int w = 0; w < ready; w++) {
+    if (w < started) {
+      merge_shard(ctx, &shards[w].ctx);
+      if (shards[w].ctx.window.size > window_size) {
+        window_size = shards[w].ctx.window.size;
+      }
+    }
+    cleanup_shard(&shards[w]);
+  }
+  // 終了時の統計でも照合できる範囲をワーカーのリングの大きさで表示する
+  // （メインスレッドのリングは送受信に使っていないので、確保し直してよい）
+  if (window_size > ctx->window.size) {
+    free_seq_window(&ctx->window);
+    create_seq_window(&ctx->window, window_size);
+  }
+  close(stop_fd);
+  close(done_fd);
+  free_target_copy(&report_targets);
+  free(cpus);
+  free(shards);
+  return ret;
+}
@@ -0,0 +1,208 @@
+#include "ping_shared.h"
+#include "ping_resolver.h"
+#include "ping_sched.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ping_shared.c: 実行中の統計を共有するファイル（--stats-file）の書き込みと読み込みを担当するファイル
+// 書き手は送受信ループの外（step_ping_loopの最後）で統計を丸ごと写すので、
+// 応答1つごとの処理（receive_ping）には手間を足さない
+
+#define SHARED_SNAPSHOT_TRIES 10000 // 一貫した写しを取るまでに読み直す最大回数
+
+static size_t shared_size(uint32_t target_capacity) {
+  return sizeof(PingSharedStats) +
+         (size_t)target_capacity * sizeof(PingSharedTarget);
+}
+
+static long long timespec_ns(const struct timespec *ts) {
+  return (long long)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+int open_shared_stats(PingContext *ctx) {
+  char path[4096];
+  char tmp_path[4096 + 32];
+
+  if (!ctx->stats_path) {
+    return 0;
+  }
+  if (ctx->worker_id >= 0) {
+    snprintf(path, sizeof(path), "%s.%d", ctx->stats_path, ctx->worker_id);
+  } else {
+    snprintf(path, sizeof(path), "%s", ctx->stats_path);
+  }
+
+  // 前回の実行のファイルを読み手がmmapしたままでも縮めないよう、
+  // 別名のファイルを用意してから置き換える（読み手は古いファイルを読み続けられる）
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+  uint32_t capacity = ctx->target_count + resolver_pending(ctx->resolver);
+  size_t size = shared_size(capacity);
+  int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "ft_ping: %s: %s\n", tmp_path, strerror(errno));
+    return -1;
+  }
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "ft_ping: %s: %s\n", tmp_path, strerror(errno));
+    unlink(tmp_path);
+    return -1;
+  }
+
+  // ftruncateで伸ばした部分は0で埋まっているので、宛先の行は書かない
+  // magicは最後に書き、読み手が書きかけのヘッダを受け付けないようにする
+  PingSharedStats *shared = map;
+  shared->version = PING_SHARED_VERSION;
+  shared->target_capacity = capacity;
+  shared->pid = getpid();
+  shared->worker_id = ctx->worker_id;
+  shared->ident = ctx->ident;
+  shared->linger = ctx->linger;
+  shared->running = 1;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(shared->magic, PING_SHARED_MAGIC, sizeof(shared->magic));
+  if (rename(tmp_path, path) < 0) {
+    fprintf(stderr, "ft_ping: %s: %s\n", path, strerror(errno));
+    munmap(map, size);
+    unlink(tmp_path);
+    return -1;
+  }
+  ctx->shared = shared;
+  ctx->shared_next_ms = 0;
+  return 0;
+}
+
+void publish_shared_stats(PingContext *ctx) {
+  PingSharedStats *shared = ctx->shared;
+  struct timespec real, mono;
+
+  clock_gettime(CLOCK_REALTIME, &real);
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+
+  // seqを奇数にしてから書き、書き終えたら偶数に戻す
+  uint32_t seq = shared->seq;
+  __atomic_store_n(&shared->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  shared->updated_unix_ns = timespec_ns(&real);
+  if (ctx->start_time.tv_sec != 0 || ctx->start_time.tv_nsec != 0) {
+    shared->start_unix_ns = timespec_ns(&real) - (timespec_ns(&mono) -
+                                                  timespec_ns(&ctx->start_time));
+  }
+  shared->running = ctx->ping_running;
+  shared->packets_sent = ctx->packets_sent;
+  shared->packets_received = ctx->packets_received;
+  shared->packets_duplicate = ctx->packets_duplicate;
+  shared->packets_late = ctx->packets_late;
+  shared->packets_timeout = ctx->packets_timeout;
+  shared->rtt.count = ctx->rtt_count;
+  shared->rtt.min = ctx->rtt_min;
+  shared->rtt.max = ctx->rtt_max;
+  shared->rtt.sum = ctx->rtt_sum;
+  shared->rtt.sum2 = ctx->rtt_sum2;
+  shared->hist = ctx->rtt_hist;
+
+  // 名前は宛先が増えたときに1度だけ書く
+  uint32_t count = (uint32_t)ctx->target_count < shared->target_capacity
+                       ? (uint32_t)ctx->target_count
+                       : shared->target_capacity;
+  for (uint32_t i = shared->target_count; i < count; i++) {
+    const PingTarget *target = &ctx->targets[i];
+    snprintf(shared->targets[i].hostname, PING_SHARED_NAME_MAX, "%s",
+             target->hostname ? target->hostname : target->ip);
+    memcpy(shared->targets[i].ip, target->ip, sizeof(target->ip));
+  }
+  shared->target_count = count;
+  for (uint32_t i = 0; i < count; i++) {
+    const PingTarget *target = &ctx->targets[i];
+    shared->targets[i].packets_sent = target->packets_sent;
+    shared->targets[i].packets_received = target->packets_received;
+    shared->targets[i].packets_duplicate = target->packets_duplicate;
+    shared->targets[i].rtt = target->rtt;
+  }
+
+  __atomic_store_n(&shared->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void publish_shared_stats_if_due(PingContext *ctx, const struct timespec *now) {
+  unsigned long long now_ms = timespec_to_ms(now);
+  if (now_ms < ctx->shared_next_ms) {
+    return;
+  }
+  publish_shared_stats(ctx);
+  ctx->shared_next_ms = now_ms + PING_SHARED_PUBLISH_MS;
+}
+
+void close_shared_stats(PingContext *ctx) {
+  if (!ctx->shared) {
+    return;
+  }
+  // 読み手が最後の統計と分かるよう、送受信中の印を下ろした状態で写す
+  int running = ctx->ping_running;
+  ctx->ping_running = 0;
+  publish_shared_stats(ctx);
+  ctx->ping_running = running;
+  munmap(ctx->shared, shared_size(ctx->shared->target_capacity));
+  ctx->shared = NULL;
+}
+
+const PingSharedStats *map_shared_stats(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+
+  if (fd < 0) {
+    fprintf(stderr, "ft_ping: %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(PingSharedStats)) {
+    fprintf(stderr, "ft_ping: %s: not an ft_ping stats file\n", path);
+    close(fd);
+    return NULL;
+  }
+  void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "ft_ping: %s: mmap failed: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  const PingSharedStats *shared = map;
+  if (memcmp(shared->magic, PING_SHARED_MAGIC, sizeof(shared->magic)) != 0 ||
+      shared->version != PING_SHARED_VERSION ||
+      shared_size(shared->target_capacity) != (size_t)st.st_size) {
+    fprintf(stderr, "ft_ping: %s: not an ft_ping stats file\n", path);
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+  *size = shared_size(shared->target_capacity);
+  return shared;
+}
+
+void unmap_shared_stats(const PingSharedStats *shared, size_t size) {
+  munmap((void *)shared, size);
+}
+
+int snapshot_shared_stats(const PingSharedStats *shared, size_t size,
+                          PingSharedStats *out) {
+  for (int tries = 0; tries < SHARED_SNAPSHOT_TRIES; tries++) {
+    uint32_t before = __atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      // 書き込み中は書き手に譲ってから読み直す
+      sched_yield();
+      continue;
+    }
+    memcpy(out, shared, size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shared->seq, __ATOMIC_RELAXED) == before) {
+      return 0;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,160 @@
+#include "ping_stats.h"
+
+#include <math.h>
+
+// ping_stats.c: RTTの集計を担当するファイル
+// 最小・最大・平均・標準偏差用の合計値と、パーセンタイル用のヒストグラムを持つ
+// ヒストグラムは固定サイズなので、実行時間やパケット数に関わらずメモリは一定
+
+void add_rtt_sample(PingRttStats *stats, double rtt) {
+  stats->count++;
+  stats->sum += rtt;
+  stats->sum2 += rtt * rtt;
+  if (stats->count == 1 || rtt < stats->min)
+    stats->min = rtt;
+  if (stats->count == 1 || rtt > stats->max)
+    stats->max = rtt;
+}
+
+void merge_rtt_stats(PingRttStats *dst, const PingRttStats *src) {
+  if (src->count == 0) {
+    return;
+  }
+  if (dst->count == 0 || src->min < dst->min) {
+    dst->min = src->min;
+  }
+  if (dst->count == 0 || src->max > dst->max) {
+    dst->max = src->max;
+  }
+  dst->count += src->count;
+  dst->sum += src->sum;
+  dst->sum2 += src->sum2;
+}
+
+// 値vのバケット番号
+// v < 2^SUB_BITS はそのまま、それ以上は上位SUB_BITSビットが残るよう
+// shiftビット右シフトし、shiftごとにHALF個ずつ番号をずらす
+static int bucket_index(unsigned long long v) {
+  if (v < 2 * PING_HIST_HALF) {
+    return (int)v;
+  }
+  int msb = 63 - __builtin_clzll(v);
+  int shift = msb - (PING_HIST_SUB_BITS - 1);
+  if (shift > PING_HIST_MAX_SHIFT) {
+    return PING_HIST_BUCKETS - 1;
+  }
+  return PING_HIST_HALF * shift + (int)(v >> shift);
+}
+
+// バケットに入る値の範囲 [lower, lower + width)
+static void bucket_range(int index, unsigned long long *lower,
+                         unsigned long long *width) {
+  if (index < 2 * PING_HIST_HALF) {
+    *lower = (unsigned long long)index;
+    *width = 1;
+    return;
+  }
+  int shift = index / PING_HIST_HALF - 1;
+  *lower = (unsigned long long)(index - PING_HIST_HALF * shift) << shift;
+  *width = 1ULL << shift;
+}
+
+void histogram_record(PingHistogram *hist, double rtt) {
+  unsigned long long ns = rtt > 0.0 ? (unsigned long long)(rtt * 1e6 + 0.5) : 0;
+
+  hist->counts[bucket_index(ns)]++;
+  if (hist->total == 0 || ns < hist->min_ns) {
+    hist->min_ns = ns;
+  }
+  if (hist->total == 0 || ns > hist->max_ns) {
+    hist->max_ns = ns;
+  }
+  hist->total++;
+}
+
+double histogram_percentile(const PingHistogram *hist, double p) {
+  if (hist->total == 0) {
+    return 0.0;
+  }
+
+  // 小さい方から数えてrank番目の値が入るバケットを探す
+  unsigned long long rank =
+      (unsigned long long)ceil(p / 100.0 * (double)hist->total);
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > hist->total) {
+    rank = hist->total;
+  }
+
+  unsigned long long seen = 0;
+  for (int i = 0; i < PING_HIST_BUCKETS; i++) {
+    seen += hist->counts[i];
+    if (seen < rank) {
+      continue;
+    }
+    // 最上位のバケットには範囲外の値も入るので、記録した最大値を返す
+    if (i == PING_HIST_BUCKETS - 1) {
+      break;
+    }
+    // バケットの中央値を返す（記録した最小・最大値の範囲に収める）
+    unsigned long long lower;
+    unsigned long long width;
+    bucket_range(i, &lower, &width);
+    double ns = (double)lower + (double)(width - 1) / 2.0;
+    if (ns < (double)hist->min_ns) {
+      ns = (double)hist->min_ns;
+    } else if (ns > (double)hist->max_ns) {
+      ns = (double)hist->max_ns;
+    }
+    return ns / 1e6;
+  }
+  return (double)hist->max_ns / 1e6;
+}
+
+unsigned long long histogram_count_below(const PingHistogram *hist,
+                                         double rtt) {
+  unsigned long long limit = rtt > 0.0 ? (unsigned long long)(rtt * 1e6) : 0;
+  unsigned long long count = 0;
+
+  // バケットは値の小さい順に並ぶので、上端がlimitを超えたところで止める
+  for (int i = 0; i < PING_HIST_BUCKETS - 1; i++) {
+    unsigned long long lower;
+    unsigned long long width;
+    bucket_range(i, &lower, &width);
+    if (lower + width - 1 > limit) {
+      break;
+    }
+    count += hist->counts[i];
+  }
+  return count;
+}
+
+void histogram_merge(PingHistogram *dst, const PingHistogram *src) {
+  if (src->total == 0) {
+    return;
+  }
+  for (int i = 0; i < PING_HIST_BUCKETS; i++) {
+    dst->counts[i] += src->counts[i];
+  }
+  if (dst->total == 0 || src->min_ns < dst->min_ns) {
+    dst->min_ns = src->min_ns;
+  }
+  if (dst->total == 0 || src->max_ns > dst->max_ns) {
+    dst->max_ns = src->max_ns;
+  }
+  dst->total += src->total;
+}
+
+void merge_interval_stats(PingIntervalStats *dst, const PingIntervalStats *src) {
+  dst->packets_sent += src->packets_sent;
+  dst->packets_received += src->packets_received;
+  dst->packets_duplicate += src->packets_duplicate;
+  dst->packets_timeout += src->packets_timeout;
+  merge_rtt_stats(&dst->rtt, &src->rtt);
+  histogram_merge(&dst->hist, &src->hist);
+}
+
+void reset_interval_stats(PingIntervalStats *stats) {
+  // 固定サイズなのでリセットの手間は記録数に依存しない
+  memset(stats, 0, sizeof(*stats));
+}
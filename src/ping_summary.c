@@ -0,0 +1,263 @@
+#include "ping_summary.h"
+#include "ping_output.h"
+#include "ping_profile.h"
+#include "ping_stats.h"
+#include "ping_sweep.h"
+
+#include <math.h>
+
+// ping_summary.c:
+// 終了時・SIGQUIT時の累積の統計と、--report-intervalの区間ごとの統計を表示するファイル
+// pingの統計情報(送受信数、パケットロス、RTT統計)を人が読む形で出力する
+
+// 複数宛先の場合は宛先ごとに1行ずつ送受信数とRTTを表示
+static void print_target_statistics(PingContext *ctx, FILE *stream) {
+  fprintf(stream, "\n--- ping statistics (%d hosts) ---\n", ctx->target_count);
+  for (int i = 0; i < ctx->target_count; i++) {
+    PingTarget *target = &ctx->targets[i];
+    double loss = 0.0;
+    if (target->packets_sent > 0) {
+      loss = (double)(target->packets_sent - target->packets_received) *
+             100.0 / (double)target->packets_sent;
+      if (loss < 0.0) {
+        loss = 0.0;
+      }
+    }
+    fprintf(stream, "%s (%s) : xmt/rcv/%%loss = %lld/%lld/%.1f%%", target->hostname,
+                    target->ip, target->packets_sent, target->packets_received, loss);
+    if (target->packets_duplicate > 0) {
+      fprintf(stream, ", +%lld duplicates", target->packets_duplicate);
+    }
+    if (target->rtt.count > 0) {
+      fprintf(stream, ", min/avg/max = %.3f/%.3f/%.3f ms", target->rtt.min,
+                      target->rtt.sum / (double)target->rtt.count, target->rtt.max);
+    }
+    fprintf(stream, "\n");
+  }
+  fprintf(stream, "--- total ---\n");
+}
+
+// ヒストグラムから求めたRTTのパーセンタイルを表示（誤差はping.hを参照）
+static void print_rtt_percentiles(const PingHistogram *hist, FILE *stream) {
+  if (hist->total == 0) {
+    return;
+  }
+  fprintf(stream, "round-trip p50/p90/p99/p99.9 = %.3f/%.3f/%.3f/%.3f ms\n",
+                  histogram_percentile(hist, 50.0), histogram_percentile(hist, 90.0),
+                  histogram_percentile(hist, 99.0), histogram_percentile(hist, 99.9));
+}
+
+void print_statistics(PingContext *ctx) {
+  // 入力パラメータの検証
+  if (!ctx) {
+    return;
+  }
+  // JSON Lines/CSVでは統計を標準エラー出力に出し、標準出力を記録だけにする
+  FILE *stream = text_stream(ctx);
+
+  // ホスト名の有効性チェック（複数宛先の場合は宛先ごとの統計を先に表示）
+  if (ctx->target_count > 1) {
+    print_target_statistics(ctx, stream);
+  } else if (ctx->target_count == 0 || !ctx->targets[0].hostname) {
+    fprintf(stream, "\n--- ping statistics ---\n");
+  } else {
+    fprintf(stream, "\n--- %s ping statistics ---\n", ctx->targets[0].hostname);
+  }
+
+  // パケットロス率の計算（ゼロ除算防止）
+  double loss_rate = 0.0;
+  if (ctx->packets_sent > 0) {
+    // 整数オーバーフロー防止のため double キャストを先に実行
+    loss_rate = ((double)(ctx->packets_sent - ctx->packets_received) * 100.0) /
+                (double)ctx->packets_sent;
+
+    // 負の値や異常値のチェック
+    if (loss_rate < 0.0) {
+      loss_rate = 0.0;
+    } else if (loss_rate > 100.0) {
+      loss_rate = 100.0;
+    }
+  }
+
+  // 重複パケット情報の表示（負の値チェック追加）
+  if (ctx->packets_duplicate > 0) {
+    fprintf(stream, "%lld packets transmitted, %lld packets received, +%lld duplicates, "
+                    "%.1f%% packet loss\n",
+                    ctx->packets_sent,
+                    ctx->packets_received >= 0 ? ctx->packets_received : 0,
+                    ctx->packets_duplicate >= 0 ? ctx->packets_duplicate : 0, loss_rate);
+  } else {
+    fprintf(stream, "%lld packets transmitted, %lld packets received, %.1f%% packet loss\n",
+                    ctx->packets_sent,
+                    ctx->packets_received >= 0 ? ctx->packets_received : 0, loss_rate);
+  }
+
+  // 照合できる範囲より古い応答は統計に含めず、数だけ表示
+  if (ctx->packets_late > 0) {
+    fprintf(stream, "%lld late replies ignored (older than the last %d probes)\n",
+                    ctx->packets_late, ctx->window.size);
+  }
+  // 応答待ちがタイムアウトした数（後から応答が届いたものも含む）
+  if (ctx->packets_timeout > 0) {
+    fprintf(stream, "%lld probes timed out (no reply within %g s)\n",
+            ctx->packets_timeout, ctx->linger);
+  }
+
+  // 経路がないなどで送信できなかった数（送信数には含めない）
+  if (ctx->send_errors > 0) {
+    fprintf(stream, "%lld probes not sent (send errors)\n", ctx->send_errors);
+  }
+
+  // RTT統計の表示（データ有効性チェック強化）
+  if (ctx->rtt_count > 0 && ctx->rtt_sum >= 0.0) {
+    double avg = ctx->rtt_sum / (double)ctx->rtt_count;
+    double mdev = 0.0;
+
+    // 標準偏差計算の改善（数値安定性とゼロ除算防止）
+    if (ctx->rtt_count > 1 && ctx->rtt_sum2 >= 0.0) {
+      // 分散計算で負の値を防ぐ
+      double variance = (ctx->rtt_sum2 / (double)ctx->rtt_count) - (avg * avg);
+
+      // 浮動小数点計算の誤差により variance が負になる場合があるため
+      if (variance > 0.0) {
+        mdev = sqrt(variance);
+      } else {
+        mdev = 0.0;
+      }
+    }
+
+    // RTT値の妥当性チェック（負の値や異常に大きい値の防止）
+    double min_rtt = (ctx->rtt_min >= 0.0) ? ctx->rtt_min : 0.0;
+    double max_rtt = (ctx->rtt_max >= 0.0) ? ctx->rtt_max : 0.0;
+
+    // avg が負になることはないはずだが、安全のためチェック
+    if (avg < 0.0) {
+      avg = 0.0;
+    }
+
+    // mdev が負になることはないはずだが、安全のためチェック
+    if (mdev < 0.0) {
+      mdev = 0.0;
+    }
+
+    fprintf(stream, "round-trip min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\n", min_rtt,
+                    avg, max_rtt, mdev);
+    print_rtt_percentiles(&ctx->rtt_hist, stream);
+  }
+
+  // カーネルタイムスタンプ使用時はユーザ空間の時計で測ったRTTと、
+  // その差(ツール自身が加えた遅延)を表示
+  if (ctx->kernel_timestamps && ctx->user_rtt.count > 0) {
+    double n = (double)ctx->user_rtt.count;
+    double avg = ctx->user_rtt.sum / n;
+    double variance = ctx->user_rtt.sum2 / n - avg * avg;
+    fprintf(stream, "user-clock round-trip min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\n",
+                    ctx->user_rtt.min, avg, ctx->user_rtt.max,
+                    variance > 0.0 ? sqrt(variance) : 0.0);
+    fprintf(stream, "tool overhead min/avg/max = %.3f/%.3f/%.3f ms "
+                    "(%ld samples, %ld kernel TX timestamps)\n",
+                    ctx->overhead.min, ctx->overhead.sum / (double)ctx->overhead.count,
+                    ctx->overhead.max, ctx->overhead.count, ctx->kernel_tx_count);
+  }
+
+  // 送信スケジュールの遅れ(ジッタ)を計測していれば表示する
+  if (ctx->sched.jitter_count > 0) {
+    double n = (double)ctx->sched.jitter_count;
+    double avg = ctx->sched.jitter_sum / n;
+    double variance = ctx->sched.jitter_sum2 / n - avg * avg;
+    fprintf(stream, "send jitter min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f us "
+                    "(%ld sends)\n",
+                    ctx->sched.jitter_min, avg, ctx->sched.jitter_max, variance > 0.0 ? sqrt(variance) : 0.0,
+                    ctx->sched.jitter_count);
+  }
+
+  // verboseモードでは送信1パケットあたりのシステムコール数を表示
+  if (ctx->verbose_mode && ctx->tx.probes > 0) {
+    fprintf(stream, "tx: %ld packets in %ld syscalls (%.3f syscalls/packet, %s)\n",
+                    ctx->tx.probes, ctx->tx.syscalls,
+                    (double)ctx->tx.syscalls / (double)ctx->tx.probes,
+                    ctx->io_uring ? "io_uring" : "sendmmsg");
+  }
+
+  // verboseモードでは受信1回のシステムコールで読み出したパケット数を表示
+  // io_uringでは受信を登録し直したときだけシステムコールを使う
+  if (ctx->verbose_mode && ctx->rx.syscalls > 0) {
+    fprintf(stream, "rx: %ld packets in %ld syscalls (%.3f packets/syscall, %s)\n",
+                    ctx->rx.packets, ctx->rx.syscalls,
+                    (double)ctx->rx.packets / (double)ctx->rx.syscalls,
+                    ctx->io_uring ? "io_uring" : "recvmmsg");
+  } else if (ctx->verbose_mode && ctx->rx.packets > 0) {
+    fprintf(stream, "rx: %ld packets in 0 syscalls (io_uring)\n",
+                    ctx->rx.packets);
+  }
+
+  // floodモードでは達成した送受信レートを表示
+  if (ctx->flood_mode && ctx->packets_sent > 0) {
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == 0) {
+      double elapsed = (now.tv_sec - ctx->start_time.tv_sec) +
+                       (now.tv_nsec - ctx->start_time.tv_nsec) / 1000000000.0;
+      if (elapsed > 0.0) {
+        fprintf(stream, "flood: %.1f packets/s sent, %.1f packets/s received "
+                        "(%.3f s)\n",
+                        ctx->packets_sent / elapsed, ctx->packets_received / elapsed,
+                        elapsed);
+      }
+    }
+  }
+
+  // --sweepでは宛先ごとにサイズごとの統計を表示する
+  if (ctx->sweep_count > 0) {
+    print_sweep_statistics(ctx, stream);
+  }
+
+  // -Xでは段階ごとの処理時間を続けて表示する
+  if (ctx->prof) {
+    print_profile(ctx, stream);
+  }
+}
+
+void print_interval_report(PingContext *ctx) {
+  // 前回のレポート以降の区間統計を1行で表示する
+  // 区間をまたいだ応答は受信した区間に数えるので、ロス率は0%未満にならないよう丸める
+  if (!ctx) {
+    return;
+  }
+
+  FILE *stream = text_stream(ctx);
+  const PingIntervalStats *interval = &ctx->interval;
+  struct timespec now;
+  double elapsed = 0.0;
+  if (clock_gettime(CLOCK_MONOTONIC, &now) == 0) {
+    elapsed = (now.tv_sec - ctx->start_time.tv_sec) +
+              (now.tv_nsec - ctx->start_time.tv_nsec) / 1000000000.0;
+  }
+
+  double loss = 0.0;
+  if (interval->packets_sent > 0 &&
+      interval->packets_received < interval->packets_sent) {
+    loss = (double)(interval->packets_sent - interval->packets_received) *
+           100.0 / (double)interval->packets_sent;
+  }
+
+  fprintf(stream, "[%.3f s] %lld sent, %lld received", elapsed, interval->packets_sent,
+                  interval->packets_received);
+  if (interval->packets_duplicate > 0) {
+    fprintf(stream, ", +%lld duplicates", interval->packets_duplicate);
+  }
+  if (interval->packets_timeout > 0) {
+    fprintf(stream, ", %lld timed out", interval->packets_timeout);
+  }
+  fprintf(stream, ", %.1f%% loss", loss);
+  if (interval->rtt.count > 0) {
+    const PingHistogram *hist = &interval->hist;
+    fprintf(stream, ", rtt min/avg/max = %.3f/%.3f/%.3f ms, "
+                    "p50/p90/p99/p99.9 = %.3f/%.3f/%.3f/%.3f ms",
+                    interval->rtt.min, interval->rtt.sum / (double)interval->rtt.count,
+                    interval->rtt.max, histogram_percentile(hist, 50.0),
+                    histogram_percentile(hist, 90.0), histogram_percentile(hist, 99.0),
+                    histogram_percentile(hist, 99.9));
+  }
+  fprintf(stream, "\n");
+  fflush(stream);
+}
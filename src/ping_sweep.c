@@ -0,0 +1,204 @@
+#include "ping_sweep.h"
+#include "ping_stats.h"
+
+#include <math.h>
+
+// ping_sweep.c: データ部サイズの掃引（--sweep）の集計と表示を担当するファイル
+// 送信はサイズを変えながら宛先ごとに順に行い、サイズごとの統計は宛先に持つ
+// RTTの最小値はキューイングの影響を受けにくいので、近似には最小値を使う
+// 1バイト増えると要求と応答で2回運ぶので、帯域は 2×8ビット ÷ 傾き で推定する
+// （経路の各リンクの送信時間の合計なので、ボトルネックの帯域の下限の目安になる）
+
+int setup_sweep(PingContext *ctx, int min, int max, int step) {
+  if (step <= 0) {
+    step = (max - min) / (PING_SWEEP_DEFAULT_SIZES - 1);
+    if (step < 1) {
+      step = 1;
+    }
+  }
+  long count = (max - min + step - 1) / step + 1;
+  if (min == max) {
+    count = 1;
+  }
+  if (count > PING_MAX_SWEEP_SIZES) {
+    return -1;
+  }
+  ctx->sweep_min = min;
+  ctx->sweep_max = max;
+  ctx->sweep_step = step;
+  ctx->sweep_count = (int)count;
+  ctx->data_size = max;
+  return 0;
+}
+
+int sweep_data_size(const PingContext *ctx, int index) {
+  long size = ctx->sweep_min + (long)index * ctx->sweep_step;
+  return size < ctx->sweep_max ? (int)size : ctx->sweep_max;
+}
+
+long long sweep_probe_limit(const PingContext *ctx) {
+  return (long long)ctx->count * (ctx->sweep_count > 0 ? ctx->sweep_count : 1);
+}
+
+int next_sweep_index(const PingContext *ctx, const PingTarget *target) {
+  // 送信待ちの分も数え、同じバッチの送信にも順にサイズを割り当てる
+  return (int)((target->packets_sent + target->probes_pending) %
+               ctx->sweep_count);
+}
+
+void count_sweep_send(PingContext *ctx, PingTarget *target, int index) {
+  if (!target->sweep) {
+    target->sweep = calloc(ctx->sweep_count, sizeof(PingSweepStat));
+    if (!target->sweep) {
+      return;
+    }
+  }
+  target->sweep[index].packets_sent++;
+}
+
+void count_sweep_reply(PingContext *ctx, PingTarget *target, int index,
+                       double rtt) {
+  (void)ctx;
+  if (!target->sweep) {
+    return;
+  }
+  target->sweep[index].packets_received++;
+  add_rtt_sample(&target->sweep[index].rtt, rtt);
+}
+
+int fit_sweep(const PingContext *ctx, const PingTarget *target,
+              PingSweepFit *fit) {
+  double n = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, syy = 0.0;
+
+  memset(fit, 0, sizeof(*fit));
+  if (!target->sweep) {
+    return -1;
+  }
+  for (int i = 0; i < ctx->sweep_count; i++) {
+    const PingSweepStat *stat = &target->sweep[i];
+    if (stat->rtt.count == 0) {
+      continue;
+    }
+    double x = sweep_data_size(ctx, i);
+    double y = stat->rtt.min;
+    n += 1.0;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    syy += y * y;
+  }
+  fit->points = (int)n;
+  double vx = n * sxx - sx * sx;
+  if (fit->points < 2 || vx <= 0.0) {
+    return -1;
+  }
+  fit->ms_per_byte = (n * sxy - sx * sy) / vx;
+  fit->base_ms = (sy - fit->ms_per_byte * sx) / n;
+  double vy = n * syy - sy * sy;
+  fit->r2 = vy > 0.0 ? (n * sxy - sx * sy) * (n * sxy - sx * sy) / (vx * vy)
+                     : 1.0;
+  return 0;
+}
+
+static double sweep_loss(const PingSweepStat *stat) {
+  if (stat->packets_sent == 0) {
+    return 0.0;
+  }
+  double loss = (double)(stat->packets_sent - stat->packets_received) *
+                100.0 / (double)stat->packets_sent;
+  return loss < 0.0 ? 0.0 : loss;
+}
+
+int sweep_loss_jump(const PingContext *ctx, const PingTarget *target,
+                    int index) {
+  (void)ctx;
+  if (!target->sweep || target->sweep[index].packets_sent == 0) {
+    return 0;
+  }
+  // 送信のあった1つ小さいサイズと比べる
+  for (int i = index - 1; i >= 0; i--) {
+    if (target->sweep[i].packets_sent > 0) {
+      return sweep_loss(&target->sweep[index]) - sweep_loss(&target->sweep[i]) >=
+             PING_SWEEP_LOSS_JUMP;
+    }
+  }
+  return 0;
+}
+
+// 帯域を読みやすい単位で表示する
+static void print_bandwidth(double bits_per_second, FILE *stream) {
+  static const char *const units[] = {"bit/s", "kbit/s", "Mbit/s", "Gbit/s",
+                                      "Tbit/s"};
+  int unit = 0;
+  while (bits_per_second >= 1000.0 && unit < 4) {
+    bits_per_second /= 1000.0;
+    unit++;
+  }
+  fprintf(stream, "%.1f %s", bits_per_second, units[unit]);
+}
+
+static void print_target_sweep(const PingContext *ctx, const PingTarget *target,
+                               FILE *stream) {
+  fprintf(stream, "--- %s size sweep ---\n", target->ip);
+  fprintf(stream, "%6s %6s %6s %6s %8s %8s %8s %8s\n", "bytes", "xmt", "rcv",
+          "loss", "min", "avg", "max", "mdev");
+  int first_jump = -1;
+  for (int i = 0; i < ctx->sweep_count; i++) {
+    const PingSweepStat *stat = &target->sweep[i];
+    if (stat->packets_sent == 0) {
+      continue;
+    }
+    fprintf(stream, "%6d %6lld %6lld %5.1f%%", sweep_data_size(ctx, i),
+            stat->packets_sent, stat->packets_received, sweep_loss(stat));
+    if (stat->rtt.count > 0) {
+      double avg = stat->rtt.sum / (double)stat->rtt.count;
+      double variance = stat->rtt.sum2 / (double)stat->rtt.count - avg * avg;
+      fprintf(stream, " %8.3f %8.3f %8.3f %8.3f", stat->rtt.min, avg,
+              stat->rtt.max, variance > 0.0 ? sqrt(variance) : 0.0);
+    } else {
+      fprintf(stream, " %8s %8s %8s %8s", "-", "-", "-", "-");
+    }
+    if (sweep_loss_jump(ctx, target, i)) {
+      fprintf(stream, "  loss jump");
+      if (first_jump < 0) {
+        first_jump = i;
+      }
+    }
+    fprintf(stream, "\n");
+  }
+
+  PingSweepFit fit;
+  if (fit_sweep(ctx, target, &fit) < 0) {
+    fprintf(stream, "fit: not enough sizes with replies\n");
+  } else {
+    fprintf(stream, "fit: min rtt = %.3f ms + %.3f ns/byte (r2=%.3f, %d sizes)",
+            fit.base_ms, fit.ms_per_byte * 1e6, fit.r2, fit.points);
+    if (fit.ms_per_byte > 0.0) {
+      fprintf(stream, ", bandwidth ~");
+      print_bandwidth(2.0 * 8.0 / (fit.ms_per_byte / 1000.0), stream);
+    } else {
+      // 揺らぎの方が大きく、サイズによる遅延の差が見えない（ループバックなど）
+      fprintf(stream, ", no per-byte delay visible");
+    }
+    fprintf(stream, "\n");
+  }
+  if (first_jump > 0) {
+    // 跳ね上がる直前の送信のあったサイズとの間に、MTUや断片化の境界がある
+    int below = first_jump - 1;
+    while (below > 0 && target->sweep[below].packets_sent == 0) {
+      below--;
+    }
+    fprintf(stream, "loss jumps between %d and %d bytes (MTU or "
+                    "fragmentation?)\n",
+            sweep_data_size(ctx, below), sweep_data_size(ctx, first_jump));
+  }
+}
+
+void print_sweep_statistics(const PingContext *ctx, FILE *stream) {
+  for (int i = 0; i < ctx->target_count; i++) {
+    if (ctx->targets[i].sweep) {
+      print_target_sweep(ctx, &ctx->targets[i], stream);
+    }
+  }
+}
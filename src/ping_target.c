@@ -0,0 +1,163 @@
+#include "ping_target.h"
+#include "ping_output.h"
+#include "ping_resolve.h"
+#include "ping_resolver.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+
+// ping_target.c: 宛先の登録を担当するファイル
+// コマンドライン引数や宛先ファイルのホスト名を解決し、宛先配列に追加する
+// 宛先はPingContextのtargets配列にまとめて持ち、送信時はラウンドロビンで選ぶ
+// ワーカープールがあれば名前解決はワーカーに任せ、解決できた宛先から順に追加する
+
+#define TARGET_LINE_MAX 512
+
+// 宛先配列に空きを確保し、初期化した末尾の要素を返す
+static PingTarget *reserve_target(PingContext *ctx) {
+  if (ctx->target_count >= ctx->target_capacity) {
+    int new_capacity = ctx->target_capacity > 0 ? ctx->target_capacity * 2 : 4;
+    PingTarget *new_targets =
+        realloc(ctx->targets, new_capacity * sizeof(PingTarget));
+    if (!new_targets) {
+      return NULL;
+    }
+    ctx->targets = new_targets;
+    ctx->target_capacity = new_capacity;
+  }
+
+  PingTarget *target = &ctx->targets[ctx->target_count];
+  memset(target, 0, sizeof(*target));
+  return target;
+}
+
+int add_target(PingContext *ctx, const char *hostname) {
+  // 宛先を解決して追加する
+  // 戻り値: 追加した宛先のインデックス, -1=解決失敗またはメモリ不足
+  if (!ctx || !hostname) {
+    return -1;
+  }
+
+  PingTarget *target = reserve_target(ctx);
+  if (!target) {
+    return -1;
+  }
+  if (resolve_hostname(target, hostname) < 0) {
+    free(target->hostname);
+    target->hostname = NULL;
+    return -1;
+  }
+  return ctx->target_count++;
+}
+
+int add_resolved_target(PingContext *ctx, const char *hostname,
+                        const struct sockaddr_in *addr) {
+  PingTarget *target = reserve_target(ctx);
+  if (!target) {
+    return -1;
+  }
+  if (set_target_address(target, hostname, addr) < 0) {
+    free(target->hostname);
+    target->hostname = NULL;
+    return -1;
+  }
+  return ctx->target_count++;
+}
+
+int request_target(PingContext *ctx, const char *hostname) {
+  struct sockaddr_in addr;
+  struct in_addr literal;
+
+  // IPアドレスは問い合わせずに済むので、その場で追加する
+  if (!ctx->resolver || inet_pton(AF_INET, hostname, &literal) == 1) {
+    return add_target(ctx, hostname) < 0 ? -1 : 0;
+  }
+  if (resolver_lookup(ctx->resolver, hostname, &addr)) {
+    return add_resolved_target(ctx, hostname, &addr) < 0 ? -1 : 0;
+  }
+  return resolver_add(ctx->resolver, hostname);
+}
+
+int collect_targets(PingContext *ctx) {
+  PingResolver *resolver = ctx->resolver;
+  PingResolveJob *job;
+  uint64_t completions;
+  int added = 0;
+
+  if (!resolver) {
+    return 0;
+  }
+  // 通知を消してから取り出すので、この後に終わった解決は次の通知で受け取る
+  if (read(resolver->event_fd, &completions, sizeof(completions)) < 0 &&
+      errno != EAGAIN) {
+    perror("ft_ping: eventfd read failed");
+  }
+  while ((job = resolver_next_result(resolver)) != NULL) {
+    if (job->error != 0) {
+      fprintf(text_stream(ctx), "ft_ping: cannot resolve %s: %s\n", job->name,
+              gai_strerror(job->error));
+    } else if (add_resolved_target(ctx, job->name, &job->addr) >= 0) {
+      added++;
+    }
+  }
+  // 全て解決し終えたら、実行中に止められてもよいようすぐにキャッシュへ書き戻す
+  if (resolver_pending(resolver) == 0) {
+    save_resolver_cache(resolver);
+  }
+  return added;
+}
+
+int load_targets_file(PingContext *ctx, const char *path) {
+  // 1行に1つのホスト名を書いたファイルから宛先を追加する
+  // 空行と'#'以降はコメントとして無視し、解決できない宛先は読み飛ばす
+  // 戻り値: 追加または解決待ちにした宛先数, -1=ファイルを開けない
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "ft_ping: %s: ", path);
+    perror(NULL);
+    return -1;
+  }
+
+  char line[TARGET_LINE_MAX];
+  int added = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+
+    char *start = line;
+    while (*start && isspace((unsigned char)*start)) {
+      start++;
+    }
+    char *end = start + strlen(start);
+    while (end > start && isspace((unsigned char)end[-1])) {
+      *--end = '\0';
+    }
+    if (*start == '\0') {
+      continue;
+    }
+
+    if (request_target(ctx, start) >= 0) {
+      added++;
+    }
+  }
+
+  fclose(fp);
+  return added;
+}
+
+void free_targets(PingContext *ctx) {
+  if (!ctx) {
+    return;
+  }
+  for (int i = 0; i < ctx->target_count; i++) {
+    free(ctx->targets[i].hostname);
+    free(ctx->targets[i].sweep);
+  }
+  free(ctx->targets);
+  ctx->targets = NULL;
+  ctx->target_count = 0;
+  ctx->target_capacity = 0;
+}
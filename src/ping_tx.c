@@ -0,0 +1,129 @@
+#define _GNU_SOURCE
+#include "ping_tx.h"
+#include "ping_checksum.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+
+// ping_tx.c: ICMP Echo Requestの送信バッファを管理するファイル
+// 起動時にパケットを組み立てておき、送信ごとにシーケンス番号と送信時刻、
+// 宛先アドレスだけを書き換える。チェックサムは書き換えたワードの差分だけ更新し(RFC1624)、
+// 溜まったパケットはsendmmsgでまとめて送信する
+
+int init_tx_engine(PingTxEngine *tx, int ident, size_t packet_size) {
+  if (!tx || packet_size < ICMP_HDRLEN) {
+    return -1;
+  }
+
+  memset(tx, 0, sizeof(*tx));
+  tx->packet_size = packet_size;
+  tx->slots = calloc(PING_TX_BATCH, packet_size);
+  if (!tx->slots) {
+    return -1;
+  }
+
+  // テンプレート: Type=8, Code=0, Identifier=ident, Sequence=0, Data=0
+  // 1つ目のスロットで組み立てて残りのスロットへコピーする
+  unsigned char *template = tx->slots;
+  struct icmphdr *icmp_hdr = (struct icmphdr *)template;
+  icmp_hdr->type = ICMP_ECHO;
+  icmp_hdr->code = 0;
+  icmp_hdr->un.echo.id = htons(ident & 0xFFFF);
+  icmp_hdr->un.echo.sequence = 0;
+  icmp_hdr->checksum = 0;
+  icmp_hdr->checksum = ping_checksum(template, (int)packet_size);
+
+  for (int i = 0; i < PING_TX_BATCH; i++) {
+    if (i > 0) {
+      memcpy(tx->slots + (size_t)i * packet_size, template, packet_size);
+    }
+    tx->iovs[i].iov_base = tx->slots + (size_t)i * packet_size;
+    tx->iovs[i].iov_len = packet_size;
+    tx->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    tx->msgs[i].msg_hdr.msg_iov = &tx->iovs[i];
+    tx->msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  return 0;
+}
+
+int prepare_tx_slot(PingTxEngine *tx, int seq, const struct timespec *timestamp,
+                    const struct sockaddr_in *dest_addr, size_t packet_size) {
+  if (!tx || !timestamp || !dest_addr || tx->pending >= PING_TX_BATCH ||
+      packet_size < ICMP_HDRLEN || packet_size > tx->packet_size) {
+    return -1;
+  }
+
+  // パケットの中身は宛先に依存しないので、宛先アドレスだけを差し替える
+  tx->msgs[tx->pending].msg_hdr.msg_name = (void *)dest_addr;
+  tx->iovs[tx->pending].iov_len = packet_size;
+
+  unsigned char *packet = tx->slots + (size_t)tx->pending * tx->packet_size;
+  struct icmphdr *icmp_hdr = (struct icmphdr *)packet;
+  uint16_t sequence = htons(seq & 0xFFFF);
+  if (packet_size != tx->packet_size) {
+    // --sweepで短く送る場合: 送信時刻より後ろのデータ部は0なので、
+    // 送信時刻までのチェックサムがスロット全体のチェックサムと等しい
+    // 送信時刻が入らない長さでは時刻の領域も0にし、ヘッダだけのチェックサムにする
+    size_t stamped = ICMP_HDRLEN + sizeof(struct timespec);
+    icmp_hdr->un.echo.sequence = sequence;
+    if (tx->packet_size >= stamped) {
+      if (packet_size >= stamped) {
+        memcpy(packet + ICMP_HDRLEN, timestamp, sizeof(struct timespec));
+      } else {
+        memset(packet + ICMP_HDRLEN, 0, sizeof(struct timespec));
+      }
+    }
+    icmp_hdr->checksum = 0;
+    icmp_hdr->checksum = ping_checksum(
+        packet, (int)(tx->packet_size < stamped ? tx->packet_size : stamped));
+    tx->pending++;
+    return 0;
+  }
+
+  // スロットには前回送信したパケットが残っているので、
+  // 変わるワード(シーケンス番号と送信時刻)の差分だけチェックサムに反映する
+  uint16_t checksum = icmp_hdr->checksum;
+
+  checksum = ping_checksum_update(checksum, &icmp_hdr->un.echo.sequence,
+                                  &sequence, sizeof(sequence));
+  icmp_hdr->un.echo.sequence = sequence;
+  // データ部が送信時刻より小さい場合は時刻を埋め込まない
+  if (tx->packet_size >= ICMP_HDRLEN + sizeof(struct timespec)) {
+    checksum = ping_checksum_update(checksum, packet + ICMP_HDRLEN, timestamp,
+                                    sizeof(struct timespec));
+    memcpy(packet + ICMP_HDRLEN, timestamp, sizeof(struct timespec));
+  }
+  icmp_hdr->checksum = checksum;
+
+  tx->pending++;
+  return 0;
+}
+
+int flush_tx_engine(PingTxEngine *tx, int sock_fd) {
+  // 送信待ちのパケットをまとめて送信し、送信できた数を返す
+  // 途中で失敗した場合、残りのパケットは破棄する
+  if (!tx || tx->pending == 0) {
+    return 0;
+  }
+
+  int sent = sendmmsg(sock_fd, tx->msgs, tx->pending, 0);
+  tx->syscalls++;
+  tx->pending = 0;
+  if (sent < 0) {
+    // 呼び出し側がerrnoで続けられるエラーか判断するので、perrorで書き換えられないよう残す
+    int err = errno;
+    perror("ft_ping: sendmmsg failed");
+    errno = err;
+    return -1;
+  }
+  tx->probes += sent;
+  return sent;
+}
+
+void close_tx_engine(PingTxEngine *tx) {
+  if (tx) {
+    free(tx->slots);
+    tx->slots = NULL;
+    tx->pending = 0;
+  }
+}
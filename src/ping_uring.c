@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include "ping_uring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ping_uring.c: io_uringでの送受信（--io-uring）を担当するファイル
+// 投入キュー・完了キューはmmapした共有メモリで、受信の完了は読むだけで取り出せる
+// システムコールは送信のバッチごとの io_uring_enter と、止まった受信を登録し直すときだけ
+
+#define URING_SEND 1ULL // user_dataの上位32ビット: sendmsg（下位はスロット番号）
+#define URING_RECV 2ULL // user_dataの上位32ビット: multishot recvmsg
+#define URING_BGID 0    // 受信バッファのグループ番号
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                      flags, NULL, 0);
+}
+
+static int uring_register(int ring_fd, unsigned opcode, void *arg,
+                          unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+// 空いているSQEを1つ取り出す（投入はsubmit_uringでまとめて行う）
+static struct io_uring_sqe *get_sqe(PingUring *ring) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sq_local_tail - head >= ring->sq_entries) {
+    errno = EBUSY;
+    return NULL;
+  }
+  struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & *ring->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  ring->sq_local_tail++;
+  return sqe;
+}
+
+// 書き込んだSQEを投入し、wait個の完了を待つ
+// 戻り値: 0=成功, -1=失敗(errnoを参照)
+static int submit_uring(PingUring *ring, unsigned wait) {
+  __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+  unsigned to_submit = ring->sq_local_tail - ring->sq_submitted;
+  int ret = uring_enter(ring->ring_fd, to_submit, wait,
+                        wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+  if (ret < 0) {
+    return -1;
+  }
+  ring->sq_submitted += (unsigned)ret;
+  return 0;
+}
+
+// 投入できなかったSQEを取り下げる（カーネルはまだ読んでいない）
+static void discard_unsubmitted(PingUring *ring) {
+  ring->sq_local_tail = ring->sq_submitted;
+  __atomic_store_n(ring->sq_tail, ring->sq_submitted, __ATOMIC_RELEASE);
+}
+
+// 完了キューを空にする
+// 送信の結果はsend_resへ、受信したバッファはreadyへ移し、処理は呼び出し側に任せる
+static void reap_uring(PingUring *ring) {
+  unsigned head = *ring->cq_head;
+  unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+  for (; head != tail; head++) {
+    const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    if ((cqe->user_data >> 32) == URING_SEND) {
+      ring->send_res[(uint32_t)cqe->user_data] = cqe->res;
+      if (ring->send_inflight > 0) {
+        ring->send_inflight--;
+      }
+      continue;
+    }
+    // F_MOREがなければmultishotは止まったので、次の受信で登録し直す
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      ring->recv_armed = 0;
+    }
+    if (cqe->res < 0) {
+      // バッファ切れ（-ENOBUFS）はバッファを返してから登録し直せばよい
+      if (cqe->res != -ENOBUFS) {
+        ring->recv_error = -cqe->res;
+      }
+      continue;
+    }
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+      int index = (ring->ready_head + ring->ready_count) % PING_URING_BUFFERS;
+      ring->ready[index].bid = (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      ring->ready[index].len = cqe->res;
+      ring->ready_count++;
+    }
+  }
+  __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// 受信バッファをバッファリングに戻す（publish_buffersでカーネルに見せる）
+// 先頭のエントリのresvはリングの末尾と重なっているので、resvには書かない
+static void return_buffer(PingUring *ring, int bid) {
+  struct io_uring_buf *buf =
+      &ring->buf_ring->bufs[ring->buf_tail & (PING_URING_BUFFERS - 1)];
+  buf->addr = (uint64_t)(uintptr_t)(ring->buffers +
+                                    (size_t)bid * ring->buffer_size);
+  buf->len = (uint32_t)ring->buffer_size;
+  buf->bid = (uint16_t)bid;
+  ring->buf_tail++;
+}
+
+static void publish_buffers(PingUring *ring) {
+  __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+// multishot recvmsgを登録する
+// 1回の登録で、止まるまで（バッファ切れ・エラー）受信するたびに完了が届く
+static int arm_receive(PingUring *ring) {
+  struct io_uring_sqe *sqe = get_sqe(ring);
+  if (!sqe) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = ring->sock_fd;
+  sqe->addr = (uint64_t)(uintptr_t)&ring->recv_msg;
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BGID;
+  sqe->user_data = URING_RECV << 32;
+  if (submit_uring(ring, 0) < 0) {
+    discard_unsubmitted(ring);
+    return -1;
+  }
+  ring->recv_armed = 1;
+  return 0;
+}
+
+PingUring *open_uring(int sock_fd, size_t payload_size) {
+  struct io_uring_params params;
+  PingUring *ring = calloc(1, sizeof(*ring));
+
+  if (!ring) {
+    return NULL;
+  }
+  ring->sock_fd = sock_fd;
+  ring->sq_ring = MAP_FAILED;
+  ring->cq_ring = MAP_FAILED;
+  ring->sqes = MAP_FAILED;
+  ring->buf_ring = MAP_FAILED;
+
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = PING_URING_CQ_ENTRIES;
+  ring->ring_fd = uring_setup(PING_URING_ENTRIES, &params);
+  if (ring->ring_fd < 0) {
+    goto fail;
+  }
+
+  // 投入キュー・完了キュー・SQE配列をmmapする
+  ring->sq_entries = params.sq_entries;
+  ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+    ring->sq_ring_size = ring->cq_ring_size;
+  }
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                       IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED) {
+    goto fail;
+  }
+  if (single_mmap) {
+    ring->cq_ring = ring->sq_ring;
+  } else {
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->ring_fd,
+                         IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED) {
+      goto fail;
+    }
+  }
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    goto fail;
+  }
+  unsigned char *sq = ring->sq_ring;
+  unsigned char *cq = ring->cq_ring;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  // SQEの位置と投入順を一致させる
+  for (unsigned i = 0; i < ring->sq_entries; i++) {
+    ring->sq_array[i] = i;
+  }
+  ring->sq_local_tail = *ring->sq_tail;
+  ring->sq_submitted = ring->sq_local_tail;
+
+  // 受信バッファ: 先頭にrecvmsgの出力ヘッダ、続けて送信元・制御メッセージ・パケットが入る
+  ring->recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+  ring->recv_msg.msg_controllen = PING_RX_CONTROL_SIZE;
+  ring->buffer_size = sizeof(struct io_uring_recvmsg_out) +
+                      sizeof(struct sockaddr_in) + PING_RX_CONTROL_SIZE +
+                      payload_size;
+  ring->buffer_size = (ring->buffer_size + 63) & ~(size_t)63;
+  ring->buffers = malloc((size_t)PING_URING_BUFFERS * ring->buffer_size);
+  if (!ring->buffers) {
+    goto fail;
+  }
+  // バッファリングはページ境界に置く必要がある
+  ring->buf_ring_size = PING_URING_BUFFERS * sizeof(struct io_uring_buf);
+  ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring->buf_ring == MAP_FAILED) {
+    goto fail;
+  }
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+  reg.ring_entries = PING_URING_BUFFERS;
+  reg.bgid = URING_BGID;
+  if (uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    goto fail;
+  }
+  for (int bid = 0; bid < PING_URING_BUFFERS; bid++) {
+    return_buffer(ring, bid);
+  }
+  publish_buffers(ring);
+
+  if (arm_receive(ring) < 0) {
+    goto fail;
+  }
+  // multishot recvmsgに対応していないカーネルでは、登録した時点でエラーが返る
+  reap_uring(ring);
+  if (!ring->recv_armed) {
+    errno = ring->recv_error ? ring->recv_error : EINVAL;
+    goto fail;
+  }
+  return ring;
+
+fail:;
+  int saved = errno;
+  close_uring(ring);
+  errno = saved;
+  return NULL;
+}
+
+int uring_send_batch(PingUring *ring, PingTxEngine *tx) {
+  int count = tx->pending;
+
+  if (count == 0) {
+    return 0;
+  }
+  tx->pending = 0;
+  for (int i = 0; i < count; i++) {
+    // 投入キューは送信のバッチより長いので、空きは必ずある
+    struct io_uring_sqe *sqe = get_sqe(ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = ring->sock_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&tx->msgs[i].msg_hdr;
+    sqe->len = 1;
+    // リンクしておくと、送信に失敗したパケットより後ろは取り消される（-ECANCELED）
+    if (i + 1 < count) {
+      sqe->flags = IOSQE_IO_LINK;
+    }
+    sqe->user_data = (URING_SEND << 32) | (uint64_t)i;
+    ring->send_res[i] = -ECANCELED;
+  }
+  ring->send_inflight = count;
+
+  // スロットは次のバッチで書き換えるので、全ての送信が完了するまで待つ
+  // ソケットへの送信はほとんどio_uring_enterの中で完了するので、待つのは送信バッファが一杯のときだけ
+  unsigned wait = 0;
+  while (ring->send_inflight > 0) {
+    int ret = submit_uring(ring, wait);
+    tx->syscalls++;
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      perror("ft_ping: io_uring_enter failed");
+      discard_unsubmitted(ring);
+      ring->send_inflight = 0;
+      break;
+    }
+    reap_uring(ring);
+    wait = 1;
+  }
+
+  int sent = 0;
+  while (sent < count && ring->send_res[sent] >= 0) {
+    sent++;
+  }
+  if (sent == 0) {
+    int err = -ring->send_res[0];
+    errno = err;
+    perror("ft_ping: io_uring sendmsg failed");
+    errno = err;
+    return -1;
+  }
+  tx->probes += sent;
+  return sent;
+}
+
+int uring_receive_batch(PingUring *ring, PingRxEngine *rx) {
+  // 前回並べたパケットは処理済みなので、バッファをカーネルに返す
+  if (ring->held_count > 0) {
+    for (int i = 0; i < ring->held_count; i++) {
+      return_buffer(ring, ring->held[i]);
+    }
+    publish_buffers(ring);
+    ring->held_count = 0;
+  }
+  reap_uring(ring);
+  if (!ring->recv_armed) {
+    // バッファ切れやエラーで止まった受信を登録し直す
+    rx->syscalls++;
+    if (arm_receive(ring) < 0) {
+      return -1;
+    }
+  }
+  if (ring->recv_error) {
+    errno = ring->recv_error;
+    ring->recv_error = 0;
+    return -1;
+  }
+
+  int count = 0;
+  while (count < PING_RX_BATCH && ring->ready_count > 0) {
+    const PingUringPacket *packet = &ring->ready[ring->ready_head];
+    ring->ready_head = (ring->ready_head + 1) % PING_URING_BUFFERS;
+    ring->ready_count--;
+    ring->held[ring->held_count++] = packet->bid;
+
+    unsigned char *buf = ring->buffers + (size_t)packet->bid * ring->buffer_size;
+    struct io_uring_recvmsg_out out;
+    memcpy(&out, buf, sizeof(out));
+    unsigned char *name = buf + sizeof(out);
+    unsigned char *control = name + ring->recv_msg.msg_namelen;
+    unsigned char *payload = control + ring->recv_msg.msg_controllen;
+    // バッファに収まらなかったパケットは切り詰められている
+    size_t room = (size_t)packet->len - (size_t)(payload - buf);
+    size_t len = out.payloadlen < room ? out.payloadlen : room;
+
+    memset(&rx->addrs[count], 0, sizeof(rx->addrs[count]));
+    memcpy(&rx->addrs[count], name,
+           out.namelen < sizeof(rx->addrs[count]) ? out.namelen
+                                                  : sizeof(rx->addrs[count]));
+    rx->iovs[count].iov_base = payload;
+    rx->msgs[count].msg_len = (unsigned)len;
+    rx->msgs[count].msg_hdr.msg_control = control;
+    rx->msgs[count].msg_hdr.msg_controllen = out.controllen;
+    count++;
+  }
+  rx->packets += count;
+  return count;
+}
+
+int uring_ready(const PingUring *ring) {
+  // 送信の完了を待つ間にmultishotが止まった場合も、登録し直すまで受信は届かない
+  return !ring->recv_armed || ring->ready_count > 0 ||
+         __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) != *ring->cq_head;
+}
+
+void close_uring(PingUring *ring) {
+  if (!ring) {
+    return;
+  }
+  // リングを閉じると登録した受信とバッファリングも解除される
+  if (ring->ring_fd >= 0) {
+    close(ring->ring_fd);
+  }
+  if (ring->sqes != MAP_FAILED) {
+    munmap(ring->sqes, ring->sqes_size);
+  }
+  if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  }
+  if (ring->sq_ring != MAP_FAILED) {
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  }
+  if (ring->buf_ring != MAP_FAILED) {
+    munmap(ring->buf_ring, ring->buf_ring_size);
+  }
+  free(ring->buffers);
+  free(ring);
+}
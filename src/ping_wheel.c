@@ -0,0 +1,208 @@
+#include "ping_wheel.h"
+
+// ping_wheel.c: 応答待ちのタイムアウトを管理する階層タイマーホイールを担当するファイル
+// 段Lのスロットには満了時刻のビット[6L, 6L+6)で振り分けたタイマーを、双方向リストでつなぐ
+// 時刻が段Lのスロットの境界(64^Lの倍数)に達したら、そのスロットのタイマーを下の段へ移し、
+// 段0のスロットに入っているタイマーはその時刻で満了する
+// 登録・取り消しはリストのつなぎ替えだけで、満了の処理もタイマー数によらない
+// （参考: Varghese & Lauck, "Hashed and Hierarchical Timing Wheels"）
+
+#define LEVEL_SHIFT(level) ((level) * PING_WHEEL_BITS)
+#define SLOT_MASK (PING_WHEEL_SLOTS - 1)
+// 最上段でも扱える最大の待ち時間(ミリ秒)
+#define WHEEL_RANGE (1ULL << (PING_WHEEL_LEVELS * PING_WHEEL_BITS))
+
+static unsigned long long rotate_right(unsigned long long bits, int n) {
+  n &= SLOT_MASK;
+  return n == 0 ? bits : (bits >> n) | (bits << (PING_WHEEL_SLOTS - n));
+}
+
+int init_timer_wheel(PingTimerWheel *wheel, int capacity,
+                     unsigned long long now) {
+  wheel->nodes = malloc((size_t)capacity * sizeof(PingTimerNode));
+  if (!wheel->nodes) {
+    return -1;
+  }
+  wheel->capacity = capacity;
+  for (int i = 0; i < capacity; i++) {
+    wheel->nodes[i].bucket = -1;
+  }
+  for (int i = 0; i < PING_WHEEL_LEVELS * PING_WHEEL_SLOTS; i++) {
+    wheel->head[i] = -1;
+  }
+  for (int level = 0; level < PING_WHEEL_LEVELS; level++) {
+    wheel->occupied[level] = 0;
+  }
+  wheel->now = now;
+  wheel->count = 0;
+  return 0;
+}
+
+// 満了時刻に応じた段・スロットのリストの先頭につなぐ（expires >= wheel->now）
+static void link_node(PingTimerWheel *wheel, int id) {
+  PingTimerNode *node = &wheel->nodes[id];
+  unsigned long long delta = node->expires - wheel->now;
+  int level = 0;
+
+  while (level < PING_WHEEL_LEVELS - 1 &&
+         delta >= 1ULL << LEVEL_SHIFT(level + 1)) {
+    level++;
+  }
+  int slot = (int)(node->expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+  int bucket = level * PING_WHEEL_SLOTS + slot;
+
+  node->bucket = bucket;
+  node->prev = -1;
+  node->next = wheel->head[bucket];
+  if (node->next >= 0) {
+    wheel->nodes[node->next].prev = id;
+  }
+  wheel->head[bucket] = id;
+  wheel->occupied[level] |= 1ULL << slot;
+}
+
+static void unlink_node(PingTimerWheel *wheel, int id) {
+  PingTimerNode *node = &wheel->nodes[id];
+  int bucket = node->bucket;
+
+  if (node->prev >= 0) {
+    wheel->nodes[node->prev].next = node->next;
+  } else {
+    wheel->head[bucket] = node->next;
+  }
+  if (node->next >= 0) {
+    wheel->nodes[node->next].prev = node->prev;
+  }
+  if (wheel->head[bucket] < 0) {
+    wheel->occupied[bucket / PING_WHEEL_SLOTS] &=
+        ~(1ULL << (bucket % PING_WHEEL_SLOTS));
+  }
+  node->bucket = -1;
+}
+
+void timer_wheel_add(PingTimerWheel *wheel, int id, unsigned long long expires) {
+  if (id < 0 || id >= wheel->capacity) {
+    return;
+  }
+  if (wheel->nodes[id].bucket >= 0) {
+    unlink_node(wheel, id);
+    wheel->count--;
+  }
+  // 過ぎた時刻は次の時刻に、範囲外は最上段の端に丸める
+  if (expires <= wheel->now) {
+    expires = wheel->now + 1;
+  } else if (expires - wheel->now >= WHEEL_RANGE) {
+    expires = wheel->now + WHEEL_RANGE - 1;
+  }
+  wheel->nodes[id].expires = expires;
+  link_node(wheel, id);
+  wheel->count++;
+}
+
+void timer_wheel_cancel(PingTimerWheel *wheel, int id) {
+  if (id < 0 || id >= wheel->capacity || wheel->nodes[id].bucket < 0) {
+    return;
+  }
+  unlink_node(wheel, id);
+  wheel->count--;
+}
+
+int timer_wheel_pending(const PingTimerWheel *wheel, int id) {
+  return id >= 0 && id < wheel->capacity && wheel->nodes[id].bucket >= 0;
+}
+
+// 時刻wheel->nowのスロットを処理する（上の段から下の段へ移し、段0を満了させる）
+static int process_tick(PingTimerWheel *wheel, void (*expire)(void *, int),
+                        void *arg) {
+  unsigned long long now = wheel->now;
+  int fired = 0;
+
+  for (int level = PING_WHEEL_LEVELS - 1; level > 0; level--) {
+    if ((now & ((1ULL << LEVEL_SHIFT(level)) - 1)) != 0) {
+      continue;
+    }
+    int slot = (int)(now >> LEVEL_SHIFT(level)) & SLOT_MASK;
+    int bucket = level * PING_WHEEL_SLOTS + slot;
+    int id = wheel->head[bucket];
+    wheel->head[bucket] = -1;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    while (id >= 0) {
+      int next = wheel->nodes[id].next;
+      link_node(wheel, id);
+      id = next;
+    }
+  }
+
+  int slot = (int)now & SLOT_MASK;
+  int id = wheel->head[slot];
+  wheel->head[slot] = -1;
+  wheel->occupied[0] &= ~(1ULL << slot);
+  while (id >= 0) {
+    int next = wheel->nodes[id].next;
+    wheel->nodes[id].bucket = -1;
+    wheel->count--;
+    fired++;
+    // コールバックで同じidを登録し直してもよいよう、先に次を取り出しておく
+    expire(arg, id);
+    id = next;
+  }
+  return fired;
+}
+
+int timer_wheel_advance(PingTimerWheel *wheel, unsigned long long now,
+                        void (*expire)(void *arg, int id), void *arg) {
+  int fired = 0;
+
+  while (wheel->now < now) {
+    if (wheel->count == 0) {
+      wheel->now = now;
+      break;
+    }
+    // 下の段が空の間は、空でない段のスロット境界まで一度に進める
+    int level = 0;
+    while (level < PING_WHEEL_LEVELS && wheel->occupied[level] == 0) {
+      level++;
+    }
+    unsigned long long step = 1ULL << LEVEL_SHIFT(level);
+    unsigned long long next = (wheel->now | (step - 1)) + 1;
+    if (next > now) {
+      wheel->now = now;
+      break;
+    }
+    wheel->now = next;
+    fired += process_tick(wheel, expire, arg);
+  }
+  return fired;
+}
+
+long timer_wheel_next(const PingTimerWheel *wheel) {
+  long best = -1;
+
+  if (wheel->count == 0) {
+    return -1;
+  }
+  for (int level = 0; level < PING_WHEEL_LEVELS; level++) {
+    if (wheel->occupied[level] == 0) {
+      continue;
+    }
+    // 現在のスロットの次から数えて最初の空でないスロットが処理される時刻
+    int shift = LEVEL_SHIFT(level);
+    unsigned long long base = wheel->now >> shift;
+    unsigned long long rotated =
+        rotate_right(wheel->occupied[level], (int)((base + 1) & SLOT_MASK));
+    unsigned long long offset = (unsigned long long)__builtin_ctzll(rotated);
+    unsigned long long at = (base + 1 + offset) << shift;
+    long delta = (long)(at - wheel->now);
+    if (best < 0 || delta < best) {
+      best = delta;
+    }
+  }
+  return best;
+}
+
+void close_timer_wheel(PingTimerWheel *wheel) {
+  free(wheel->nodes);
+  wheel->nodes = NULL;
+  wheel->capacity = 0;
+  wheel->count = 0;
+}
@@ -0,0 +1,75 @@
+#include "ping_window.h"
+
+// ping_window.c: 送信記録のリングを担当するファイル
+// 送信番号(0から数えた送信回数)の下位ビットでwindow->size個のスロットを使い回す
+// ICMPのシーケンス番号は送信番号の下位16ビットなので、応答のシーケンス番号からは
+// 直近の送信のうち下位16ビットが一致するものを送信番号として復元する
+// スロットには送信番号を世代タグとして持たせ、上書きされた古い送信と区別する
+// 送信番号は64ビットで数え、フラッドで長時間送り続けても2^31で溢れないようにする
+// スロット数は送信レートと応答待ち時間(-W)から決め、応答待ちの送信を上書きしない
+
+int create_seq_window(PingSeqWindow *window, int size) {
+  window->slots = malloc(size * sizeof(PingSeqSlot));
+  window->size = 0;
+  if (!window->slots) {
+    return -1;
+  }
+  window->size = size;
+  for (int i = 0; i < size; i++) {
+    window->slots[i].number = -1;
+  }
+  return 0;
+}
+
+int seq_window_size(long long in_flight) {
+  if (in_flight > PING_SEQ_WINDOW_MAX) {
+    return -1;
+  }
+  int size = PING_SEQ_WINDOW;
+  while (size < in_flight) {
+    size *= 2;
+  }
+  return size;
+}
+
+int seq_slot_index(const PingSeqWindow *window, long long number) {
+  return (int)(number & (window->size - 1));
+}
+
+PingSeqSlot *claim_seq_slot(PingSeqWindow *window, long long number) {
+  PingSeqSlot *slot = &window->slots[seq_slot_index(window, number)];
+  slot->number = number;
+  slot->received = 0;
+  return slot;
+}
+
+long long seq_window_number(const PingSeqWindow *window, int seq,
+                            long long sent) {
+  if (sent <= 0) {
+    return -1;
+  }
+  long long last = sent - 1;
+  long long number = last - ((last - seq) & 0xFFFF);
+  if (number < 0 || last - number >= window->size) {
+    return -1;
+  }
+  return number;
+}
+
+PingSeqSlot *seq_slot(PingSeqWindow *window, long long number,
+                      long long sent) {
+  if (number < 0 || number >= sent || sent - number > window->size) {
+    return NULL;
+  }
+  PingSeqSlot *slot = &window->slots[seq_slot_index(window, number)];
+  if (slot->number != number) {
+    return NULL;
+  }
+  return slot;
+}
+
+void free_seq_window(PingSeqWindow *window) {
+  free(window->slots);
+  window->slots = NULL;
+  window->size = 0;
+}
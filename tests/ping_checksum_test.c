@@ -0,0 +1,92 @@
+// ping_checksum_test.c: チェックサム実装の一致テスト
+// 幅広ワード・SIMD版と、ping_checksumの選択結果が、16ビットずつ加算する
+// 従来の実装と同じ値を返すことを確認する
+
+#include "ping_checksum.h"
+#include "test_check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LEN 65536
+#define ALIGN_SLACK 8
+
+// 従来のping_checksumと同じ16ビット単位の加算
+// (末尾の奇数バイトは0を補ったワードとして扱う)
+static unsigned short reference_checksum(const unsigned char *buf, int len) {
+  unsigned int sum = 0;
+
+  while (len > 1) {
+    unsigned short word;
+    memcpy(&word, buf, sizeof(word));
+    sum += word;
+    buf += 2;
+    len -= 2;
+  }
+  if (len == 1) {
+    unsigned short word = 0;
+    memcpy(&word, buf, 1);
+    sum += word;
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return (unsigned short)~sum;
+}
+
+static void check_sum(const char *name, unsigned short got, unsigned short want,
+                      int len, int offset) {
+  check_that(got == want, "%s len=%d offset=%d: got 0x%04x want 0x%04x", name,
+             len, offset, got, want);
+}
+
+static void check_all(unsigned char *buf, int len, int offset) {
+  unsigned short want = reference_checksum(buf, len);
+
+  check_sum("ping_checksum", ping_checksum(buf, len), want, len, offset);
+  check_sum("scalar", ping_checksum_scalar(buf, len), want, len, offset);
+  check_sum("wide", ping_checksum_wide(buf, len), want, len, offset);
+#ifdef PING_CHECKSUM_HAVE_SIMD
+  check_sum("sse2", ping_checksum_sse2(buf, len), want, len, offset);
+  if (ping_checksum_avx2_supported()) {
+    check_sum("avx2", ping_checksum_avx2(buf, len), want, len, offset);
+  }
+#endif
+}
+
+int main(void) {
+  unsigned char *storage = malloc(MAX_LEN + ALIGN_SLACK);
+  if (!storage) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+
+  srand(42);
+  for (int i = 0; i < MAX_LEN + ALIGN_SLACK; i++) {
+    storage[i] = (unsigned char)rand();
+  }
+
+  // 短い長さは全て、ずらした先頭アドレスでも確認する
+  for (int offset = 0; offset < ALIGN_SLACK; offset++) {
+    for (int len = 0; len <= 2048; len++) {
+      check_all(storage + offset, len, offset);
+    }
+  }
+
+  // 大きなペイロード(-sの上限付近)
+  const int large[] = {1472, 8972, 9000, 32767, 65515, MAX_LEN};
+  for (size_t i = 0; i < sizeof(large) / sizeof(large[0]); i++) {
+    check_all(storage, large[i], 0);
+    check_all(storage + 1, large[i] - 1, 1);
+  }
+
+  // 桁上がりが最大になる全ビット1のデータ
+  memset(storage, 0xFF, MAX_LEN + ALIGN_SLACK);
+  for (int len = MAX_LEN - 64; len <= MAX_LEN; len++) {
+    check_all(storage, len, 0);
+  }
+
+  free(storage);
+  return check_report("ping_checksum_test", NULL);
+}
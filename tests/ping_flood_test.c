@@ -0,0 +1,70 @@
+// ping_flood_test.c: 応答しない宛先を混ぜたfloodのテスト
+// 127.0.0.1と応答しない240.0.0.1へ-f -l 16 -W 0.02で-cの数だけ送り、
+// タイムアウトした送信が応答待ちの数から外れて送信が止まらないことを確認する
+// （外れなければ失った数がpreloadを超えた後は送信がPING_FLOOD_TIMEOUTごとの1回に落ち、
+// 終わるまでに数秒かかる）
+// ソケットを開けない環境や、240.0.0.1への経路がない環境では確認を省く
+
+#include "ftping.h"
+#include "test_check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COUNT 200       // 宛先ごとの送信数
+#define PRELOAD 16      // 応答を待たずに送信できる数
+#define LINGER 0.02     // 応答を待つ時間(秒)
+#define TIME_LIMIT 2.0  // 終わるまでの時間の上限(秒)（修正前は約4秒かかる）
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+  PingContext ctx;
+
+  if (initialize_context(&ctx) < 0 || add_target(&ctx, "127.0.0.1") < 0 ||
+      add_target(&ctx, "240.0.0.1") < 0) {
+    fprintf(stderr, "ping_flood_test: failed to initialize context\n");
+    return EXIT_FAILURE;
+  }
+  ctx.quiet = 1;
+  ctx.flood_mode = 1;
+  ctx.preload = PRELOAD;
+  ctx.count = COUNT;
+  ctx.linger = LINGER;
+  ctx.deadline = 10.0; // 送信できない環境でも止まるように
+  if (setup_engine(&ctx, PING_INTERVAL) < 0) {
+    printf("ping_flood_test: skipped (cannot open an ICMP socket)\n");
+    return EXIT_SUCCESS;
+  }
+
+  double start = now_seconds();
+  int ret = run_ping_loop(&ctx);
+  double elapsed = now_seconds() - start;
+  if (ctx.targets[1].packets_sent == 0) {
+    printf("ping_flood_test: skipped (no route to 240.0.0.1)\n");
+    cleanup_context(&ctx);
+    return EXIT_SUCCESS;
+  }
+
+  check("run", ret < 0, 0);
+  check("sent alive", ctx.targets[0].packets_sent, COUNT);
+  check("sent dead", ctx.targets[1].packets_sent, COUNT);
+  check("received alive", ctx.targets[0].packets_received, COUNT);
+  check("received dead", ctx.targets[1].packets_received, 0);
+  check("timed out", ctx.packets_timeout, COUNT);
+  check("in time", elapsed < TIME_LIMIT, 1);
+  if (elapsed >= TIME_LIMIT) {
+    fprintf(stderr, "ping_flood_test: took %.3f s\n", elapsed);
+  }
+
+  cleanup_context(&ctx);
+  char note[32];
+  snprintf(note, sizeof(note), "(%.3f s)", elapsed);
+  return check_report("ping_flood_test", note);
+}
@@ -0,0 +1,123 @@
+// ping_lib_test.c: libftpingを呼び出し側のイベントループに組み込むテスト
+// 1つのスレッドで3つのコンテキストを同時に127.0.0.1へ送り、外側のepollで待ちながら
+// step_ping_loopで進める。コンテキストごとに識別子が異なり、応答を取り合わずに
+// on_resultと統計が-cの数だけ揃うこと、on_resultの中からstop_ping_loopで止められることを確認する
+// 2つ目のコンテキストはio_uringで送受信する（使えない環境ではsendmmsg/recvmmsgに切り替わる）
+// ソケットを開けない環境（RAWもデータグラムも許可されていない）では確認を省く
+
+#include "ftping.h"
+#include "test_check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#define CONTEXTS 3
+#define COUNT 5
+#define STOP_AFTER 3 // 最後のコンテキストは-cなしで送り、この数の応答で止める
+
+typedef struct {
+  int replies;    // REPLYの数
+  int others;     // REPLY以外の数
+  int bad_target; // 宛先インデックスやRTTがおかしい結果の数
+} Results;
+
+static void on_result(PingContext *ctx, const PingResult *result) {
+  Results *results = ctx->user_data;
+  if (result->kind != PING_RESULT_REPLY) {
+    results->others++;
+    return;
+  }
+  results->replies++;
+  if (result->target != 0 || result->rtt < 0.0 || !result->from ||
+      result->bytes != ICMP_HDRLEN + ICMP_DATA_SIZE) {
+    results->bad_target++;
+  }
+  if (ctx->count == 0 && results->replies == STOP_AFTER) {
+    stop_ping_loop(ctx);
+  }
+}
+
+int main(void) {
+  PingContext ctx[CONTEXTS];
+  Results results[CONTEXTS];
+  int epoll_fd = epoll_create1(0);
+
+  memset(results, 0, sizeof(results));
+  for (int i = 0; i < CONTEXTS; i++) {
+    if (initialize_context(&ctx[i]) < 0 ||
+        add_target(&ctx[i], "127.0.0.1") < 0) {
+      fprintf(stderr, "ping_lib_test: failed to initialize context\n");
+      return EXIT_FAILURE;
+    }
+    ctx[i].quiet = 1;
+    ctx[i].count = i < CONTEXTS - 1 ? COUNT : 0;
+    ctx[i].linger = 2.0;
+    ctx[i].on_result = on_result;
+    ctx[i].io_uring = i == 1;
+    ctx[i].user_data = &results[i];
+    if (setup_engine(&ctx[i], 0.01) < 0) {
+      printf("ping_lib_test: skipped (cannot open an ICMP socket)\n");
+      return EXIT_SUCCESS;
+    }
+    if (start_ping_loop(&ctx[i]) < 0) {
+      return EXIT_FAILURE;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &ctx[i]};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ctx[i].epoll_fd, &ev);
+  }
+
+  // 外側のイベントループ: 最も早い期限まで待ち、読めるようになったコンテキストを進める
+  int running = CONTEXTS;
+  int active[CONTEXTS] = {1, 1, 1};
+  for (int rounds = 0; running > 0 && rounds < 100000; rounds++) {
+    int timeout = -1;
+    for (int i = 0; i < CONTEXTS; i++) {
+      int t = active[i] ? ping_loop_timeout_ms(&ctx[i]) : -1;
+      if (t >= 0 && (timeout < 0 || t < timeout)) {
+        timeout = t;
+      }
+    }
+    struct epoll_event events[CONTEXTS];
+    int n = epoll_wait(epoll_fd, events, CONTEXTS, timeout < 0 ? 1000 : timeout);
+    int ready[CONTEXTS] = {0};
+    for (int e = 0; e < n; e++) {
+      ready[(PingContext *)events[e].data.ptr - ctx] = 1;
+    }
+    for (int i = 0; i < CONTEXTS; i++) {
+      if (!active[i] || (!ready[i] && ping_loop_timeout_ms(&ctx[i]) != 0)) {
+        continue;
+      }
+      int ret = step_ping_loop(&ctx[i], 0);
+      check("step_ping_loop", ret < 0, 0);
+      if (ret <= 0) {
+        active[i] = 0;
+        running--;
+      }
+    }
+  }
+
+  check("finished", running, 0);
+  check("distinct idents", ctx[0].ident != ctx[1].ident &&
+                               ctx[1].ident != ctx[2].ident &&
+                               ctx[0].ident != ctx[2].ident,
+        1);
+  for (int i = 0; i < CONTEXTS - 1; i++) {
+    check("sent", ctx[i].packets_sent, COUNT);
+    check("received", ctx[i].packets_received, COUNT);
+    check("replies", results[i].replies, COUNT);
+  }
+  check("stopped", results[CONTEXTS - 1].replies, STOP_AFTER);
+  check("stopped received", ctx[CONTEXTS - 1].packets_received, STOP_AFTER);
+  for (int i = 0; i < CONTEXTS; i++) {
+    check("other results", results[i].others, 0);
+    check("result fields", results[i].bad_target, 0);
+    check("duplicate", ctx[i].packets_duplicate, 0);
+    check("late", ctx[i].packets_late, 0);
+    cleanup_context(&ctx[i]);
+  }
+  close(epoll_fd);
+
+  return check_report("ping_lib_test", NULL);
+}
@@ -0,0 +1,156 @@
+// ping_output_test.c: 受信結果の出力（JSON Lines/CSV）のテスト
+// "と\と,を含む名前がJSONではエスケープされ、CSVでは"で囲まれることと、
+// 64KiBの出力バッファが行の途中で書き出さないことを確認する
+// 出力は一時ファイルに書くので、どの環境でも実行できる
+
+#include "ping_output.h"
+#include "ping_engine.h"
+#include "ping_target.h"
+#include "test_check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LINES 20000 // バッファを何度も書き出す行数
+
+// ファイルの先頭からの内容をbufに読む（戻り値: 読んだバイト数）
+static ssize_t read_all(int fd, char *buf, size_t size) {
+  ssize_t n = pread(fd, buf, size - 1, 0);
+  buf[n > 0 ? n : 0] = '\0';
+  return n;
+}
+
+// ファイルを空にし、書き込み位置を先頭に戻す
+static void reset_file(int fd) {
+  if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+    perror("reset");
+  }
+}
+
+static void check_line(const char *name, const char *got, const char *want) {
+  check_that(strcmp(got, want) == 0, "%s: got [%s] want [%s]", name, got, want);
+}
+
+static void check_escape(PingContext *ctx, int fd) {
+  PingTarget *target = &ctx->targets[0];
+  const char *name = "a\"b\\c,d";
+  char text[512];
+
+  ctx->format = PING_FORMAT_JSONL;
+  reset_file(fd);
+  output_reply(ctx, target, name, 64, 1, 64, 0.5, 0);
+  output_reply(ctx, target, "tab\there", 64, 2, 64, 0.5, 1);
+  output_reply(ctx, target, target->ip, 64, 3, 64, 0.5, 0);
+  flush_output(&ctx->out);
+  read_all(fd, text, sizeof(text));
+  check_line("jsonl escape", text,
+             "{\"addr\":\"a\\\"b\\\\c,d\",\"seq\":1,\"ttl\":64,\"bytes\":64,"
+             "\"rtt_ms\":0.500,\"status\":\"reply\"}\n"
+             "{\"addr\":\"tab\\u0009here\",\"seq\":2,\"ttl\":64,\"bytes\":64,"
+             "\"rtt_ms\":0.500,\"status\":\"dup\"}\n"
+             "{\"addr\":\"127.0.0.1\",\"seq\":3,\"ttl\":64,\"bytes\":64,"
+             "\"rtt_ms\":0.500,\"status\":\"reply\"}\n");
+
+  // CSVでは\は特別な文字ではないので、そのまま"で囲む
+  ctx->format = PING_FORMAT_CSV;
+  reset_file(fd);
+  output_reply(ctx, target, name, 64, 1, 64, 0.5, 0);
+  output_reply(ctx, target, "plain\\name", 64, 2, 64, 0.5, 0);
+  output_reply(ctx, target, "line\nbreak", 64, 3, 64, 0.5, 1);
+  output_lost(ctx, target, 4);
+  flush_output(&ctx->out);
+  read_all(fd, text, sizeof(text));
+  check_line("csv quote", text,
+             "\"a\"\"b\\c,d\",1,64,64,0.500,reply\n"
+             "plain\\name,2,64,64,0.500,reply\n"
+             "\"line\nbreak\",3,64,64,0.500,dup\n"
+             "127.0.0.1,4,,,,lost\n");
+}
+
+// 書き出すたびに、ファイルの末尾が行の終わりになっているか
+static void check_whole_lines(PingContext *ctx, int fd) {
+  PingTarget *target = &ctx->targets[0];
+  char name[64];
+  off_t last_size = 0;
+  long flushes = 0;
+  long torn = 0;
+
+  ctx->format = PING_FORMAT_JSONL;
+  reset_file(fd);
+  for (int i = 0; i < LINES; i++) {
+    // 長さの違う行を混ぜ、バッファの境界が行の途中に来るようにする
+    snprintf(name, sizeof(name), "host-%d\"%.*s", i, i % 23,
+             "\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\");
+    output_reply(ctx, target, name, 64, i & 0xFFFF, 64, i * 0.001, 0);
+
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size != last_size) {
+      char c = '\0';
+      if (pread(fd, &c, 1, st.st_size - 1) != 1 || c != '\n') {
+        torn++;
+      }
+      last_size = st.st_size;
+      flushes++;
+    }
+  }
+  flush_output(&ctx->out);
+  check("torn flushes", torn, 0);
+  check("buffer flushed", flushes > 1, 1);
+
+  // 書き出した内容は行の数も中身も欠けていない
+  struct stat st;
+  fstat(fd, &st);
+  char *text = malloc((size_t)st.st_size + 1);
+  if (!text) {
+    check("malloc", 0, 1);
+    return;
+  }
+  read_all(fd, text, (size_t)st.st_size + 1);
+  long lines = 0;
+  long bad = 0;
+  for (char *line = text; *line; lines++) {
+    char *end = strchr(line, '\n');
+    if (!end) {
+      bad++;
+      break;
+    }
+    if (strncmp(line, "{\"addr\":\"host-", 14) != 0 || end[-1] != '}') {
+      bad++;
+    }
+    line = end + 1;
+  }
+  check("lines", lines, LINES);
+  check("bad lines", bad, 0);
+  free(text);
+}
+
+int main(void) {
+  char path[] = "/tmp/ping_output_test.XXXXXX";
+  int fd = mkstemp(path);
+  PingContext ctx;
+
+  if (fd < 0) {
+    perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  if (initialize_context(&ctx) < 0 || add_target(&ctx, "127.0.0.1") < 0 ||
+      init_output(&ctx.out, fd) < 0) {
+    fprintf(stderr, "ping_output_test: failed to initialize\n");
+    unlink(path);
+    return EXIT_FAILURE;
+  }
+  check("buffer size", (long long)ctx.out.cap, PING_OUTPUT_BUFSIZE);
+
+  check_escape(&ctx, fd);
+  check_whole_lines(&ctx, fd);
+
+  close_output(&ctx.out);
+  cleanup_context(&ctx);
+  close(fd);
+  unlink(path);
+  return check_report("ping_output_test", NULL);
+}
@@ -0,0 +1,88 @@
+// ping_profile_test.c: -Xの段階ごとの計測のテスト
+// 記録したバケット・回数・最大値、スレッド分割時の合算、表示する段階を確認する
+// 計測のコードを含めるため-DPING_PROFILEでコンパイルする（Makefileを参照）
+
+#include "ping_profile.h"
+#include "test_check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 計測区間を1つ記録する（ctx->profがNULLなら何もしない）
+static void measure(PingContext *ctx, PingProfStage stage, int items) {
+  PING_PROF_BEGIN(ctx, start);
+  PING_PROF_END(ctx, stage, start, items);
+}
+
+int main(void) {
+  PingContext a, b;
+  memset(&a, 0, sizeof(a));
+  memset(&b, 0, sizeof(b));
+
+  // 計測していないエンジンでは何も記録しない
+  measure(&a, PING_PROF_RECV, 1);
+  check("disabled", a.prof == NULL, 1);
+
+  check("open", open_profile(&a), 0);
+  if (!a.prof) {
+    return EXIT_FAILURE;
+  }
+  check("contexts", a.prof->contexts, 1);
+  measure(&a, PING_PROF_RECV, 64);
+  measure(&a, PING_PROF_RECV, 3);
+  check("calls", a.prof->stages[PING_PROF_RECV].calls, 2);
+  check("items", a.prof->stages[PING_PROF_RECV].items, 67);
+  check("other stage untouched", a.prof->stages[PING_PROF_SEND].calls, 0);
+
+  // バケットbは[2^(b-1), 2^b)、0は0、範囲外は最上位
+  PingProfStat *stat = &a.prof->stages[PING_PROF_WAIT];
+  profile_record(a.prof, PING_PROF_WAIT, 0, 0);
+  profile_record(a.prof, PING_PROF_WAIT, 1, 0);
+  profile_record(a.prof, PING_PROF_WAIT, 1000, 0);
+  profile_record(a.prof, PING_PROF_WAIT, 1024, 0);
+  profile_record(a.prof, PING_PROF_WAIT, 1ULL << 50, 0);
+  check("bucket 0", stat->hist[0], 1);
+  check("bucket 1", stat->hist[1], 1);
+  check("bucket 1000", stat->hist[10], 1);
+  check("bucket 1024", stat->hist[11], 1);
+  check("bucket top", stat->hist[PING_PROF_BUCKETS - 1], 1);
+  check("max", stat->max == 1ULL << 50, 1);
+  check("ticks", stat->ticks == (1ULL << 50) + 2025, 1);
+
+  // スレッド分割時はワーカーの計測値を、計測していないメインの側に合算する
+  check("open b", open_profile(&b), 0);
+  profile_record(b.prof, PING_PROF_WAIT, 7, 2);
+  profile_record(b.prof, PING_PROF_SEND, 100, 64);
+  PingContext merged;
+  memset(&merged, 0, sizeof(merged));
+  merge_profile(&merged, &a);
+  merge_profile(&merged, &b);
+  if (!merged.prof) {
+    return EXIT_FAILURE;
+  }
+  check("merged contexts", merged.prof->contexts, 2);
+  check("merged calls", merged.prof->stages[PING_PROF_WAIT].calls, 6);
+  check("merged items", merged.prof->stages[PING_PROF_SEND].items, 64);
+  check("merged bucket", merged.prof->stages[PING_PROF_WAIT].hist[3], 1);
+  check("merged max", merged.prof->stages[PING_PROF_WAIT].max == 1ULL << 50,
+        1);
+
+  // 記録のある段階だけを表示する
+  char text[4096];
+  FILE *stream = fmemopen(text, sizeof(text), "w");
+  print_profile(&merged, stream);
+  fclose(stream);
+  check("print header", strstr(text, "--- profile (") != NULL, 1);
+  check("print engines", strstr(text, "2 engines") != NULL, 1);
+  check("print wait", strstr(text, "epoll_wait") != NULL, 1);
+  check("print send", strstr(text, "\nsend ") != NULL, 1);
+  check("skip unused", strstr(text, "checksum") == NULL, 1);
+
+  close_profile(&merged);
+  close_profile(&b);
+  close_profile(&a);
+  check("closed", a.prof == NULL, 1);
+
+  return check_report("ping_profile_test", NULL);
+}
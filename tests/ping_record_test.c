@@ -0,0 +1,153 @@
+// ping_record_test.c: 記録ファイルの書き込みと読み込みのテスト
+// 応答・重複・タイムアウト・タイムアウト後の応答・照合できない古い応答・終了時の応答待ちを
+// 含む送受信を記録し（記録の窓を何度も進める量）、読み込んだ統計が元の統計と一致するか確認する
+// 終了時に応答を待っていた送信はUNANSWEREDとして残るので、送信数も一致する
+
+#include "ping.h"
+#include "ping_engine.h"
+#include "ping_packet.h"
+#include "ping_record.h"
+#include "ping_stats.h"
+#include "ping_target.h"
+#include "ping_wheel.h"
+#include "ping_window.h"
+#include "test_check.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROBES 600000
+#define LINGER_MS 1000
+
+static struct timespec at_us(long long us) {
+  struct timespec ts = {us / 1000000, (us % 1000000) * 1000};
+  return ts;
+}
+
+// 送信番号numberへのEcho Replyを時刻nowに受信する
+static void reply(PingContext *ctx, int number, const struct timespec *sent,
+                  const struct timespec *now, int target) {
+  unsigned char packet[ICMP_HDRLEN + ICMP_DATA_SIZE];
+  struct icmphdr *icmp = (struct icmphdr *)packet;
+
+  memset(packet, 0, sizeof(packet));
+  icmp->type = ICMP_ECHOREPLY;
+  icmp->un.echo.id = htons(ctx->ident);
+  icmp->un.echo.sequence = htons(number & 0xFFFF);
+  memcpy(packet + ICMP_HDRLEN, sent, sizeof(*sent));
+  process_icmp(ctx, icmp, sizeof(packet), 64, &ctx->targets[target].addr, now,
+               NULL);
+}
+
+int main(void) {
+  char path[] = "/tmp/ping_record_testXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  PingContext ctx;
+  if (initialize_context(&ctx) < 0 ||
+      init_timer_wheel(&ctx.wheel, ctx.window.size, 0) < 0) {
+    perror("initialize_context");
+    return EXIT_FAILURE;
+  }
+  // データグラムソケットとして扱い、チェックサムの計算を省く
+  ctx.socket_type = PING_SOCKET_DGRAM;
+  ctx.quiet = 1;
+  ctx.linger = LINGER_MS / 1000.0;
+  const char *hosts[2] = {"127.0.0.1", "localhost"};
+  for (int i = 0; i < 2; i++) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(0x7F000001 + i);
+    add_resolved_target(&ctx, hosts[i], &addr);
+  }
+  ctx.record_path = path;
+  if (start_recording(&ctx, 0) < 0) {
+    return EXIT_FAILURE;
+  }
+
+  // 1ミリ秒ごとに送り、10回に1回は応答なし、97回に1回は重複
+  // 応答のなかった送信のうち1000回に1回は、タイムアウトした後に応答が届く
+  for (int number = 0; number < PROBES; number++) {
+    struct timespec sent = at_us(number * 1000LL);
+    struct timespec now = sent;
+    int target = number % 2;
+    expire_probes(&ctx, &now);
+
+    int index = seq_slot_index(&ctx.window, number);
+    if (timer_wheel_pending(&ctx.wheel, index)) {
+      timer_wheel_cancel(&ctx.wheel, index);
+      expire_probe(&ctx, index);
+    }
+    PingSeqSlot *slot = claim_seq_slot(&ctx.window, number);
+    slot->target = target;
+    slot->sent_time = sent;
+    ctx.packets_sent++;
+    ctx.targets[target].packets_sent++;
+    timer_wheel_add(&ctx.wheel, index, number + LINGER_MS);
+
+    if (number % 10 != 0) {
+      struct timespec recv = at_us(number * 1000LL + 37 + number % 311);
+      reply(&ctx, number, &sent, &recv, target);
+      if (number % 97 == 0) {
+        reply(&ctx, number, &sent, &recv, target);
+      }
+    }
+    if (number % 1000 == 500 && number >= 1500) {
+      int late = number - 1500;
+      struct timespec late_sent = at_us(late * 1000LL);
+      reply(&ctx, late, &late_sent, &now, late % 2);
+    }
+    if (number % 5000 == 1 && number > 20000) {
+      struct timespec old_sent = at_us((number - 20000) * 1000LL);
+      reply(&ctx, number - 20000, &old_sent, &now, 0);
+    }
+  }
+  stop_recording(&ctx);
+
+  PingContext read;
+  initialize_context(&read);
+  long records = read_record_file(&read, path);
+  unlink(path);
+
+  check_near("records", records > PROBES, 1, 0);
+  check_near("all kinds", ctx.packets_duplicate > 0 && ctx.packets_timeout > 0 &&
+                         ctx.packets_late > 0,
+        1, 0);
+  check_near("sent", read.packets_sent, ctx.packets_sent, 0);
+  check_near("received", read.packets_received, ctx.packets_received, 0);
+  check_near("duplicate", read.packets_duplicate, ctx.packets_duplicate, 0);
+  check_near("timeout", read.packets_timeout, ctx.packets_timeout, 0);
+  check_near("late", read.packets_late, ctx.packets_late, 0);
+  check_near("linger", read.linger, ctx.linger, 0);
+  check_near("rtt count", read.rtt_count, ctx.rtt_count, 0);
+  check_near("rtt min", read.rtt_min, ctx.rtt_min, 1e-9);
+  check_near("rtt max", read.rtt_max, ctx.rtt_max, 1e-9);
+  check_near("rtt sum", read.rtt_sum, ctx.rtt_sum, 1e-6);
+  check_near("rtt sum2", read.rtt_sum2, ctx.rtt_sum2, 1e-6);
+  check_near("p50", histogram_percentile(&read.rtt_hist, 50.0),
+        histogram_percentile(&ctx.rtt_hist, 50.0), 0);
+  check_near("p99.9", histogram_percentile(&read.rtt_hist, 99.9),
+        histogram_percentile(&ctx.rtt_hist, 99.9), 0);
+  check_near("targets", read.target_count, 2, 0);
+  for (int i = 0; i < 2 && i < read.target_count; i++) {
+    check_near("target sent", read.targets[i].packets_sent,
+          ctx.targets[i].packets_sent, 0);
+    check_near("target received", read.targets[i].packets_received,
+          ctx.targets[i].packets_received, 0);
+    check_near("target duplicate", read.targets[i].packets_duplicate,
+          ctx.targets[i].packets_duplicate, 0);
+    check_near("target name", strcmp(read.targets[i].hostname, hosts[i]), 0, 0);
+  }
+  cleanup_context(&ctx);
+  cleanup_context(&read);
+  return check_report("ping_record_test", NULL);
+}
@@ -0,0 +1,245 @@
+// ping_replay_test.c: キャプチャ再生のテスト
+// 応答の欠落・重複・チェックサム不正・他のプロセスの通信を含むキャプチャを作り、
+// pcap（Ethernet）とpcapng（ビッグエンディアン、Linux cooked v2、ナノ秒）の両方で
+// 再生して、送信数・受信数・重複・タイムアウト・RTTが同じになることを確認する
+
+#include "ping.h"
+#include "ping_checksum.h"
+#include "ping_engine.h"
+#include "ping_replay.h"
+#include "test_check.h"
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IDENT 0x1234
+#define FIRST_SEQ 65530 // 途中でシーケンス番号が一周する
+#define PROBES 10
+#define LOST 3          // 応答のない送信
+#define DUPLICATE 5     // 応答が2回届く送信
+#define BAD_CHECKSUM 7  // 壊れた応答だけが届く送信
+
+static const char *current = ""; // 実行中のケース名
+
+static void check_case(const char *name, double got, double want) {
+  check_that(got == want, "%s %s: got %g want %g", current, name, got, want);
+}
+
+typedef struct {
+  int pcapng;
+  FILE *fp;
+} Writer;
+
+static void put_u16(unsigned char *p, unsigned value, int big_endian) {
+  p[big_endian ? 0 : 1] = (value >> 8) & 0xFF;
+  p[big_endian ? 1 : 0] = value & 0xFF;
+}
+
+static void put_u32(unsigned char *p, uint32_t value, int big_endian) {
+  for (int i = 0; i < 4; i++) {
+    p[big_endian ? i : 3 - i] = (value >> (24 - 8 * i)) & 0xFF;
+  }
+}
+
+// IPv4/ICMPパケットを組み立てる（payloadはデータ部の先頭16バイト）
+static int build_icmp(unsigned char *p, int type, int ident, int seq,
+                      uint32_t src, uint32_t dst, const unsigned char *payload,
+                      int corrupt) {
+  int icmp_len = ICMP_HDRLEN + ICMP_DATA_SIZE;
+  memset(p, 0, 20 + icmp_len);
+  p[0] = 0x45;
+  put_u16(p + 2, 20 + icmp_len, 1);
+  p[8] = 64;
+  p[9] = IPPROTO_ICMP;
+  memcpy(p + 12, &src, 4);
+  memcpy(p + 16, &dst, 4);
+  unsigned char *icmp = p + 20;
+  icmp[0] = type;
+  put_u16(icmp + 4, ident, 1);
+  put_u16(icmp + 6, seq, 1);
+  memcpy(icmp + ICMP_HDRLEN, payload, 16);
+  unsigned short sum = ping_checksum(icmp, icmp_len);
+  memcpy(icmp + 2, &sum, 2);
+  if (corrupt) {
+    icmp[ICMP_HDRLEN + 20] ^= 0xFF;
+  }
+  return 20 + icmp_len;
+}
+
+static void write_header(Writer *w) {
+  unsigned char h[64];
+  if (!w->pcapng) {
+    // pcap: リトルエンディアン、マイクロ秒、Ethernet
+    memset(h, 0, 24);
+    put_u32(h, 0xA1B2C3D4, 0);
+    put_u16(h + 4, 2, 0);
+    put_u16(h + 6, 4, 0);
+    put_u32(h + 16, 65535, 0);
+    put_u32(h + 20, 1, 0);
+    fwrite(h, 1, 24, w->fp);
+    return;
+  }
+  // pcapng: ビッグエンディアンのSHBと、Linux cooked v2・ナノ秒のIDB
+  memset(h, 0, sizeof(h));
+  put_u32(h, 0x0A0D0D0A, 1);
+  put_u32(h + 4, 28, 1);
+  put_u32(h + 8, 0x1A2B3C4D, 1);
+  put_u16(h + 12, 1, 1);
+  put_u32(h + 16, 0xFFFFFFFF, 1);
+  put_u32(h + 20, 0xFFFFFFFF, 1);
+  put_u32(h + 24, 28, 1);
+  fwrite(h, 1, 28, w->fp);
+  memset(h, 0, sizeof(h));
+  put_u32(h, 1, 1);
+  put_u32(h + 4, 32, 1);
+  put_u16(h + 8, 276, 1);
+  put_u32(h + 12, 65535, 1);
+  put_u16(h + 16, 9, 1); // if_tsresol = 10^-9
+  put_u16(h + 18, 1, 1);
+  h[20] = 9;
+  put_u32(h + 28, 32, 1);
+  fwrite(h, 1, 32, w->fp);
+}
+
+// 時刻ms（ミリ秒）のパケットを1つ書く
+static void write_packet(Writer *w, long ms, const unsigned char *ip, int len) {
+  unsigned char frame[256], h[32];
+  int link = w->pcapng ? 20 : 14;
+
+  memset(frame, 0, link);
+  if (w->pcapng) {
+    put_u16(frame, 0x0800, 1);
+  } else {
+    put_u16(frame + 12, 0x0800, 1);
+  }
+  memcpy(frame + link, ip, len);
+  int caplen = link + len;
+
+  if (!w->pcapng) {
+    put_u32(h, 1700000000 + ms / 1000, 0);
+    put_u32(h + 4, (ms % 1000) * 1000, 0);
+    put_u32(h + 8, caplen, 0);
+    put_u32(h + 12, caplen, 0);
+    fwrite(h, 1, 16, w->fp);
+    fwrite(frame, 1, caplen, w->fp);
+    return;
+  }
+  int padded = (caplen + 3) & ~3;
+  uint64_t ns = (1700000000ULL * 1000 + ms) * 1000000ULL;
+  put_u32(h, 6, 1);
+  put_u32(h + 4, 32 + padded, 1);
+  put_u32(h + 8, 0, 1);
+  put_u32(h + 12, ns >> 32, 1);
+  put_u32(h + 16, ns & 0xFFFFFFFF, 1);
+  put_u32(h + 20, caplen, 1);
+  put_u32(h + 24, caplen, 1);
+  fwrite(h, 1, 28, w->fp);
+  memset(frame + caplen, 0, padded - caplen);
+  fwrite(frame, 1, padded, w->fp);
+  put_u32(h, 32 + padded, 1);
+  fwrite(h, 1, 4, w->fp);
+}
+
+// 2宛先へ交互にPROBES回送り、10ミリ秒後に応答が届くキャプチャを作る
+static void write_capture(const char *path, int pcapng) {
+  Writer w = {pcapng, fopen(path, "wb")};
+  uint32_t self = inet_addr("10.0.0.1");
+  uint32_t peers[2] = {inet_addr("10.0.0.2"), inet_addr("10.0.0.3")};
+  unsigned char ip[128], payload[16];
+
+  if (!w.fp) {
+    perror("fopen");
+    exit(EXIT_FAILURE);
+  }
+  write_header(&w);
+  for (int i = 0; i < PROBES; i++) {
+    int seq = (FIRST_SEQ + i) & 0xFFFF;
+    uint32_t peer = peers[i % 2];
+    long ms = i * 100;
+    memset(payload, 0, sizeof(payload));
+    payload[0] = (unsigned char)i;
+    payload[8] = 0xA5;
+
+    write_packet(&w, ms, ip, build_icmp(ip, 8, IDENT, seq, self, peer, payload, 0));
+    // 他のプロセスのEcho Requestと応答は数えない
+    write_packet(&w, ms + 1, ip,
+                 build_icmp(ip, 8, IDENT + 1, seq, self, peer, payload, 0));
+    write_packet(&w, ms + 2, ip,
+                 build_icmp(ip, 0, IDENT + 1, seq, peer, self, payload, 0));
+    if (i == LOST) {
+      continue;
+    }
+    write_packet(&w, ms + 10, ip,
+                 build_icmp(ip, 0, IDENT, seq, peer, self, payload,
+                            i == BAD_CHECKSUM));
+    if (i == DUPLICATE) {
+      write_packet(&w, ms + 20, ip,
+                   build_icmp(ip, 0, IDENT, seq, peer, self, payload, 0));
+    }
+  }
+  // 応答待ちのタイムアウトまで時刻を進める
+  write_packet(&w, PROBES * 100 + 5000, ip,
+               build_icmp(ip, 8, IDENT + 1, 0, self, peers[0], payload, 0));
+  fclose(w.fp);
+}
+
+static void run_case(const char *name, int pcapng) {
+  char path[] = "/tmp/ping_replay_testXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  write_capture(path, pcapng);
+
+  PingContext ctx;
+  if (initialize_context(&ctx) < 0) {
+    perror("initialize_context");
+    exit(EXIT_FAILURE);
+  }
+  ctx.replay = 1;
+  ctx.quiet = 1;
+  ctx.linger = 1.0;
+  ctx.ident = -1;
+  ctx.format = PING_FORMAT_JSONL; // 再生の要約は標準エラー出力へ
+  int ret = run_replay(&ctx, path);
+  unlink(path);
+
+  current = name;
+  check_case("run_replay", ret, 0);
+  check_case("ident", ctx.ident, IDENT);
+  check_case("sent", ctx.packets_sent, PROBES);
+  check_case("received", ctx.packets_received, PROBES - 2);
+  check_case("duplicate", ctx.packets_duplicate, 1);
+  check_case("timeout", ctx.packets_timeout, 2);
+  check_case("targets", ctx.target_count, 2);
+  check_case("target sent", ctx.target_count == 2 ? ctx.targets[1].packets_sent : -1,
+        PROBES / 2);
+  check_case("target received",
+        ctx.target_count == 2 ? ctx.targets[1].packets_received : -1,
+        PROBES / 2 - 2);
+  check_case("rtt min", ctx.rtt_min, 10.0);
+  check_case("rtt max", ctx.rtt_max, 10.0);
+  cleanup_context(&ctx);
+}
+
+int main(void) {
+  run_case("pcap", 0);
+  run_case("pcapng", 1);
+
+  // キャプチャでないファイルは読まない
+  current = "invalid";
+  PingContext ctx;
+  initialize_context(&ctx);
+  ctx.replay = 1;
+  ctx.format = PING_FORMAT_JSONL;
+  check_case("not a capture", run_replay(&ctx, "Makefile"), -1);
+  cleanup_context(&ctx);
+
+  return check_report("ping_replay_test", NULL);
+}
@@ -0,0 +1,171 @@
+// ping_resolver_test.c: 名前解決のキャッシュファイル（--dns-cache）のテスト
+// 読み込みで期限切れ・形式の崩れた行・長すぎる行を読み飛ばし、同じ名前は期限の遅い方を残すこと、
+// 解決結果を書き戻したファイルを読み直しても同じ名前を引けることを確認する
+// 解決の結果はジョブに直接書くので、DNSもネットワークも使わない
+
+#include "ping_resolver.h"
+#include "test_check.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NAME_MAX_LEN 255 // キャッシュに書ける名前の最大長（ping_resolver.cと同じ）
+
+// キャッシュを引き、見つかったアドレスを文字列で返す（なければ"miss"）
+static const char *lookup(const PingResolver *resolver, const char *name,
+                          char *buf, size_t size) {
+  struct sockaddr_in addr;
+
+  if (!resolver_lookup(resolver, name, &addr)) {
+    return "miss";
+  }
+  inet_ntop(AF_INET, &addr.sin_addr, buf, (socklen_t)size);
+  return buf;
+}
+
+static void check_lookup(const PingResolver *resolver, const char *name,
+                         const char *want) {
+  char buf[INET_ADDRSTRLEN];
+  const char *got = lookup(resolver, name, buf, sizeof(buf));
+  check_that(strcmp(got, want) == 0, "lookup %.40s: got %s want %s", name, got,
+             want);
+}
+
+// ワーカーを起動せずに、解決を終えたジョブとして結果を積む
+static void add_result(PingResolver *resolver, const char *name,
+                       const char *ip, long ttl) {
+  if (resolver_add(resolver, name) < 0) {
+    check("resolver_add", 0, 1);
+    return;
+  }
+  int index = resolver->job_count - 1;
+  PingResolveJob *job = &resolver->jobs[index];
+  job->addr.sin_family = AF_INET;
+  inet_pton(AF_INET, ip, &job->addr.sin_addr);
+  job->ttl = ttl;
+  int *done = realloc(resolver->done, resolver->job_count * sizeof(int));
+  if (!done) {
+    check("realloc", 0, 1);
+    return;
+  }
+  resolver->done = done;
+  resolver->done[resolver->done_count++] = index;
+  resolver->next_job = resolver->job_count;
+  check("collect", resolver_next_result(resolver) == job, 1);
+}
+
+static int count_lines(const char *path) {
+  FILE *fp = fopen(path, "r");
+  int lines = 0;
+  int c;
+
+  if (!fp) {
+    return -1;
+  }
+  while ((c = fgetc(fp)) != EOF) {
+    lines += c == '\n';
+  }
+  fclose(fp);
+  return lines;
+}
+
+int main(void) {
+  char path[] = "/tmp/ping_resolver_test.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  FILE *fp = fdopen(fd, "w");
+  if (!fp) {
+    perror("fdopen");
+    unlink(path);
+    return EXIT_FAILURE;
+  }
+  long long now = (long long)time(NULL);
+  char long_name[600];
+  char max_name[NAME_MAX_LEN + 2];
+
+  // 上限ちょうどの名前は読み、1文字長い名前と512バイトを超える行は読み飛ばす
+  memset(max_name, 'm', NAME_MAX_LEN);
+  max_name[NAME_MAX_LEN] = '\0';
+  memset(long_name, 'l', sizeof(long_name) - 1);
+  long_name[sizeof(long_name) - 1] = '\0';
+
+  // 同じ名前は期限の遅い行が勝つ（ファイル内の順序によらない）
+  fprintf(fp, "%lld 10.0.0.1 dup.example\n", now + 100);
+  fprintf(fp, "%lld 10.0.0.2 dup.example\n", now + 300);
+  fprintf(fp, "%lld 10.0.0.3 dup.example\n", now + 200);
+  // 期限切れ
+  fprintf(fp, "%lld 10.0.0.4 old.example\n", now - 1);
+  fprintf(fp, "%lld 10.0.0.4 dup.example\n", now - 1);
+  // 形式の崩れた行
+  fprintf(fp, "soon 10.0.0.5 word.example\n");
+  fprintf(fp, "%lld\n", now + 100);
+  fprintf(fp, "%lld 10.0.0.5\n", now + 100);
+  fprintf(fp, "%lld 999.0.0.5 badip.example\n", now + 100);
+  // 切り詰めると正しいアドレスに見える長いアドレス
+  fprintf(fp, "%lld 111.222.111.2221 longip.example\n", now + 100);
+  fprintf(fp, "\n");
+  // 長すぎる名前と、バッファに収まらない行（次の行は読める）
+  fprintf(fp, "%lld 10.0.0.6 %sm\n", now + 100, max_name);
+  fprintf(fp, "%lld 10.0.0.7 %s\n", now + 100, long_name);
+  fprintf(fp, "%lld 10.0.0.8 after.example\n", now + 100);
+  fprintf(fp, "%lld 10.0.0.9 %s\n", now + 100, max_name);
+  fclose(fp);
+
+  PingResolver *resolver = create_resolver(1, path);
+  if (!resolver) {
+    fprintf(stderr, "ping_resolver_test: failed to create resolver\n");
+    unlink(path);
+    return EXIT_FAILURE;
+  }
+  check("loaded", resolver->cache_count, 3);
+  check_lookup(resolver, "dup.example", "10.0.0.2");
+  check_lookup(resolver, "after.example", "10.0.0.8");
+  check_lookup(resolver, max_name, "10.0.0.9");
+  check_lookup(resolver, "old.example", "miss");
+  check_lookup(resolver, "word.example", "miss");
+  check_lookup(resolver, "badip.example", "miss");
+  check_lookup(resolver, "longip.example", "miss");
+  check_lookup(resolver, "1", "miss");
+  check_lookup(resolver, "missing.example", "miss");
+  check_lookup(resolver, long_name, "miss");
+
+  // 解決結果を書き戻す（TTLを得ていない名前は書かず、次回にまた解決する）
+  add_result(resolver, "new.example", "10.0.1.1", 60);
+  add_result(resolver, "nottl.example", "10.0.1.2", 0);
+  check("save", save_resolver_cache(resolver), 0);
+  check("saved lines", count_lines(path), 4);
+  close_resolver(resolver);
+
+  // 読み直しても同じ名前を引ける
+  resolver = create_resolver(1, path);
+  check("reloaded", resolver ? resolver->cache_count : -1, 4);
+  if (resolver) {
+    check_lookup(resolver, "dup.example", "10.0.0.2");
+    check_lookup(resolver, "after.example", "10.0.0.8");
+    check_lookup(resolver, max_name, "10.0.0.9");
+    check_lookup(resolver, "new.example", "10.0.1.1");
+    check_lookup(resolver, "nottl.example", "miss");
+    check_lookup(resolver, "old.example", "miss");
+    // 書き戻すものがなければファイルに触れない
+    check("save clean", save_resolver_cache(resolver), 0);
+    close_resolver(resolver);
+  }
+  unlink(path);
+
+  // ファイルがなくても作れ、何も引けない
+  resolver = create_resolver(1, path);
+  check("no file", resolver ? resolver->cache_count : -1, 0);
+  if (resolver) {
+    check_lookup(resolver, "dup.example", "miss");
+    close_resolver(resolver);
+  }
+  unlink(path);
+  return check_report("ping_resolver_test", NULL);
+}
@@ -0,0 +1,117 @@
+// ping_shared_test.c: 共有ファイル（--stats-file）のseqlockのテスト
+// 書き手のスレッドが統計を更新しては写し続け、同時に読み手が写しを取る
+// 書き手は「送信数 = 受信数の2倍 = RTTの記録数の2倍 = 宛先の送信数」を保ったまま更新するので、
+// 読み手の写しでこの関係が崩れていれば書きかけを読んだことになる
+// ソケットは使わないので、どの環境でも実行できる
+
+#include "ping_shared.h"
+#include "ping_engine.h"
+#include "ping_stats.h"
+#include "ping_target.h"
+#include "test_check.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ROUNDS 200000
+
+static int writer_done = 0;
+
+static void *writer(void *arg) {
+  PingContext *ctx = arg;
+  for (int i = 0; i < ROUNDS; i++) {
+    ctx->packets_sent += 2;
+    ctx->packets_received++;
+    ctx->rtt_count++;
+    ctx->rtt_sum += 1.0;
+    histogram_record(&ctx->rtt_hist, 1.0);
+    ctx->targets[0].packets_sent += 2;
+    publish_shared_stats(ctx);
+  }
+  __atomic_store_n(&writer_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+int main(void) {
+  char path[] = "/tmp/ping_shared_test.XXXXXX";
+  int fd = mkstemp(path);
+  PingContext ctx;
+
+  if (fd < 0 || initialize_context(&ctx) < 0 ||
+      add_target(&ctx, "127.0.0.1") < 0) {
+    fprintf(stderr, "ping_shared_test: failed to initialize\n");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  ctx.stats_path = path;
+  check("open", open_shared_stats(&ctx), 0);
+  if (!ctx.shared) {
+    return EXIT_FAILURE;
+  }
+
+  size_t size;
+  const PingSharedStats *shared = map_shared_stats(path, &size);
+  check("map", shared != NULL, 1);
+  if (!shared) {
+    return EXIT_FAILURE;
+  }
+  check("capacity", shared->target_capacity, 1);
+  check("running", shared->running, 1);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, writer, &ctx);
+  PingSharedStats *snap = malloc(size);
+  long long last_sent = 0;
+  long snapshots = 0, torn = 0, backwards = 0;
+  while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+    if (snapshot_shared_stats(shared, size, snap) < 0) {
+      continue;
+    }
+    snapshots++;
+    if (snap->packets_sent != 2 * snap->packets_received ||
+        snap->rtt.count != snap->packets_received ||
+        (long long)snap->hist.total != snap->packets_received ||
+        (snap->target_count == 1 &&
+         snap->targets[0].packets_sent != snap->packets_sent)) {
+      torn++;
+    }
+    if (snap->packets_sent < last_sent) {
+      backwards++;
+    }
+    last_sent = snap->packets_sent;
+  }
+  pthread_join(thread, NULL);
+  check("torn snapshots", torn, 0);
+  check("counters went backwards", backwards, 0);
+  check("took snapshots", snapshots > 0, 1);
+
+  // 閉じた後は最後の統計が終了済みとして残る
+  close_shared_stats(&ctx);
+  check("closed", ctx.shared == NULL, 1);
+  check("final snapshot", snapshot_shared_stats(shared, size, snap), 0);
+  check("final running", snap->running, 0);
+  check("final sent", snap->packets_sent, 2LL * ROUNDS);
+  check("final received", snap->packets_received, ROUNDS);
+  check("final target count", snap->target_count, 1);
+  check("final target sent", snap->targets[0].packets_sent, 2LL * ROUNDS);
+  check("final target ip", strcmp(snap->targets[0].ip, "127.0.0.1"), 0);
+  check("final seq even", snap->seq % 2, 0);
+  check("count below 1ms", histogram_count_below(&snap->hist, 0.5), 0);
+  check("count below 2ms", histogram_count_below(&snap->hist, 2.0), ROUNDS);
+  free(snap);
+  unmap_shared_stats(shared, size);
+
+  // 共有ファイルでないファイルは受け付けない
+  size_t other_size;
+  check("reject other file", map_shared_stats("Makefile", &other_size) == NULL,
+        1);
+
+  unlink(path);
+  cleanup_context(&ctx);
+  char note[32];
+  snprintf(note, sizeof(note), "(%ld snapshots)", snapshots);
+  return check_report("ping_shared_test", note);
+}
@@ -0,0 +1,132 @@
+// ping_stats_test.c: RTTヒストグラムのパーセンタイル誤差テスト
+// ヒストグラムから求めたパーセンタイルと、全ての値を並べ替えて求めた
+// 正確なパーセンタイルの差が、ping.hに書いた誤差(値の1/128)以内であることを確認する
+
+#include "ping_stats.h"
+#include "test_check.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLES 200000
+
+static int compare_ull(const void *a, const void *b) {
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+  return (x > y) - (x < y);
+}
+
+// 並べ替えた値から、histogram_percentileと同じ順位の定義で求める
+static double exact_percentile(const unsigned long long *sorted, long n,
+                               double p) {
+  long rank = (long)ceil(p / 100.0 * (double)n);
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > n) {
+    rank = n;
+  }
+  return (double)sorted[rank - 1];
+}
+
+static void check_percentiles(const char *name, const PingHistogram *hist,
+                              unsigned long long *values, long n) {
+  const double ps[] = {0.0, 1.0, 50.0, 90.0, 99.0, 99.9, 99.99, 100.0};
+
+  qsort(values, n, sizeof(values[0]), compare_ull);
+  for (size_t i = 0; i < sizeof(ps) / sizeof(ps[0]); i++) {
+    double want = exact_percentile(values, n, ps[i]);
+    double got = histogram_percentile(hist, ps[i]) * 1e6;
+    check_that(fabs(got - want) <= want / 128.0 + 1e-3,
+               "%s p%g: got %.1f ns want %.1f ns", name, ps[i], got, want);
+  }
+}
+
+static void record_all(PingHistogram *hist, const unsigned long long *values,
+                       long n) {
+  memset(hist, 0, sizeof(*hist));
+  for (long i = 0; i < n; i++) {
+    histogram_record(hist, (double)values[i] / 1e6);
+  }
+}
+
+int main(void) {
+  unsigned long long *values = malloc(SAMPLES * sizeof(values[0]));
+  PingHistogram *hist = malloc(sizeof(PingHistogram));
+  PingHistogram *part = malloc(sizeof(PingHistogram));
+  if (!values || !hist || !part) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  srand(42);
+
+  // 10ナノ秒〜10秒に対数一様に分布するRTT
+  for (long i = 0; i < SAMPLES; i++) {
+    double exponent = 1.0 + 9.0 * (double)rand() / RAND_MAX;
+    values[i] = (unsigned long long)pow(10.0, exponent);
+  }
+  record_all(hist, values, SAMPLES);
+  check_percentiles("log-uniform", hist, values, SAMPLES);
+
+  // 1ナノ秒刻みのバケットと、対数線形のバケットの境界付近
+  for (long i = 0; i < 5000; i++) {
+    values[i] = (unsigned long long)i;
+  }
+  record_all(hist, values, 5000);
+  check_percentiles("sequential", hist, values, 5000);
+
+  // ループバック程度の狭い範囲に集中したRTT
+  for (long i = 0; i < SAMPLES; i++) {
+    values[i] = 40000 + (unsigned long long)(rand() % 20000);
+  }
+  record_all(hist, values, SAMPLES);
+  check_percentiles("narrow", hist, values, SAMPLES);
+
+  // 2つに分けて記録し合算しても同じ結果になる
+  record_all(hist, values, SAMPLES / 3);
+  record_all(part, values + SAMPLES / 3, SAMPLES - SAMPLES / 3);
+  histogram_merge(hist, part);
+  check_percentiles("merged", hist, values, SAMPLES);
+
+  // 範囲外(約68秒以上)の値は最上位のバケットに入り、最大値は記録した値のまま
+  values[0] = 1000ULL * 1000 * 1000;
+  values[1] = 100ULL * 1000 * 1000 * 1000;
+  record_all(hist, values, 2);
+  cases++;
+  if (histogram_percentile(hist, 100.0) != 100000.0) {
+    fprintf(stderr, "FAIL overflow: got %.3f ms\n",
+            histogram_percentile(hist, 100.0));
+    failures++;
+  }
+
+  // 区間統計は合算でき、リセット後は空になる
+  PingIntervalStats *sum = calloc(1, sizeof(PingIntervalStats));
+  PingIntervalStats *one = calloc(1, sizeof(PingIntervalStats));
+  if (!sum || !one) {
+    perror("calloc");
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < 2; i++) {
+    reset_interval_stats(one);
+    one->packets_sent = 3;
+    one->packets_received = 2;
+    add_rtt_sample(&one->rtt, 1.0 + i);
+    histogram_record(&one->hist, 1.0 + i);
+    merge_interval_stats(sum, one);
+  }
+  check_that(sum->packets_sent == 6 && sum->packets_received == 4 &&
+                 sum->rtt.count == 2 && sum->rtt.min == 1.0 &&
+                 sum->rtt.max == 2.0 && sum->hist.total == 2,
+             "interval merge");
+  reset_interval_stats(sum);
+  check_that(sum->packets_sent == 0 && sum->rtt.count == 0 &&
+                 sum->hist.total == 0,
+             "interval reset");
+
+  free(sum);
+  free(one);
+  free(values);
+  free(hist);
+  free(part);
+  return check_report("ping_stats_test", NULL);
+}
@@ -0,0 +1,141 @@
+// ping_sweep_test.c: データ部サイズの掃引（--sweep）のテスト
+// サイズの並び、長さを変えながら組み立てたパケットのチェックサム、
+// 既知の直線に乗るRTTの近似、ロス率の跳ね上がりの検出を確認する
+// ソケットは使わないので、どの環境でも実行できる
+
+#include "ping_sweep.h"
+#include "ping_checksum.h"
+#include "ping_engine.h"
+#include "ping_target.h"
+#include "ping_tx.h"
+#include "test_check.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 長さを変えながら同じスロットを使い回しても、送る範囲のチェックサムが正しいか
+static void check_tx_checksums(void) {
+  PingTxEngine tx;
+  struct sockaddr_in addr;
+  const int max_data = 100;
+  int bad = 0;
+
+  memset(&addr, 0, sizeof(addr));
+  if (init_tx_engine(&tx, 0x1234, ICMP_HDRLEN + max_data) < 0) {
+    check("tx init", 0, 1);
+    return;
+  }
+  srand(1);
+  for (int seq = 0; seq < 20000; seq++) {
+    // 全長・時刻より短い長さ・ランダムな長さを混ぜる
+    int data = seq % 5 == 0 ? max_data : seq % 7 == 0 ? seq % 16
+                                                      : rand() % (max_data + 1);
+    struct timespec ts = {seq * 7919L, (seq * 104729L) % 1000000000L};
+    prepare_tx_slot(&tx, seq, &ts, &addr, ICMP_HDRLEN + data);
+    int slot = tx.pending - 1;
+    if ((int)tx.iovs[slot].iov_len != ICMP_HDRLEN + data ||
+        ping_checksum(tx.iovs[slot].iov_base, ICMP_HDRLEN + data) != 0) {
+      bad++;
+    }
+    if (tx.pending == PING_TX_BATCH) {
+      tx.pending = 0;
+    }
+  }
+  check("tx checksums", bad, 0);
+  tx.pending = 0;
+  struct timespec ts = {0, 0};
+  check("tx too long", prepare_tx_slot(&tx, 0, &ts, &addr,
+                                       ICMP_HDRLEN + max_data + 1),
+        -1);
+  close_tx_engine(&tx);
+}
+
+int main(void) {
+  PingContext ctx;
+
+  if (initialize_context(&ctx) < 0 || add_target(&ctx, "127.0.0.1") < 0 ||
+      add_target(&ctx, "127.0.0.2") < 0) {
+    fprintf(stderr, "ping_sweep_test: failed to initialize\n");
+    return EXIT_FAILURE;
+  }
+
+  // 刻みで割り切れない範囲でも最後はMAX
+  check("setup", setup_sweep(&ctx, 0, 8972, 512), 0);
+  check("count", ctx.sweep_count, 19);
+  check("data size", ctx.data_size, 8972);
+  check("size 1", sweep_data_size(&ctx, 1), 512);
+  check("size last", sweep_data_size(&ctx, 18), 8972);
+  check("default step", setup_sweep(&ctx, 0, 1500, 0), 0);
+  check("default count", ctx.sweep_count, PING_SWEEP_DEFAULT_SIZES);
+  check("default last", sweep_data_size(&ctx, ctx.sweep_count - 1), 1500);
+  check("single size", setup_sweep(&ctx, 64, 64, 0), 0);
+  check("single count", ctx.sweep_count, 1);
+  check("too many sizes", setup_sweep(&ctx, 0, 65507, 1), -1);
+
+  // -cはサイズごとの数で、INT_MAXにサイズの数を掛けても溢れない
+  check("no limit", sweep_probe_limit(&ctx), 0);
+  ctx.count = 2147483647;
+  check("limit one size", sweep_probe_limit(&ctx), 2147483647LL);
+  setup_sweep(&ctx, 0, 100, 50);
+  check("limit sweep", sweep_probe_limit(&ctx), 3 * 2147483647LL);
+  ctx.count = 0;
+
+  check_tx_checksums();
+
+  // 宛先ごとにサイズを順に使う
+  setup_sweep(&ctx, 0, 1000, 100);
+  PingTarget *a = &ctx.targets[0];
+  PingTarget *b = &ctx.targets[1];
+  check("first index", next_sweep_index(&ctx, a), 0);
+  a->probes_pending = 3;
+  check("pending index", next_sweep_index(&ctx, a), 3);
+  a->probes_pending = 0;
+  a->packets_sent = 12;
+  check("wrapped index", next_sweep_index(&ctx, a), 1);
+  a->packets_sent = 0;
+
+  // RTT = 0.05ms + 100ns/バイト に乗る応答（最小値で近似するので大きい値は影響しない）
+  // 800バイト以上は応答の半分を失う
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < ctx.sweep_count; i++) {
+      int size = sweep_data_size(&ctx, i);
+      count_sweep_send(&ctx, a, i);
+      if (size < 800 || round % 2 == 0) {
+        count_sweep_reply(&ctx, a, i, 0.05 + size * 1e-4 + round * 0.01);
+      }
+    }
+  }
+  PingSweepFit fit;
+  check("fit", fit_sweep(&ctx, a, &fit), 0);
+  check("fit points", fit.points, 11);
+  check_near("fit base", fit.base_ms, 0.05, 1e-9);
+  check_near("fit slope", fit.ms_per_byte, 1e-4, 1e-9);
+  check_near("fit r2", fit.r2, 1.0, 1e-9);
+  check("sent per size", a->sweep[3].packets_sent, 10);
+  check("received per size", a->sweep[9].packets_received, 5);
+  check("no jump below", sweep_loss_jump(&ctx, a, 7), 0);
+  check("jump at 800", sweep_loss_jump(&ctx, a, 8), 1);
+  check("no jump after", sweep_loss_jump(&ctx, a, 9), 0);
+
+  // 応答が1サイズだけの宛先は近似しない
+  count_sweep_send(&ctx, b, 0);
+  count_sweep_reply(&ctx, b, 0, 1.0);
+  check("fit one size", fit_sweep(&ctx, b, &fit), -1);
+
+  char text[8192];
+  FILE *stream = fmemopen(text, sizeof(text), "w");
+  print_sweep_statistics(&ctx, stream);
+  fclose(stream);
+  check("print target", strstr(text, "--- 127.0.0.1 size sweep ---") != NULL,
+        1);
+  check("print jump", strstr(text, "loss jumps between 700 and 800") != NULL,
+        1);
+  check("print slope", strstr(text, "+ 100.000 ns/byte") != NULL, 1);
+  check("print bandwidth", strstr(text, "bandwidth ~160.0 Mbit/s") != NULL, 1);
+  check("print no fit", strstr(text, "not enough sizes") != NULL, 1);
+
+  cleanup_context(&ctx);
+  return check_report("ping_sweep_test", NULL);
+}
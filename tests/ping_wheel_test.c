@@ -0,0 +1,129 @@
+// ping_wheel_test.c: タイマーホイールの満了時刻テスト
+// 大量のタイマーを不規則な間隔で登録・取り消ししながら時刻を進め、
+// 各タイマーがちょうど満了時刻に1回だけ満了し、取り消したタイマーは満了しないこと、
+// timer_wheel_nextが最も早い満了時刻を飛び越えないことを確認する
+
+#include "ping_wheel.h"
+#include "test_check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TIMERS 300000
+#define MAX_DELAY (20ULL * 60 * 1000) // 20分（最上段まで使う）
+
+typedef struct {
+  PingTimerWheel *wheel;
+  unsigned long long *expires; // 登録した満了時刻（0=未登録）
+  long fired;
+} TestState;
+
+static void check_id(const char *name, int ok, int id, unsigned long long now) {
+  check_that(ok, "%s id=%d now=%llu", name, id, now);
+}
+
+static void on_expire(void *arg, int id) {
+  TestState *state = arg;
+  check_id("expire time", state->expires[id] == state->wheel->now, id,
+        state->wheel->now);
+  state->expires[id] = 0;
+  state->fired++;
+}
+
+// 乱数（テストを再現できるよう固定の種を使う）
+static unsigned long long next_random(unsigned long long *seed) {
+  *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return *seed >> 33;
+}
+
+static unsigned long long earliest(const unsigned long long *expires) {
+  unsigned long long best = 0;
+  for (int i = 0; i < TIMERS; i++) {
+    if (expires[i] != 0 && (best == 0 || expires[i] < best)) {
+      best = expires[i];
+    }
+  }
+  return best;
+}
+
+int main(void) {
+  PingTimerWheel wheel;
+  unsigned long long *expires = calloc(TIMERS, sizeof(unsigned long long));
+  unsigned long long seed = 1;
+  unsigned long long now = 123456789;
+
+  if (!expires || init_timer_wheel(&wheel, TIMERS, now) < 0) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  TestState state = {&wheel, expires, 0};
+
+  // 全タイマーを登録し、一部を取り消す・付け替える
+  long added = 0;
+  long cancelled = 0;
+  for (int id = 0; id < TIMERS; id++) {
+    unsigned long long delay = 1 + next_random(&seed) % MAX_DELAY;
+    if (id % 4 == 0) {
+      delay = 1 + next_random(&seed) % 100; // 段0に入る近い時刻
+    }
+    timer_wheel_add(&wheel, id, now + delay);
+    expires[id] = now + delay;
+    added++;
+  }
+  for (int id = 0; id < TIMERS; id += 7) {
+    timer_wheel_cancel(&wheel, id);
+    expires[id] = 0;
+    cancelled++;
+  }
+  for (int id = 3; id < TIMERS; id += 11) {
+    if (expires[id] != 0) {
+      expires[id] = now + 1 + next_random(&seed) % 5000;
+      timer_wheel_add(&wheel, id, expires[id]);
+    }
+  }
+  check_id("count", wheel.count == added - cancelled, -1, now);
+
+  // 次の満了時刻まで進める・不規則な幅で進めるを交互に繰り返す
+  int round = 0;
+  while (wheel.count > 0) {
+    long next = timer_wheel_next(&wheel);
+    if (round % 64 == 0) {
+      unsigned long long first = earliest(expires);
+      check_id("next not after earliest", next > 0 && now + next <= first, -1,
+            now);
+    }
+    if (round % 2 == 0) {
+      now += (unsigned long long)next;
+    } else {
+      now += 1 + next_random(&seed) % 3000;
+    }
+    timer_wheel_advance(&wheel, now, on_expire, &state);
+    round++;
+
+    // 進める途中でも、新しいタイマーを近い時刻に登録できる
+    if (round % 100 == 0) {
+      int id = (int)(next_random(&seed) % TIMERS);
+      if (expires[id] == 0) {
+        expires[id] = now + 1 + next_random(&seed) % 200;
+        timer_wheel_add(&wheel, id, expires[id]);
+        added++;
+      }
+    }
+  }
+  check_id("all fired", state.fired == added - cancelled, -1, now);
+  check_id("none left", earliest(expires) == 0, -1, now);
+
+  // 範囲外の待ち時間は最上段の端に丸め、過ぎた時刻は次の時刻に満了する
+  timer_wheel_add(&wheel, 0, now + (1ULL << 40));
+  check_id("clamped", wheel.nodes[0].expires < now + (1ULL << 40), 0, now);
+  timer_wheel_cancel(&wheel, 0);
+  expires[1] = now + 1;
+  timer_wheel_add(&wheel, 1, now - 5);
+  timer_wheel_advance(&wheel, now + 1, on_expire, &state);
+  check_id("past fired", expires[1] == 0, 1, now);
+  check_id("pending", !timer_wheel_pending(&wheel, 1), 1, now);
+
+  close_timer_wheel(&wheel);
+  free(expires);
+  return check_report("ping_wheel_test", NULL);
+}
@@ -0,0 +1,89 @@
+// ping_window_test.c: 送信記録リングの照合テスト
+// 16ビットのシーケンス番号が一周した後も、応答が正しい送信番号のスロットに
+// 対応付けられ、範囲より古い応答や未送信の番号は照合されないことを確認する
+// 送信番号が2^31を越える長時間の送信や、送信レートに合わせて広げたリングでも
+// 同じように照合できることを確認する
+
+#include "ping_window.h"
+#include "test_check.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void check_seq(const char *name, long long got, long long want, int seq,
+                      long long sent) {
+  check_that(got == want, "%s seq=%d sent=%lld: got %lld want %lld", name, seq,
+             sent, got, want);
+}
+
+// 送信番号firstからcount回送信を続けながら、直近の送信・範囲の端・範囲外の応答を照合する
+static void run_window(PingSeqWindow *window, long long first,
+                       long long count) {
+  for (long long sent = first + 1; sent <= first + count; sent++) {
+    long long number = sent - 1;
+    PingSeqSlot *slot = claim_seq_slot(window, number);
+    slot->target = (int)(number % 7);
+
+    int seq = (int)(number & 0xFFFF);
+    check_seq("latest", seq_window_number(window, seq, sent), number, seq,
+              sent);
+    if (seq_slot(window, number, sent) != slot) {
+      check_seq("latest slot", 0, 1, seq, sent);
+    }
+
+    long long oldest = sent - window->size;
+    if (oldest >= first) {
+      int oldest_seq = (int)(oldest & 0xFFFF);
+      check_seq("oldest", seq_window_number(window, oldest_seq, sent), oldest,
+                oldest_seq, sent);
+      PingSeqSlot *oldest_slot = seq_slot(window, oldest, sent);
+      check_seq("oldest target", oldest_slot ? oldest_slot->target : -1,
+                oldest % 7, oldest_seq, sent);
+    }
+    // シーケンス番号の全体を使うリングでは、範囲より古い応答は直近の送信と区別できない
+    if (oldest >= first + 1 && window->size < PING_SEQ_WINDOW_MAX) {
+      int late_seq = (int)((oldest - 1) & 0xFFFF);
+      check_seq("late", seq_window_number(window, late_seq, sent), -1,
+                late_seq, sent);
+      check_seq("late slot", seq_slot(window, oldest - 1, sent) != NULL, 0,
+                late_seq, sent);
+    }
+  }
+}
+
+int main(void) {
+  PingSeqWindow window;
+  if (create_seq_window(&window, PING_SEQ_WINDOW) < 0) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+
+  run_window(&window, 0, 3 * 65536 + 100);
+  // フラッドで長時間送り続けた後も、2^31・2^32を越えて照合できる
+  run_window(&window, (1LL << 31) - 2 * 65536, 4 * 65536);
+  run_window(&window, (1LL << 32) - 65536, 2 * 65536);
+
+  // 一周する前はまだ送っていない番号を照合しない
+  check_seq("unsent", seq_window_number(&window, 10, 5), -1, 10, 5);
+  check_seq("nothing sent", seq_window_number(&window, 0, 0), -1, 0, 0);
+  check_seq("pending", seq_slot(&window, 5, 5) != NULL, 0, 5, 5);
+  free_seq_window(&window);
+
+  // 応答待ちの送信数に合わせて広げたリングでも同じように照合できる
+  if (create_seq_window(&window, PING_SEQ_WINDOW_MAX) < 0) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  run_window(&window, 0, 3 * 65536 + 100);
+  run_window(&window, (1LL << 32) - 65536, 2 * 65536);
+  free_seq_window(&window);
+
+  // スロット数は応答待ちになりうる送信数以上の2のべき乗で、最小はPING_SEQ_WINDOW
+  check("size small", seq_window_size(10), PING_SEQ_WINDOW);
+  check("size exact", seq_window_size(PING_SEQ_WINDOW), PING_SEQ_WINDOW);
+  check("size next", seq_window_size(PING_SEQ_WINDOW + 1), 2 * PING_SEQ_WINDOW);
+  check("size max", seq_window_size(PING_SEQ_WINDOW_MAX), PING_SEQ_WINDOW_MAX);
+  check("size over", seq_window_size(PING_SEQ_WINDOW_MAX + 1), -1);
+
+  return check_report("ping_window_test", NULL);
+}
@@ -0,0 +1,58 @@
+// test_check.h: テスト共通の確認関数
+// 確認した数と失敗した数を数え、失敗は名前と値を標準エラーに表示する
+// 各テストの.cからincludeする（テストごとに別の実行ファイルなので、カウンタはstaticでよい）
+
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures = 0;
+static long cases = 0;
+
+// 1件の確認を数え、okでなければ"FAIL "に続けて書式どおりに表示する
+// （戻り値: ok）
+static inline int check_that(int ok, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static inline int check_that(int ok, const char *format, ...) {
+  cases++;
+  if (!ok) {
+    va_list ap;
+    va_start(ap, format);
+    fputs("FAIL ", stderr);
+    vfprintf(stderr, format, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    failures++;
+  }
+  return ok;
+}
+
+// 整数の一致
+static inline void check(const char *name, long long got, long long want) {
+  check_that(got == want, "%s: got %lld want %lld", name, got, want);
+}
+
+// 実数が誤差tolerance以内で一致するか
+static inline void check_near(const char *name, double got, double want,
+                              double tolerance) {
+  check_that(fabs(got - want) <= tolerance, "%s: got %.9f want %.9f", name, got,
+             want);
+}
+
+// 結果を表示し、mainの戻り値を返す（noteは成功時に件数の後へ添える、NULL=なし）
+static inline int check_report(const char *test, const char *note) {
+  if (failures > 0) {
+    fprintf(stderr, "%s: %d of %ld checks failed\n", test, failures, cases);
+    return EXIT_FAILURE;
+  }
+  printf("%s: %ld checks passed%s%s\n", test, cases, note ? " " : "",
+         note ? note : "");
+  return EXIT_SUCCESS;
+}
+
+#endif // TEST_CHECK_H
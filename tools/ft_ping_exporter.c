@@ -0,0 +1,390 @@
+// ft_ping_exporter.c: --stats-fileで共有した実行中の統計を、Prometheusのテキスト形式で出力する
+// --listen SOCKETを指定するとUnixドメインソケットでHTTPのリクエストを待ち、接続ごとにその時点の統計を返す
+// 指定しなければ1回だけ標準出力に書く（node_exporterのtextfileコレクタなどに渡せる）
+// 複数のファイル（--threadsのワーカーごとのファイルや、複数のft_ping）は合算し、
+// 宛先ごとの統計は同じ宛先（IPとホスト名が同じ）をまとめる
+// 読むたびにファイルをmmapし直してseqlockで写すので、ft_pingの送受信を止めない
+
+#include "ping.h"
+#include "ping_shared.h"
+#include "ping_stats.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ft_ping_rtt_secondsのバケットの上端(秒)
+static const double rtt_buckets[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025,
+                                     0.005,  0.01,    0.025,  0.05,  0.1,
+                                     0.25,   0.5,     1.0,    2.5,   5.0,
+                                     10.0};
+static const double rtt_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static volatile sig_atomic_t g_stop = 0;
+
+// 全ファイルを合算した統計
+typedef struct {
+  int files;                  // 読めたファイル数
+  int running;                // 送受信中のファイル数
+  long long updated_unix_ns;  // 最も新しい更新時刻
+  long long packets_sent;
+  long long packets_received;
+  long long packets_duplicate;
+  long long packets_late;
+  long long packets_timeout;
+  PingRttStats rtt;
+  PingHistogram hist;
+  PingSharedTarget *targets;  // 宛先ごとの統計（動的割り当て）
+  int target_count;
+} ExportStats;
+
+static void on_signal(int sig) {
+  (void)sig;
+  g_stop = 1;
+}
+
+// 共有ファイル1つの写しを取り、statsへ足し込む
+static int load_file(ExportStats *stats, const char *path) {
+  size_t size;
+  const PingSharedStats *shared = map_shared_stats(path, &size);
+  if (!shared) {
+    return -1;
+  }
+  PingSharedStats *snap = malloc(size);
+  if (!snap || snapshot_shared_stats(shared, size, snap) < 0) {
+    fprintf(stderr, "ft_ping_exporter: %s: no consistent snapshot\n", path);
+    free(snap);
+    unmap_shared_stats(shared, size);
+    return -1;
+  }
+  unmap_shared_stats(shared, size);
+
+  PingSharedTarget *targets =
+      realloc(stats->targets, (stats->target_count + snap->target_count) *
+                                  sizeof(PingSharedTarget));
+  if (!targets && stats->target_count + snap->target_count > 0) {
+    fprintf(stderr, "ft_ping_exporter: out of memory\n");
+    free(snap);
+    return -1;
+  }
+  stats->targets = targets;
+  memcpy(stats->targets + stats->target_count, snap->targets,
+         snap->target_count * sizeof(PingSharedTarget));
+  stats->target_count += snap->target_count;
+
+  stats->files++;
+  stats->running += snap->running;
+  if (snap->updated_unix_ns > stats->updated_unix_ns) {
+    stats->updated_unix_ns = snap->updated_unix_ns;
+  }
+  stats->packets_sent += snap->packets_sent;
+  stats->packets_received += snap->packets_received;
+  stats->packets_duplicate += snap->packets_duplicate;
+  stats->packets_late += snap->packets_late;
+  stats->packets_timeout += snap->packets_timeout;
+  merge_rtt_stats(&stats->rtt, &snap->rtt);
+  histogram_merge(&stats->hist, &snap->hist);
+  free(snap);
+  return 0;
+}
+
+static int compare_targets(const void *a, const void *b) {
+  const PingSharedTarget *x = a;
+  const PingSharedTarget *y = b;
+  int cmp = strcmp(x->ip, y->ip);
+  return cmp != 0 ? cmp : strcmp(x->hostname, y->hostname);
+}
+
+// 同じ宛先（IPとホスト名が同じ）の行をまとめる
+static void merge_targets(ExportStats *stats) {
+  if (stats->target_count < 2) {
+    return;
+  }
+  qsort(stats->targets, stats->target_count, sizeof(PingSharedTarget),
+        compare_targets);
+  int out = 0;
+  for (int i = 1; i < stats->target_count; i++) {
+    PingSharedTarget *dst = &stats->targets[out];
+    const PingSharedTarget *src = &stats->targets[i];
+    if (compare_targets(dst, src) != 0) {
+      stats->targets[++out] = *src;
+      continue;
+    }
+    dst->packets_sent += src->packets_sent;
+    dst->packets_received += src->packets_received;
+    dst->packets_duplicate += src->packets_duplicate;
+    merge_rtt_stats(&dst->rtt, &src->rtt);
+  }
+  stats->target_count = out + 1;
+}
+
+// ラベルの値を書く（\ " 改行をエスケープする）
+static void put_label(FILE *out, const char *value) {
+  for (const char *p = value; *p; p++) {
+    if (*p == '\\' || *p == '"') {
+      fputc('\\', out);
+      fputc(*p, out);
+    } else if (*p == '\n') {
+      fputs("\\n", out);
+    } else {
+      fputc(*p, out);
+    }
+  }
+}
+
+static void put_header(FILE *out, const char *name, const char *type,
+                       const char *help) {
+  fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void put_target_value(FILE *out, const char *name,
+                             const PingSharedTarget *target, double value) {
+  fprintf(out, "%s{host=\"", name);
+  put_label(out, target->hostname);
+  fprintf(out, "\",addr=\"%s\"} %.9g\n", target->ip, value);
+}
+
+static void write_metrics(FILE *out, const ExportStats *stats) {
+  put_header(out, "ft_ping_stats_files", "gauge",
+             "Number of ft_ping stats files read.");
+  fprintf(out, "ft_ping_stats_files %d\n", stats->files);
+  put_header(out, "ft_ping_running", "gauge",
+             "Number of stats files whose ft_ping is still probing.");
+  fprintf(out, "ft_ping_running %d\n", stats->running);
+  put_header(out, "ft_ping_last_update_timestamp_seconds", "gauge",
+             "Unix time of the most recent statistics update.");
+  fprintf(out, "ft_ping_last_update_timestamp_seconds %.3f\n",
+          stats->updated_unix_ns / 1e9);
+
+  put_header(out, "ft_ping_probes_sent_total", "counter",
+             "Echo requests sent.");
+  fprintf(out, "ft_ping_probes_sent_total %lld\n", stats->packets_sent);
+  put_header(out, "ft_ping_replies_total", "counter",
+             "Echo replies received (not counting duplicates).");
+  fprintf(out, "ft_ping_replies_total %lld\n", stats->packets_received);
+  put_header(out, "ft_ping_duplicate_replies_total", "counter",
+             "Duplicate echo replies received.");
+  fprintf(out, "ft_ping_duplicate_replies_total %lld\n",
+          stats->packets_duplicate);
+  put_header(out, "ft_ping_late_replies_total", "counter",
+             "Replies too old to match a probe.");
+  fprintf(out, "ft_ping_late_replies_total %lld\n", stats->packets_late);
+  put_header(out, "ft_ping_probe_timeouts_total", "counter",
+             "Probes with no reply within the wait time.");
+  fprintf(out, "ft_ping_probe_timeouts_total %lld\n", stats->packets_timeout);
+
+  put_header(out, "ft_ping_rtt_seconds", "histogram", "Round-trip time.");
+  for (size_t i = 0; i < sizeof(rtt_buckets) / sizeof(rtt_buckets[0]); i++) {
+    fprintf(out, "ft_ping_rtt_seconds_bucket{le=\"%g\"} %llu\n", rtt_buckets[i],
+            histogram_count_below(&stats->hist, rtt_buckets[i] * 1000.0));
+  }
+  fprintf(out, "ft_ping_rtt_seconds_bucket{le=\"+Inf\"} %llu\n",
+          stats->hist.total);
+  fprintf(out, "ft_ping_rtt_seconds_sum %.9f\n", stats->rtt.sum / 1000.0);
+  fprintf(out, "ft_ping_rtt_seconds_count %ld\n", stats->rtt.count);
+  put_header(out, "ft_ping_rtt_quantile_seconds", "gauge",
+             "Round-trip time quantiles from the histogram (within 0.8%).");
+  for (size_t i = 0; i < sizeof(rtt_quantiles) / sizeof(rtt_quantiles[0]);
+       i++) {
+    fprintf(out, "ft_ping_rtt_quantile_seconds{quantile=\"%g\"} %.9f\n",
+            rtt_quantiles[i],
+            histogram_percentile(&stats->hist, rtt_quantiles[i] * 100.0) /
+                1000.0);
+  }
+
+  if (stats->target_count == 0) {
+    return;
+  }
+  put_header(out, "ft_ping_target_probes_sent_total", "counter",
+             "Echo requests sent per destination.");
+  for (int i = 0; i < stats->target_count; i++) {
+    put_target_value(out, "ft_ping_target_probes_sent_total",
+                     &stats->targets[i], stats->targets[i].packets_sent);
+  }
+  put_header(out, "ft_ping_target_replies_total", "counter",
+             "Echo replies received per destination.");
+  for (int i = 0; i < stats->target_count; i++) {
+    put_target_value(out, "ft_ping_target_replies_total", &stats->targets[i],
+                     stats->targets[i].packets_received);
+  }
+  put_header(out, "ft_ping_target_duplicate_replies_total", "counter",
+             "Duplicate echo replies received per destination.");
+  for (int i = 0; i < stats->target_count; i++) {
+    put_target_value(out, "ft_ping_target_duplicate_replies_total",
+                     &stats->targets[i], stats->targets[i].packets_duplicate);
+  }
+  put_header(out, "ft_ping_target_rtt_seconds", "summary",
+             "Round-trip time per destination.");
+  for (int i = 0; i < stats->target_count; i++) {
+    put_target_value(out, "ft_ping_target_rtt_seconds_sum", &stats->targets[i],
+                     stats->targets[i].rtt.sum / 1000.0);
+    put_target_value(out, "ft_ping_target_rtt_seconds_count",
+                     &stats->targets[i], stats->targets[i].rtt.count);
+  }
+  put_header(out, "ft_ping_target_rtt_min_seconds", "gauge",
+             "Smallest round-trip time per destination.");
+  for (int i = 0; i < stats->target_count; i++) {
+    if (stats->targets[i].rtt.count > 0) {
+      put_target_value(out, "ft_ping_target_rtt_min_seconds",
+                       &stats->targets[i], stats->targets[i].rtt.min / 1000.0);
+    }
+  }
+  put_header(out, "ft_ping_target_rtt_max_seconds", "gauge",
+             "Largest round-trip time per destination.");
+  for (int i = 0; i < stats->target_count; i++) {
+    if (stats->targets[i].rtt.count > 0) {
+      put_target_value(out, "ft_ping_target_rtt_max_seconds",
+                       &stats->targets[i], stats->targets[i].rtt.max / 1000.0);
+    }
+  }
+}
+
+// 全ファイルを読んでoutに書く（戻り値: 読めたファイル数）
+static int export_files(FILE *out, char **files, int file_count) {
+  ExportStats stats;
+  memset(&stats, 0, sizeof(stats));
+  for (int i = 0; i < file_count; i++) {
+    load_file(&stats, files[i]);
+  }
+  merge_targets(&stats);
+  write_metrics(out, &stats);
+  free(stats.targets);
+  return stats.files;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+// 接続1つ分: リクエストヘッダを読み捨て、パスによらずその時点の統計を返す
+static void serve_client(int client, char **files, int file_count) {
+  char request[4096];
+  size_t used = 0;
+  struct timeval timeout = {1, 0};
+
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  while (used < sizeof(request) - 1) {
+    ssize_t n = read(client, request + used, sizeof(request) - 1 - used);
+    if (n <= 0) {
+      break;
+    }
+    used += (size_t)n;
+    request[used] = '\0';
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+      break;
+    }
+  }
+
+  char *body = NULL;
+  size_t body_len = 0;
+  FILE *out = open_memstream(&body, &body_len);
+  if (!out) {
+    return;
+  }
+  export_files(out, files, file_count);
+  fclose(out);
+
+  char header[256];
+  int header_len = snprintf(header, sizeof(header),
+                            "HTTP/1.0 200 OK\r\n"
+                            "Content-Type: text/plain; version=0.0.4\r\n"
+                            "Content-Length: %zu\r\n\r\n",
+                            body_len);
+  if (write_all(client, header, (size_t)header_len) == 0) {
+    write_all(client, body, body_len);
+  }
+  free(body);
+}
+
+static int serve(const char *socket_path, char **files, int file_count) {
+  struct sockaddr_un addr;
+
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "ft_ping_exporter: %s: socket path too long\n",
+            socket_path);
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("ft_ping_exporter: socket failed");
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_path);
+  // 前回の実行で残ったソケットは置き換える
+  unlink(socket_path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, 16) < 0) {
+    fprintf(stderr, "ft_ping_exporter: %s: %s\n", socket_path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  while (!g_stop) {
+    int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client < 0) {
+      if (errno != EINTR) {
+        perror("ft_ping_exporter: accept failed");
+      }
+      continue;
+    }
+    serve_client(client, files, file_count);
+    close(client);
+  }
+  close(fd);
+  unlink(socket_path);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *listen_path = NULL;
+  int first = 1;
+
+  if (argc > 2 && strcmp(argv[1], "--listen") == 0) {
+    listen_path = argv[2];
+    first = 3;
+  }
+  if (first >= argc || strcmp(argv[1], "--help") == 0) {
+    fprintf(stderr, "Usage: ft_ping_exporter [--listen SOCKET] FILE...\n");
+    fprintf(stderr, "Export live ft_ping statistics published with "
+                    "--stats-file in the Prometheus text format,\n"
+                    "once to stdout or over HTTP on a Unix socket.\n");
+    return first >= argc ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  if (!listen_path) {
+    return export_files(stdout, argv + first, argc - first) > 0
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+  }
+
+  // 終了シグナルでacceptを中断し、ソケットを消してから終わる
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  return serve(listen_path, argv + first, argc - first) < 0 ? EXIT_FAILURE
+                                                             : EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+// ft_ping_read.c: --recordで書いた記録ファイルを読み、ft_pingの終了時と同じ統計を表示する
+// 複数のファイル（複数のプロセスや--threadsのワーカーごとのファイル）を渡すと、
+// 同じ宛先（IPとホスト名が同じ）の統計をまとめて1つの統計として表示する
+
+#include "ping.h"
+#include "ping_engine.h"
+#include "ping_record.h"
+#include "ping_summary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+int main(int argc, char *argv[]) {
+  PingContext ctx;
+  int files = 0;
+  long records = 0;
+  double bytes = 0.0;
+
+  if (argc < 2 || strcmp(argv[1], "--help") == 0) {
+    fprintf(stderr, "Usage: ft_ping_read FILE...\n");
+    fprintf(stderr, "Print ft_ping statistics from probe logs written with "
+                    "--record.\n");
+    return argc < 2 ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  if (initialize_context(&ctx) < 0) {
+    fprintf(stderr, "ft_ping: failed to initialize context\n");
+    return EXIT_FAILURE;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 1; i < argc; i++) {
+    long count = read_record_file(&ctx, argv[i]);
+    if (count < 0) {
+      cleanup_context(&ctx);
+      return EXIT_FAILURE;
+    }
+    struct stat st;
+    if (stat(argv[i], &st) == 0) {
+      bytes += st.st_size;
+    }
+    records += count;
+    files++;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (end.tv_sec - start.tv_sec) +
+                   (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("read: %ld records from %d file%s, %.1f MB in %.3f s\n", records,
+         files, files == 1 ? "" : "s", bytes / 1e6, elapsed);
+  print_statistics(&ctx);
+  cleanup_context(&ctx);
+  return EXIT_SUCCESS;
+}